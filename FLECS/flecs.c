@@ -478,6 +478,9 @@ typedef struct ecs_table__t {
     struct ecs_table_record_t *records; /* Array with table records */
     ecs_hashmap_t *name_index;       /* Cached pointer to name index */
 
+    uint32_t *chunk_ticks;           /* Change ticks per chunk & column */
+    int32_t chunk_count;             /* Number of chunks in chunk_ticks */
+
 #ifdef FLECS_DEBUG_INFO
     /* Fields used for debug visualization */
     struct {
@@ -636,8 +639,25 @@ void flecs_table_swap(
 void flecs_table_mark_dirty(
     ecs_world_t *world,
     ecs_table_t *table,
+    int32_t row,
     ecs_entity_t component);
 
+/* Mark rows dirty for chunk change detection. The index is the column offset by
+ * one, with 0 indicating the entity column. If index is -1, rows are marked 
+ * dirty for all columns. */
+void flecs_table_mark_rows_dirty(
+    ecs_world_t *world,
+    ecs_table_t *table,
+    int32_t index,
+    int32_t row,
+    int32_t count);
+
+/* Get (or create) change ticks for chunks of table. Used for chunk based change
+ * detection. */
+uint32_t* flecs_table_get_chunk_ticks(
+    ecs_world_t *world,
+    ecs_table_t *table);
+
 void flecs_table_notify(
     ecs_world_t *world,
     ecs_table_t *table,
@@ -812,11 +832,13 @@ typedef struct ecs_cmd_n_t {
     int32_t count;
 } ecs_cmd_n_t;
 
+/* Commands are kept compact (48 bytes) since queues can hold millions of them.
+ * The system that enqueued a command is only stored while commands are being
+ * captured, in ecs_commands_t::systems. */
 typedef struct ecs_cmd_t {
     ecs_cmd_kind_t kind;             /* Command kind */
     int32_t next_for_entity;         /* Next operation for entity */    
     ecs_id_t id;                     /* (Component) id */
-    ecs_component_record_t *cdr;            /* component record (only for set/mut/emplace) */
     ecs_cmd_entry_t *entry;
     ecs_entity_t entity;             /* Entity id */
 
@@ -824,14 +846,20 @@ typedef struct ecs_cmd_t {
         ecs_cmd_1_t _1;              /* Data for single entity operation */
         ecs_cmd_n_t _n;              /* Data for multi entity operation */
     } is;
-
-    ecs_entity_t system;             /* System that enqueued the command */
 } ecs_cmd_t;
 
+/* Component assigned by a command that was applied in parallel, which still 
+ * needs to be marked dirty for change detection. */
+typedef struct ecs_cmd_dirty_t {
+    ecs_table_t *table;
+    int32_t row;
+    ecs_id_t id;
+} ecs_cmd_dirty_t;
+
 /** Callback used to capture commands of a frame */
 typedef void (*ecs_on_commands_action_t)(
     const ecs_stage_t *stage,
-    const ecs_vec_t *commands,
+    const ecs_commands_t *commands,
     void *ctx);
 
 /** A stage is a context that allows for safely using the API from multiple 
@@ -856,6 +884,7 @@ struct ecs_stage_t {
     /* Command queue */
     ecs_commands_t *cmd;
     ecs_commands_t cmd_stack[2];     /* Two so we can flush one & populate the other */
+    ecs_commands_t cmd_overlap;      /* Commands of systems that ran during merge */
     bool cmd_flushing;               /* Ensures only one defer_end call flushes */
 
     /* Thread context */
@@ -866,6 +895,20 @@ struct ecs_stage_t {
     /* One-shot actions to be executed after the merge */
     ecs_vec_t post_frame_actions;
 
+    /* Commands applied by flecs_stage_merge_parallel */
+    ecs_vec_t parallel_dirty;        /* vector<ecs_cmd_dirty_t> */
+    int32_t parallel_set_count;
+
+    /* Thread affinity for worker that runs stage, -1 if not set */
+    int32_t cpu;
+    int32_t numa_node;
+
+    /* Entity ids reserved by stage in deterministic mode */
+    ecs_entity_t id_next;            /* Next id in current block */
+    ecs_entity_t id_end;             /* End of current block */
+    int32_t id_block_count;          /* Blocks reserved since readonly_begin */
+    ecs_vec_t id_blocks;             /* Reserved blocks that haven't been used */
+
     /* Namespacing */
     ecs_entity_t scope;              /* Entity of current scope */
     ecs_entity_t with;               /* Id to add by default to new entities */
@@ -887,6 +930,11 @@ struct ecs_stage_t {
     /* Thread specific runtime for script execution */
     ecs_script_runtime_t *runtime;
 #endif
+
+#ifdef FLECS_PERF_COUNTERS
+    /* Hardware performance counters for systems ran by stage */
+    struct ecs_system_perf_t *perf;
+#endif
 };
 
 /* Component monitor */
@@ -942,6 +990,30 @@ typedef struct ecs_action_elem_t {
 
 typedef struct ecs_pipeline_state_t ecs_pipeline_state_t;
 
+/* Parsed terms for a query DSL expression */
+typedef struct ecs_query_expr_entry_t {
+    char *expr;                      /* Normalized expression (cache key) */
+    ecs_size_t expr_len;
+    ecs_entity_t scope;              /* Scope used to resolve identifiers */
+    ecs_entity_t *lookup_path;       /* Lookup path used to resolve identifiers */
+    int32_t lookup_path_count;
+    uint64_t hash;
+    ecs_term_t *terms;               /* Terms as returned by the parser */
+    int32_t term_count;
+    char *tokens;                    /* Token buffer referenced by term names */
+    ecs_size_t tokens_len;
+    struct ecs_query_expr_entry_t *prev; /* Previous (more recently used) */
+    struct ecs_query_expr_entry_t *next; /* Next (less recently used) */
+} ecs_query_expr_entry_t;
+
+/* LRU cache with parser output for query expressions */
+typedef struct ecs_query_expr_cache_t {
+    ecs_map_t index;                 /* map<hash, ecs_query_expr_entry_t*> */
+    ecs_query_expr_entry_t *first;   /* Most recently used entry */
+    ecs_query_expr_entry_t *last;    /* Least recently used entry */
+    int32_t count;
+} ecs_query_expr_cache_t;
+
 /** The world stores and manages all ECS data. An application can have more than
  * one world, but data is not shared between worlds. */
 struct ecs_world_t {
@@ -968,6 +1040,14 @@ struct ecs_world_t {
     /* Unique id per generated event used to prevent duplicate notifications */
     int32_t event_id;
 
+    /* Events collected while commands are merged, see flecs_emit_batch_begin */
+    ecs_vec_t event_batches;         /* vec<ecs_event_batch_t> */
+    bool event_batching;
+
+    /* Incremented when tables or entities are added to or removed from 
+     * traversable hierarchies. Invalidates event propagation caches. */
+    int32_t propagate_version;
+
     /* Array of table versions used with component refs to determine if the 
      * cached pointer is still valid. */
     uint32_t table_version[ECS_TABLE_VERSION_ARRAY_SIZE];
@@ -975,6 +1055,9 @@ struct ecs_world_t {
     /* Is entity range checking enabled? */
     bool range_check_enabled;
 
+    /* Tick used for chunk based change detection */
+    uint32_t change_tick;
+
     /* --  Data storage -- */
     ecs_store_t store;
 
@@ -991,6 +1074,7 @@ struct ecs_world_t {
     /* -- Staging -- */
     ecs_stage_t **stages;            /* Stages */
     int32_t stage_count;             /* Number of stages */
+    ecs_entity_t id_block_base;      /* Base for stage id blocks (deterministic mode) */
 
     /* -- Component ids -- */
     ecs_vec_t component_ids;         /* World local component ids */
@@ -1010,8 +1094,12 @@ struct ecs_world_t {
     ecs_os_mutex_t sync_mutex;       /* Mutex for job_cond */
     int32_t workers_running;         /* Number of threads running */
     int32_t workers_waiting;         /* Number of workers waiting on sync */
+    int32_t workers_sleeping;        /* Number of threads blocked on a cond */
+    int32_t sync_epoch;              /* Incremented when workers are signaled */
+    bool workers_merge;              /* Workers should merge instead of run */
     ecs_pipeline_state_t* pq;        /* Pointer to the pipeline for the workers to execute */
     bool workers_use_task_api;       /* Workers are short-lived tasks, not long-running threads */
+    bool main_affinity_set;          /* Affinity of calling thread was set by ecs_set_threads_w_desc */
 
     /* -- Time management -- */
     ecs_time_t world_start_time;     /* Timestamp of simulation start */
@@ -1027,6 +1115,9 @@ struct ecs_world_t {
     /* -- Default query flags -- */
     ecs_flags32_t default_query_flags;
 
+    /* -- Parsed query expressions -- */
+    ecs_query_expr_cache_t query_expr_cache;
+
     /* Count that increases when component monitors change */
     int32_t monitor_generation;
 
@@ -1130,6 +1221,21 @@ typedef struct ecs_reachable_cache_t {
     ecs_vec_t ids; /* vec<reachable_elem_t> */
 } ecs_reachable_cache_t;
 
+/* Table that events for a target are propagated to */
+typedef struct ecs_propagate_elem_t {
+    ecs_table_t *table;
+    ecs_entity_t trav;            /* Relationship used to reach table */
+} ecs_propagate_elem_t;
+
+/* Flattened result of walking the traversable relationships of a target, so
+ * that propagating an event doesn't have to walk the hierarchy again. The 
+ * cache is valid as long as the world propagate_version doesn't change. */
+typedef struct ecs_propagate_cache_t {
+    int32_t version;
+    ecs_vec_t tables;             /* vec<ecs_propagate_elem_t> */
+    ecs_vec_t records;            /* vec<ecs_component_record_t*> */
+} ecs_propagate_cache_t;
+
 /* Component index data that just applies to pairs */
 typedef struct ecs_pair_id_record_t {
     /* Name lookup index (currently only used for ChildOf pairs) */
@@ -1146,6 +1252,9 @@ typedef struct ecs_pair_id_record_t {
 
     /* Cache for finding components that are reachable through a relationship */
     ecs_reachable_cache_t reachable;
+
+    /* Cache for tables that events are propagated to, for (*, T) records */
+    ecs_propagate_cache_t propagate;
 } ecs_pair_id_record_t;
 
 /* Payload for id index which contains all data structures for an id. */
@@ -2438,6 +2547,10 @@ int flecs_query_finalize_query(
     ecs_query_t *q,
     const ecs_query_desc_t *desc);
 
+/* Free entries of the query expression cache */
+void flecs_query_expr_cache_fini(
+    ecs_world_t *world);
+
 /* Internal function for creating iterator, doesn't run aperiodic tasks */
 ecs_iter_t flecs_query_iter(
     const ecs_world_t *world,
@@ -2474,6 +2587,18 @@ typedef struct ecs_event_id_record_t {
     int32_t observer_count;
 } ecs_event_id_record_t;
 
+/** Flattened list of observers for an event and a concrete (component) id.
+ * Includes observers for wildcard ids that match the id, so that emitting an
+ * event requires a single lookup. Rebuilt when the version of the event
+ * record no longer matches, which happens when observers are created or
+ * deleted. */
+typedef struct ecs_event_fanout_t {
+    ecs_event_id_record_t *iders[5]; /* Observer sets that match the id */
+    int32_t ider_count;
+    ecs_vec_t observers;             /* vec<ecs_observer_t*> (self, self_up) */
+    int32_t version;
+} ecs_event_fanout_t;
+
 typedef struct ecs_observer_impl_t {
     ecs_observer_t pub;
 
@@ -2490,10 +2615,25 @@ typedef struct ecs_observer_impl_t {
     ecs_query_t *not_query;     /**< Query used to populate observer data when a
                                      term with a not operator triggers. */
 
+    struct ecs_observer_async_t *async; /**< Event queue of async observer */
+
     /* Mixins */
     flecs_poly_dtor_t dtor;
 } ecs_observer_impl_t;
 
+/* Event queued for an async observer */
+typedef struct ecs_observer_async_event_t {
+    ecs_entity_t entity;
+    ecs_entity_t event;
+} ecs_observer_async_event_t;
+
+typedef struct ecs_observer_async_t {
+    ecs_vec_t queue;            /**< vec<ecs_observer_async_event_t> */
+    ecs_map_t index;            /**< map<entity, index in queue> */
+    ecs_entity_t system;        /**< System that processes the queue */
+    int32_t processed;          /**< Number of events processed by system */
+} ecs_observer_async_t;
+
 #define flecs_observer_impl(observer) (ECS_CONST_CAST(ecs_observer_impl_t*, observer))
 
 ecs_event_record_t* flecs_event_record_get(
@@ -2517,6 +2657,26 @@ void flecs_event_id_record_remove(
     ecs_event_record_t *er,
     ecs_id_t id);
 
+/* Get flattened list of observers for event record and id */
+ecs_event_fanout_t* flecs_event_fanout_get(
+    ecs_event_record_t *er,
+    ecs_id_t id);
+
+/* Free flattened lists of observers for id, when its component record is 
+ * deleted */
+void flecs_observable_fanout_remove(
+    ecs_observable_t *observable,
+    ecs_id_t id);
+
+/* Invoke observers in fanout for self and self_up terms */
+void flecs_event_fanout_invoke(
+    ecs_world_t *world,
+    ecs_event_record_t *er,
+    ecs_event_fanout_t *fanout,
+    ecs_id_t id,
+    ecs_iter_t *it,
+    ecs_table_t *table);
+
 void flecs_observable_init(
     ecs_observable_t *observable);
 
@@ -2542,6 +2702,34 @@ void flecs_emit(
     ecs_flags64_t *set_mask,
     ecs_event_desc_t *desc);
 
+/* Events with the same kind, ids and previous table that are collected by a
+ * batched operation. Entities are stored instead of rows, as rows can change
+ * before the batch is flushed. */
+typedef struct ecs_event_batch_t {
+    ecs_entity_t event;
+    ecs_type_t ids;
+    ecs_table_t *other_table;
+    ecs_flags32_t flags;
+    ecs_vec_t entities;
+} ecs_event_batch_t;
+
+/* Start collecting OnAdd/OnSet events. Returns false if already batching. */
+bool flecs_emit_batch_begin(
+    ecs_world_t *world);
+
+/* Emit collected events for maximal table ranges and stop batching */
+void flecs_emit_batch_end(
+    ecs_world_t *world);
+
+/* Emit collected events and stop batching, for operations that write component
+ * values after OnAdd observers are invoked. Returns false if not batching. */
+bool flecs_emit_batch_suspend(
+    ecs_world_t *world);
+
+/* Resume batching after flecs_emit_batch_suspend */
+void flecs_emit_batch_resume(
+    ecs_world_t *world);
+
 bool flecs_default_next_callback(
     ecs_iter_t *it);
 
@@ -2552,6 +2740,13 @@ void flecs_observers_invoke(
     ecs_table_t *table,
     ecs_entity_t trav);
 
+void flecs_uni_observer_invoke(
+    ecs_world_t *world,
+    ecs_observer_t *o,
+    ecs_iter_t *it,
+    ecs_table_t *table,
+    ecs_entity_t trav);
+
 void flecs_emit_propagate_invalidate(
     ecs_world_t *world,
     ecs_table_t *table,
@@ -2564,6 +2759,26 @@ void flecs_observer_set_disable_bit(
     ecs_flags32_t bit,
     bool cond);
 
+/* Invoke async observer for part of its queue. Called on each worker. */
+void flecs_observer_async_run(
+    ecs_world_t *stage,
+    ecs_observer_t *o,
+    int32_t stage_index,
+    int32_t stage_count);
+
+/* Remove events processed by the last run from async observer queue. */
+void flecs_observer_async_flush(
+    ecs_world_t *world,
+    ecs_observer_t *o);
+
+#ifdef FLECS_SYSTEM
+/* Create system that runs async observer in phase (see system.c) */
+ecs_entity_t flecs_observer_async_system_init(
+    ecs_world_t *world,
+    ecs_observer_t *o,
+    ecs_entity_t phase);
+#endif
+
 #endif
 
 /**
@@ -2600,6 +2815,17 @@ void flecs_iter_free(
 #define flecs_iter_free_n(ptr, T, count)\
     flecs_iter_free(ptr, ECS_SIZEOF(T) * count)
 
+/* Create worker iterator that dynamically claims chunks from a counter that is
+ * shared between workers. The counter must be zero-initialized before workers
+ * start iterating. If task_size is 0, the number of rows per chunk is derived
+ * from the number of rows in a result. */
+ecs_iter_t flecs_worker_steal_iter(
+    const ecs_iter_t *it,
+    int32_t index,
+    int32_t count,
+    int32_t *tasks_claimed,
+    int32_t task_size);
+
 #endif
 
 /**
@@ -2707,6 +2933,61 @@ void flecs_stage_merge_post_frame(
     ecs_world_t *world,
     ecs_stage_t *stage);  
 
+/* Test if commands in stages are eligible for a parallel merge */
+bool flecs_stage_merge_parallel_begin(
+    ecs_world_t *world);
+
+/* Apply commands that can be merged in parallel with other stages */
+void flecs_stage_merge_parallel(
+    ecs_world_t *world,
+    ecs_stage_t *stage);
+
+/* Finish parallel merge, must be called by a single thread */
+void flecs_stage_merge_parallel_end(
+    ecs_world_t *world);
+
+/* Test if commands in stages only assign values to existing components, and
+ * store the assigned components in ids */
+bool flecs_stage_cmds_assign_only(
+    ecs_world_t *world,
+    ecs_vec_t *ids);
+
+/* Switch stages to their other command buffer before workers start systems */
+void flecs_stage_merge_overlap_begin(
+    ecs_world_t *world);
+
+/* Apply commands while workers run systems, must be called by a single thread */
+void flecs_stage_merge_overlap(
+    ecs_world_t *world);
+
+/* Finish overlapped merge after workers are done */
+void flecs_stage_merge_overlap_end(
+    ecs_world_t *world);
+
+/* Restore commands of systems that ran while merging, after the merge */
+void flecs_stage_merge_overlap_restore(
+    ecs_world_t *world);
+
+/* Create new entity id for stage. In deterministic mode ids created by stages
+ * while multi threaded are taken from blocks reserved for each stage. */
+ecs_entity_t flecs_stage_new_id(
+    ecs_world_t *world,
+    ecs_stage_t *stage);
+
+/* Reset stage id blocks, called when entering multi threaded readonly mode */
+void flecs_stage_id_blocks_begin(
+    ecs_world_t *world);
+
+/* Claim ids in blocks used by stages, called when leaving readonly mode */
+void flecs_stage_id_blocks_end(
+    ecs_world_t *world);
+
+#ifdef FLECS_PERF_COUNTERS
+/* Close performance counters of stage (implemented by system addon) */
+void flecs_system_perf_free(
+    struct ecs_system_perf_t *perf);
+#endif
+
 bool flecs_defer_cmd(
     ecs_stage_t *stage);
 
@@ -3352,6 +3633,38 @@ int32_t flecs_query_pivot_term(
     const ecs_world_t *world,
     const ecs_query_t *query);
 
+#ifdef FLECS_PERF_TRACE
+#if defined(_MSC_VER)
+#define FLECS_PERF_TRACE_TLS __declspec(thread)
+#else
+#define FLECS_PERF_TRACE_TLS __thread
+#endif
+
+#define FLECS_PERF_TRACE_FIBER_DEPTH (16)
+
+/* Trace scopes that are open on a fiber. When the fiber yields its scopes are
+ * closed, and they are reopened when the fiber is resumed, so that the scopes
+ * of the thread that resumes the fiber stay nested. Scopes nested deeper than
+ * FLECS_PERF_TRACE_FIBER_DEPTH are not suspended. */
+typedef struct ecs_perf_trace_fiber_t {
+    struct {
+        const char *file;
+        size_t line;
+        const char *name;
+    } scopes[FLECS_PERF_TRACE_FIBER_DEPTH];
+    int32_t depth;
+    struct ecs_perf_trace_fiber_t *prev;
+} ecs_perf_trace_fiber_t;
+
+/* Reopen scopes of fiber, track scopes opened by calling thread until leave */
+void flecs_perf_trace_fiber_enter(
+    ecs_perf_trace_fiber_t *fiber);
+
+/* Close scopes that are still open on fiber */
+void flecs_perf_trace_fiber_leave(
+    ecs_perf_trace_fiber_t *fiber);
+#endif
+
 #endif
 
 
@@ -5680,6 +5993,7 @@ void flecs_commit(
         construct, evt_flags);
 
     flecs_table_traversable_add(src_table, -is_trav);
+    world->propagate_version += is_trav;
 
     /* If the entity is being watched, it is being monitored for changes and
      * requires rematching systems when components are added or removed. This
@@ -6187,7 +6501,7 @@ ecs_entity_t ecs_new(
     ecs_world_t *world)
 {
     ecs_stage_t *stage = flecs_stage_from_world(&world);
-    ecs_entity_t e = flecs_new_id(world);
+    ecs_entity_t e = flecs_stage_new_id(world, stage);
     flecs_add_to_root_table(world, stage, e);
     return e;
 }
@@ -6245,8 +6559,8 @@ ecs_entity_t ecs_new_w_table(
     ecs_check(world != NULL, ECS_INVALID_PARAMETER, NULL);
     ecs_check(table != NULL, ECS_INVALID_PARAMETER, NULL);
 
-    flecs_stage_from_world(&world);    
-    ecs_entity_t entity = flecs_new_id(world);
+    ecs_stage_t *stage = flecs_stage_from_world(&world);    
+    ecs_entity_t entity = flecs_stage_new_id(world, stage);
     ecs_record_t *r = flecs_entities_get(world, entity);
     ecs_flags32_t flags = table->flags & EcsTableAddEdgeFlags;
     if (table->flags & EcsTableHasIsA) {
@@ -6285,7 +6599,7 @@ void flecs_copy_id(
         ecs_os_memcpy(dst_ptr, src_ptr, flecs_utosize(size));
     }
 
-    flecs_table_mark_dirty(world, r->table, id);
+    flecs_table_mark_dirty(world, r->table, ECS_RECORD_TO_ROW(r->row), id);
 
     ecs_table_t *table = r->table;
     ecs_assert(table != NULL, ECS_INTERNAL_ERROR, NULL);
@@ -7562,6 +7876,7 @@ void ecs_delete(
 
             if (row_flags & EcsEntityIsTraversable) {
                 flecs_table_traversable_add(r->table, -1);
+                world->propagate_version ++;
             }
 
             /* Merge operations before deleting entity */
@@ -8099,7 +8414,7 @@ void flecs_modified_id_if(
     ecs_type_t ids = { .array = &id, .count = 1 };
     flecs_notify_on_set(world, table, ECS_RECORD_TO_ROW(r->row), 1, &ids, owned);
 
-    flecs_table_mark_dirty(world, table, id);
+    flecs_table_mark_dirty(world, table, ECS_RECORD_TO_ROW(r->row), id);
     flecs_defer_end(world, stage);
 error:
     return;
@@ -8131,7 +8446,7 @@ void ecs_modified_id(
     ecs_type_t ids = { .array = &id, .count = 1 };
     flecs_notify_on_set(world, table, ECS_RECORD_TO_ROW(r->row), 1, &ids, true);
 
-    flecs_table_mark_dirty(world, table, id);
+    flecs_table_mark_dirty(world, table, ECS_RECORD_TO_ROW(r->row), id);
     flecs_defer_end(world, stage);
 error:
     return;
@@ -8176,8 +8491,16 @@ void flecs_set_id_move(
         return;
     }
 
+    /* OnAdd observers can initialize the component, so they must run before 
+     * the value is assigned instead of when batched events are flushed. Set 
+     * commands that get here while merging are the only command for the 
+     * entity, so no batched event can be for the entity. */
+    bool event_batching = world->event_batching;
+    world->event_batching = false;
+
     ecs_record_t *r = flecs_entities_get(world, entity);
     flecs_component_ptr_t dst = flecs_ensure(world, entity, id, r);
+    world->event_batching = event_batching;
     ecs_check(dst.ptr != NULL, ECS_INVALID_PARAMETER, NULL);
 
     const ecs_type_info_t *ti = dst.ti;
@@ -8195,7 +8518,7 @@ void flecs_set_id_move(
         ecs_os_memcpy(dst.ptr, ptr, flecs_utosize(size));
     }
 
-    flecs_table_mark_dirty(world, r->table, id);
+    flecs_table_mark_dirty(world, r->table, ECS_RECORD_TO_ROW(r->row), id);
 
     if (cmd_kind == EcsCmdSet) {
         ecs_table_t *table = r->table;
@@ -9366,6 +9689,236 @@ bool flecs_remove_invalid(
     return true;
 }
 
+/* Returns whether an add/remove command for an id can be folded. Ids that have
+ * been invalidated by deleting their relationship or target are left alone, as
+ * applying them runs cleanup actions for the entity. Ids that add or remove
+ * other ids when they're added (Exclusive, Union, With, IsA) are also left 
+ * alone, as the batch can't tell which ids the entity has without applying 
+ * them. */
+static
+bool flecs_cmd_can_fold(
+    ecs_world_t *world,
+    ecs_id_t id)
+{
+    if (ecs_id_is_wildcard(id)) {
+        return false;
+    }
+
+    ecs_component_record_t *cdr;
+
+    if (ECS_HAS_ID_FLAG(id, PAIR)) {
+        ecs_entity_t rel = ECS_PAIR_FIRST(id);
+        if (!flecs_entities_is_valid(world, rel) || 
+            !flecs_entities_is_valid(world, ECS_PAIR_SECOND(id))) 
+        {
+            return false;
+        }
+
+        if (rel == EcsIsA) {
+            return false;
+        }
+
+        cdr = flecs_components_get(world, ecs_pair(rel, EcsWildcard));
+    } else {
+        if (!flecs_entities_is_valid(world, id & ECS_COMPONENT_MASK)) {
+            return false;
+        }
+
+        cdr = flecs_components_get(world, id);
+    }
+
+    if (cdr && (cdr->flags & (EcsIdExclusive|EcsIdIsUnion|EcsIdWith|
+        EcsIdIsSparse))) 
+    {
+        return false;
+    }
+
+    return true;
+}
+
+/* Returns whether the commands for a pair that the entity doesn't have before
+ * or after the batch can be dropped. Adding a Symmetric pair also modifies the
+ * target, and the first add of a OneOf pair validates the target. This is only
+ * checked for commands that would be dropped, which is much less common than
+ * the commands that are checked by flecs_cmd_can_fold. */
+static
+bool flecs_cmd_can_drop(
+    ecs_world_t *world,
+    ecs_id_t id)
+{
+    if (!ECS_HAS_ID_FLAG(id, PAIR)) {
+        return true;
+    }
+
+    ecs_record_t *r = flecs_entities_get(world, ECS_PAIR_FIRST(id));
+    ecs_table_t *rel_table = r ? r->table : NULL;
+    if (!rel_table) {
+        return true;
+    }
+
+    return !ecs_table_has_id(world, rel_table, EcsSymmetric) && 
+        !ecs_table_has_id(world, rel_table, EcsOneOf) &&
+        !ecs_table_has_id(world, rel_table, ecs_pair(EcsOneOf, EcsWildcard));
+}
+
+typedef struct ecs_cmd_fold_t {
+    ecs_id_t id;
+    bool had;                        /* Entity has id before the batch */
+    bool has;                        /* Entity has id after the last command */
+    bool pinned;                     /* Id is also used by non-foldable commands */
+    bool checked;                    /* Id passed flecs_cmd_can_fold */
+} ecs_cmd_fold_t;
+
+/* Fold add/remove commands for an entity before its destination table is 
+ * computed. When an entity doesn't have an id before and after the batch, the
+ * adds and removes for the id cancel each other out. These commands don't emit
+ * OnAdd or OnRemove events when the batch is applied, so they can be dropped
+ * without traversing the table graph for them. Commands for ids the entity has
+ * before or after the batch are applied as usual, so that the events they emit
+ * are the same as when the commands aren't folded. */
+static
+void flecs_cmd_fold_for_entity(
+    ecs_world_t *world,
+    ecs_table_t *table,
+    ecs_cmd_t *cmds,
+    int32_t start)
+{
+    ecs_cmd_fold_t folds[FLECS_CMD_FOLD_MAX];
+    int32_t f, fold_count = 0, folded = 0;
+    int32_t cur = start, next;
+    ecs_cmd_t *cmd;
+
+    /* Track whether the running table has each id after each command. This 
+     * only depends on the add/remove commands for the id itself, as the batch
+     * isn't folded if it contains commands that add or remove other ids. */
+    do {
+        cmd = &cmds[cur];
+        next = cmd->next_for_entity;
+        if (next < 0) {
+            next *= -1;
+        }
+
+        ecs_cmd_kind_t kind = cmd->kind;
+        bool is_add = kind == EcsCmdAdd || kind == EcsCmdAddModified;
+        bool is_remove = kind == EcsCmdRemove;
+
+        switch(kind) {
+        case EcsCmdAdd:
+        case EcsCmdAddModified:
+        case EcsCmdRemove:
+        case EcsCmdSet:
+        case EcsCmdEmplace:
+        case EcsCmdEnsure:
+        case EcsCmdModified:
+        case EcsCmdModifiedNoHook:
+        case EcsCmdEnable:
+        case EcsCmdDisable:
+            break;
+        case EcsCmdSkip:
+            continue;
+        case EcsCmdNew:
+        case EcsCmdClone:
+        case EcsCmdBulkNew:
+        case EcsCmdPath:
+        case EcsCmdDelete:
+        case EcsCmdClear:
+        case EcsCmdOnDeleteAction:
+        case EcsCmdEvent:
+        default:
+            /* Entity's ids no longer only depend on add/remove commands */
+            return;
+        }
+
+        ecs_id_t id = cmd->id;
+        for (f = 0; f < fold_count; f ++) {
+            if (folds[f].id == id) {
+                break;
+            }
+        }
+
+        if (f == fold_count) {
+            if (fold_count == FLECS_CMD_FOLD_MAX) {
+                /* Not tracked, ids that aren't tracked aren't folded */
+                if ((is_add || is_remove) && !flecs_cmd_can_fold(world, id)) {
+                    return;
+                }
+                continue;
+            }
+
+            folds[f].id = id;
+            folds[f].had = ecs_table_has_id(world, table, id);
+            folds[f].has = folds[f].had;
+            folds[f].pinned = false;
+            folds[f].checked = false;
+            fold_count ++;
+        }
+
+        /* Check each id once per batch, instead of for each command */
+        if ((is_add || is_remove) && !folds[f].checked) {
+            if (!flecs_cmd_can_fold(world, id)) {
+                return;
+            }
+            folds[f].checked = true;
+        }
+
+        if (is_add) {
+            folds[f].has = true;
+        } else if (is_remove) {
+            folds[f].has = false;
+        } else if (kind != EcsCmdModified && kind != EcsCmdModifiedNoHook) {
+            folds[f].pinned = true;
+        }
+    } while ((cur = next));
+
+    cur = start;
+    do {
+        cmd = &cmds[cur];
+        next = cmd->next_for_entity;
+        if (next < 0) {
+            next *= -1;
+        }
+
+        ecs_cmd_kind_t kind = cmd->kind;
+        if (kind != EcsCmdAdd && kind != EcsCmdAddModified && 
+            kind != EcsCmdRemove) 
+        {
+            continue;
+        }
+
+        for (f = 0; f < fold_count; f ++) {
+            if (folds[f].id == cmd->id) {
+                break;
+            }
+        }
+
+        if (f == fold_count || folds[f].pinned) {
+            continue;
+        }
+
+        if (folds[f].had || folds[f].has) {
+            /* Commands add or remove the id, keep their events */
+            continue;
+        }
+
+        if (!flecs_cmd_can_drop(world, cmd->id)) {
+            /* Don't check the pair again for the remaining commands */
+            folds[f].pinned = true;
+            continue;
+        }
+
+        if (kind == EcsCmdAddModified) {
+            /* Add is folded, but keep Modified */
+            cmd->kind = EcsCmdModified;
+        } else {
+            cmd->kind = EcsCmdSkip;
+        }
+
+        folded ++;
+    } while ((cur = next));
+
+    world->info.cmd.folded_count += folded;
+}
+
 static
 void flecs_cmd_batch_for_entity(
     ecs_world_t *world,
@@ -9395,6 +9948,11 @@ void flecs_cmd_batch_for_entity(
      * in a single batch. */
     ecs_flags64_t set_mask[4] = {0};
 
+    if (cmds[start].next_for_entity < 0) {
+        /* Entity has more than one command, fold adds & removes */
+        flecs_cmd_fold_for_entity(world, table, cmds, start);
+    }
+
     do {
         cmd = &cmds[cur];
         id = cmd->id;
@@ -9677,16 +10235,21 @@ bool flecs_defer_end(
 
             /* Internal callback for capturing commands */
             if (world->on_commands_active) {
-                world->on_commands_active(stage, queue, 
+                world->on_commands_active(stage, commands, 
                     world->on_commands_ctx_active);
             }
 
             ecs_cmd_t *cmds = ecs_vec_first(queue);
             int32_t i, count = ecs_vec_count(queue);
+            world->info.cmd.queue_bytes += count * ECS_SIZEOF(ecs_cmd_t);
 
             ecs_table_diff_builder_t diff;
             flecs_table_diff_builder_init(world, &diff);
 
+            /* Observers are invoked once for all entities that got the same
+             * components, instead of once for each entity. */
+            bool batch_events = merge_to_world && flecs_emit_batch_begin(world);
+
             for (i = 0; i < count; i ++) {
                 ecs_cmd_t *cmd = &cmds[i];
                 ecs_entity_t e = cmd->entity;
@@ -9711,6 +10274,10 @@ bool flecs_defer_end(
                  * contained both a delete and a subsequent add/remove/set which
                  * should be ignored. */
                 ecs_cmd_kind_t kind = cmd->kind;
+                if (kind == EcsCmdSkip && !e) {
+                    /* Already applied by flecs_stage_merge_parallel */
+                    continue;
+                }
                 if ((kind != EcsCmdPath) && ((kind == EcsCmdSkip) || (e && !is_alive))) {
                     world->info.cmd.discard_count ++;
                     flecs_discard_cmd(world, cmd);
@@ -9741,17 +10308,25 @@ bool flecs_defer_end(
                     flecs_remove_id(world, e, id);
                     world->info.cmd.remove_count ++;
                     break;
-                case EcsCmdClone:
+                case EcsCmdClone: {
+                    /* Values are copied after OnAdd observers are invoked */
+                    bool resume = flecs_emit_batch_suspend(world);
                     ecs_clone(world, e, id, cmd->is._1.clone_value);
+                    if (resume) {
+                        flecs_emit_batch_resume(world);
+                    }
                     world->info.cmd.other_count ++;
                     break;
+                }
                 case EcsCmdSet:
                     flecs_set_id_move(world, dst_stage, e, 
                         cmd->id, flecs_itosize(cmd->is._1.size), 
                         cmd->is._1.value, kind);
                     world->info.cmd.set_count ++;
                     break;
-                case EcsCmdEmplace:
+                case EcsCmdEmplace: {
+                    /* Value is moved after OnAdd observers are invoked */
+                    bool resume = flecs_emit_batch_suspend(world);
                     if (merge_to_world) {
                         bool is_new;
                         ecs_emplace_id(world, e, id, &is_new);
@@ -9762,8 +10337,12 @@ bool flecs_defer_end(
                     flecs_set_id_move(world, dst_stage, e, 
                         cmd->id, flecs_itosize(cmd->is._1.size), 
                         cmd->is._1.value, kind);
+                    if (resume) {
+                        flecs_emit_batch_resume(world);
+                    }
                     world->info.cmd.ensure_count ++;
                     break;
+                }
                 case EcsCmdEnsure:
                     flecs_set_id_move(world, dst_stage, e, 
                         cmd->id, flecs_itosize(cmd->is._1.size), 
@@ -9846,10 +10425,15 @@ bool flecs_defer_end(
                 }
             }
 
+            if (batch_events) {
+                flecs_emit_batch_end(world);
+            }
+
             stage->cmd_flushing = false;
 
             flecs_stack_reset(&commands->stack);
             ecs_vec_clear(queue);
+            ecs_vec_clear(&commands->systems);
             flecs_table_diff_builder_fini(world, &diff);
 
             /* Internal callback for capturing commands, signal queue is done */
@@ -9888,6 +10472,7 @@ bool flecs_defer_purge(
             ecs_vec_fini_t(&stage->allocator, &stage->cmd->queue, ecs_cmd_t);
 
             ecs_vec_clear(&commands);
+            ecs_vec_clear(&stage->cmd->systems);
             flecs_stack_reset(&stage->cmd->stack);
             flecs_sparse_clear(&stage->cmd->entries);
         }
@@ -11639,6 +12224,14 @@ error:
     return false;
 }
 
+static
+bool flecs_worker_chunk_next(
+    ecs_iter_t *it);
+
+static
+bool flecs_worker_steal_next(
+    ecs_iter_t *it);
+
 ecs_iter_t ecs_worker_iter(
     const ecs_iter_t *it,
     int32_t index,
@@ -11679,6 +12272,14 @@ bool ecs_worker_next(
     int32_t res_count = iter->count, res_index = iter->index;
     int32_t per_worker, first;
 
+    if (iter->tasks_claimed) {
+        return flecs_worker_steal_next(it);
+    }
+
+    if (iter->chunk.size) {
+        return flecs_worker_chunk_next(it);
+    }
+
     do {
         if (!ecs_iter_next(chain_it)) {
             return false;
@@ -11724,6 +12325,221 @@ error:
     return false;
 }
 
+/* Progress to next chunk of parent iterator result. Fetches next result from
+ * parent iterator when all chunks of the current result have been returned. */
+static
+bool flecs_chunk_next(
+    ecs_iter_t *it,
+    ecs_chunk_iter_t *iter)
+{
+    ecs_iter_t *chain_it = it->chain_it;
+
+    if (iter->row >= iter->count) {
+        if (!ecs_iter_next(chain_it)) {
+            return false;
+        }
+
+        /* Copy everything up to the private iterator data */
+        ecs_os_memcpy(it, chain_it, offsetof(ecs_iter_t, priv_));
+
+        if (!chain_it->table || !chain_it->count) {
+            /* Task query or empty result, return as is */
+            iter->row = iter->count = 0;
+            return true;
+        }
+
+        iter->row = 0;
+        iter->count = chain_it->count;
+    }
+
+    int32_t row = iter->row;
+    int32_t count = iter->count - row;
+    if (count > iter->size) {
+        count = iter->size;
+    }
+
+    it->offset = chain_it->offset + row;
+    it->frame_offset = chain_it->frame_offset + row;
+    it->count = count;
+    it->entities = &chain_it->entities[row];
+    iter->row += count;
+
+    return true;
+}
+
+static
+bool flecs_worker_chunk_next(
+    ecs_iter_t *it)
+{
+    ecs_worker_iter_t *iter = &it->priv_.iter.worker;
+    int32_t chunk_index;
+
+    do {
+        if (!flecs_chunk_next(it, &iter->chunk)) {
+            return false;
+        }
+
+        if (it->table == NULL) {
+            if (iter->index == 0) {
+                return true;
+            } else {
+                /* Chained iterator returned true, so clean it up here. */
+                ecs_iter_fini(it->chain_it);
+                return false;
+            }
+        }
+
+        chunk_index = iter->chunk_index ++;
+    } while ((chunk_index % iter->count) != iter->index);
+
+    return true;
+}
+
+/* Number of rows per task for a result. Small results are claimed as a whole,
+ * large results are split up so that each worker can claim multiple tasks. */
+static
+int32_t flecs_worker_task_size(
+    int32_t count,
+    int32_t worker_count)
+{
+    int32_t size = count / (worker_count * FLECS_WORKER_TASKS_PER_THREAD);
+    if (size < FLECS_WORKER_TASK_MIN_ROWS) {
+        size = FLECS_WORKER_TASK_MIN_ROWS;
+    }
+    return size;
+}
+
+/* Each worker iterates all results of the parent iterator, which divides the
+ * results up into the same sequence of tasks for every worker. A worker only
+ * returns the tasks it claimed from the shared counter, which means that a
+ * worker that finishes its tasks early claims tasks that would otherwise have
+ * been processed by a slower worker. Because claims are monotonic, a worker
+ * never has to go back to an earlier result of the parent iterator. */
+static
+bool flecs_worker_steal_next(
+    ecs_iter_t *it)
+{
+    ecs_iter_t *chain_it = it->chain_it;
+    ecs_worker_iter_t *iter = &it->priv_.iter.worker;
+    ecs_chunk_iter_t *chunk = &iter->chunk;
+
+    if (iter->task_claimed < iter->chunk_index) {
+        iter->task_claimed = ecs_os_ainc(iter->tasks_claimed) - 1;
+    }
+
+    do {
+        if (chunk->row >= chunk->count) {
+            if (!ecs_iter_next(chain_it)) {
+                return false;
+            }
+
+            /* Copy everything up to the private iterator data */
+            ecs_os_memcpy(it, chain_it, offsetof(ecs_iter_t, priv_));
+
+            if (it->table == NULL) {
+                /* Task query results are not split up */
+                if (iter->index == 0) {
+                    return true;
+                } else {
+                    /* Chained iterator returned true, so clean it up here. */
+                    ecs_iter_fini(chain_it);
+                    return false;
+                }
+            }
+
+            chunk->row = 0;
+            chunk->count = chain_it->count;
+            chunk->size = iter->task_size;
+            if (!chunk->size) {
+                chunk->size = flecs_worker_task_size(chunk->count, iter->count);
+            }
+            continue;
+        }
+
+        int32_t row = chunk->row;
+        int32_t count = chunk->count - row;
+        if (count > chunk->size) {
+            count = chunk->size;
+        }
+
+        chunk->row += count;
+
+        if (iter->chunk_index ++ == iter->task_claimed) {
+            it->offset = chain_it->offset + row;
+            it->frame_offset = chain_it->frame_offset + row;
+            it->count = count;
+            it->entities = &chain_it->entities[row];
+            return true;
+        }
+    } while (true);
+}
+
+ecs_iter_t flecs_worker_steal_iter(
+    const ecs_iter_t *it,
+    int32_t index,
+    int32_t count,
+    int32_t *tasks_claimed,
+    int32_t task_size)
+{
+    ecs_assert(tasks_claimed != NULL, ECS_INTERNAL_ERROR, NULL);
+
+    ecs_iter_t result = ecs_worker_iter(it, index, count);
+    result.priv_.iter.worker.tasks_claimed = tasks_claimed;
+    result.priv_.iter.worker.task_claimed = -1;
+    result.priv_.iter.worker.task_size = task_size;
+    return result;
+}
+
+ecs_iter_t ecs_worker_chunk_iter(
+    const ecs_iter_t *it,
+    int32_t index,
+    int32_t count,
+    int32_t chunk_size)
+{
+    ecs_check(chunk_size > 0, ECS_INVALID_PARAMETER, NULL);
+
+    ecs_iter_t result = ecs_worker_iter(it, index, count);
+    result.priv_.iter.worker.chunk.size = chunk_size;
+    return result;
+error:
+    return (ecs_iter_t){ 0 };
+}
+
+ecs_iter_t ecs_chunk_iter(
+    const ecs_iter_t *it,
+    int32_t chunk_size)
+{
+    ecs_check(it != NULL, ECS_INVALID_PARAMETER, NULL);
+    ecs_check(it->next != NULL, ECS_INVALID_PARAMETER, NULL);
+    ecs_check(chunk_size > 0, ECS_INVALID_PARAMETER, NULL);
+
+    ecs_iter_t result = *it;
+    result.priv_.cache.stack_cursor = NULL; /* Don't copy allocator cursor */
+
+    result.priv_.iter.chunk = (ecs_chunk_iter_t){
+        .size = chunk_size
+    };
+    result.next = ecs_chunk_next;
+    result.fini = ecs_chained_iter_fini;
+    result.chain_it = ECS_CONST_CAST(ecs_iter_t*, it);
+
+    return result;
+error:
+    return (ecs_iter_t){ 0 };
+}
+
+bool ecs_chunk_next(
+    ecs_iter_t *it)
+{
+    ecs_check(it != NULL, ECS_INVALID_PARAMETER, NULL);
+    ecs_check(it->chain_it != NULL, ECS_INVALID_PARAMETER, NULL);
+    ecs_check(it->next == ecs_chunk_next, ECS_INVALID_PARAMETER, NULL);
+
+    return flecs_chunk_next(it, &it->priv_.iter.chunk);
+error:
+    return false;
+}
+
 /**
  * @file misc.c
  * @brief Miscellaneous functions.
@@ -12214,6 +13030,19 @@ void flecs_observable_init(
     observable->on_set.event = EcsOnSet;
 }
 
+static
+void flecs_event_fanout_fini(
+    ecs_event_record_t *er)
+{
+    ecs_map_iter_t it = ecs_map_iter(&er->fanout);
+    while (ecs_map_next(&it)) {
+        ecs_event_fanout_t *fanout = ecs_map_ptr(&it);
+        ecs_vec_fini_t(NULL, &fanout->observers, ecs_observer_t*);
+        ecs_os_free(fanout);
+    }
+    ecs_map_fini(&er->fanout);
+}
+
 void flecs_observable_fini(
     ecs_observable_t *observable)
 {
@@ -12224,17 +13053,23 @@ void flecs_observable_fini(
     ecs_assert(!ecs_map_is_init(&observable->on_set.event_ids), 
         ECS_INTERNAL_ERROR, NULL);
 
+    flecs_event_fanout_fini(&observable->on_add);
+    flecs_event_fanout_fini(&observable->on_remove);
+    flecs_event_fanout_fini(&observable->on_set);
+    flecs_event_fanout_fini(&observable->on_wildcard);
+
     ecs_sparse_t *events = &observable->events;
     int32_t i, count = flecs_sparse_count(events);
     for (i = 0; i < count; i ++) {
         ecs_event_record_t *er = 
             flecs_sparse_get_dense_t(events, ecs_event_record_t, i);
         ecs_assert(er != NULL, ECS_INTERNAL_ERROR, NULL);
-        (void)er;
 
         /* All observers should've unregistered by now */
         ecs_assert(!ecs_map_is_init(&er->event_ids), 
             ECS_INTERNAL_ERROR, NULL);
+
+        flecs_event_fanout_fini(er);
     }
 
     flecs_sparse_fini(&observable->events);
@@ -12423,135 +13258,135 @@ int32_t flecs_event_observers_get(
     return count;
 }
 
-bool flecs_observers_exist(
-    ecs_observable_t *observable,
-    ecs_id_t id,
-    ecs_entity_t event)
+static
+void flecs_event_fanout_append(
+    ecs_vec_t *observers,
+    const ecs_map_t *map)
 {
-    const ecs_event_record_t *er = flecs_event_record_get_if(observable, event);
-    if (!er) {
-        return false;
+    ecs_map_iter_t it = ecs_map_iter(map);
+    while (ecs_map_next(&it)) {
+        ecs_vec_append_t(NULL, observers, ecs_observer_t*)[0] = 
+            ecs_map_ptr(&it);
     }
-
-    return flecs_event_id_record_get_if(er, id) != NULL;
 }
 
 static
-void flecs_emit_propagate(
-    ecs_world_t *world,
-    ecs_iter_t *it,
-    ecs_component_record_t *cdr,
-    ecs_component_record_t *tgt_idr,
-    ecs_entity_t trav,
-    ecs_event_id_record_t **iders,
-    int32_t ider_count);
-
-static
-void flecs_emit_propagate_id(
-    ecs_world_t *world,
-    ecs_iter_t *it,
-    ecs_component_record_t *cdr,
-    ecs_component_record_t *cur,
-    ecs_entity_t trav,
-    ecs_event_id_record_t **iders,
-    int32_t ider_count)
+void flecs_event_fanout_build(
+    const ecs_event_record_t *er,
+    ecs_event_fanout_t *fanout,
+    ecs_id_t id)
 {
-    ecs_table_cache_iter_t idt;
-    if (!flecs_table_cache_all_iter(&cur->cache, &idt)) {
-        return;
-    }
+    fanout->ider_count = flecs_event_observers_get(er, id, fanout->iders);
+    fanout->version = er->fanout_version;
+    ecs_vec_clear(&fanout->observers);
 
-    const ecs_table_record_t *tr;
-    int32_t event_cur = it->event_cur;
-    while ((tr = flecs_table_cache_next(&idt, ecs_table_record_t))) {
-        ecs_table_t *table = tr->hdr.table;
-        if (!ecs_table_count(table)) {
-            continue;
-        }
+    /* Same order in which the observer sets were invoked without the cache */
+    int32_t i;
+    for (i = 0; i < fanout->ider_count; i ++) {
+        ecs_event_id_record_t *ider = fanout->iders[i];
+        flecs_event_fanout_append(&fanout->observers, &ider->self);
+        flecs_event_fanout_append(&fanout->observers, &ider->self_up);
+    }
+}
 
-        bool owned = flecs_component_get_table(cdr, table) != NULL;
+ecs_event_fanout_t* flecs_event_fanout_get(
+    ecs_event_record_t *er,
+    ecs_id_t id)
+{
+    ecs_map_init_if(&er->fanout, NULL);
+    ecs_event_fanout_t **ptr = ecs_map_ensure_ref(
+        &er->fanout, ecs_event_fanout_t, id);
+    ecs_event_fanout_t *fanout = ptr[0];
+    if (!fanout) {
+        fanout = ptr[0] = ecs_os_calloc_t(ecs_event_fanout_t);
+        flecs_event_fanout_build(er, fanout, id);
+    } else if (fanout->version != er->fanout_version) {
+        flecs_event_fanout_build(er, fanout, id);
+    }
 
-        int32_t e, entity_count = ecs_table_count(table);
-        it->table = table;
-        it->other_table = NULL;
-        it->offset = 0;
-        it->count = entity_count;
-        it->up_fields = 1;
-        if (entity_count) {
-            it->entities = ecs_table_entities(table);
-        }
+    return fanout;
+}
 
-        int32_t ider_i;
-        for (ider_i = 0; ider_i < ider_count; ider_i ++) {
-            ecs_event_id_record_t *ider = iders[ider_i];
-            flecs_observers_invoke(world, &ider->up, it, table, trav);
+static
+void flecs_event_fanout_remove(
+    ecs_event_record_t *er,
+    ecs_id_t id)
+{
+    if (!ecs_map_is_init(&er->fanout)) {
+        return;
+    }
 
-            if (!owned) {
-                /* Owned takes precedence */
-                flecs_observers_invoke(world, &ider->self_up, it, table, trav);
-            }
-        }
+    ecs_event_fanout_t *fanout = ecs_map_remove_ptr(&er->fanout, id);
+    if (fanout) {
+        ecs_vec_fini_t(NULL, &fanout->observers, ecs_observer_t*);
+        ecs_os_free(fanout);
+    }
+}
 
-        if (!table->_->traversable_count) {
-            continue;
-        }
+void flecs_observable_fanout_remove(
+    ecs_observable_t *observable,
+    ecs_id_t id)
+{
+    flecs_event_fanout_remove(&observable->on_add, id);
+    flecs_event_fanout_remove(&observable->on_remove, id);
+    flecs_event_fanout_remove(&observable->on_set, id);
+    flecs_event_fanout_remove(&observable->on_wildcard, id);
 
-        const ecs_entity_t *entities = ecs_table_entities(table);
-        for (e = 0; e < entity_count; e ++) {
-            ecs_record_t *r = flecs_entities_get(world, entities[e]);
-            ecs_assert(r != NULL, ECS_INTERNAL_ERROR, NULL);
-            ecs_component_record_t *idr_t = r->cdr;
-            if (idr_t) {
-                /* Only notify for entities that are used in pairs with
-                 * traversable relationships */
-                flecs_emit_propagate(world, it, cdr, idr_t, trav,
-                    iders, ider_count);
-            }
-        }
+    ecs_sparse_t *events = &observable->events;
+    int32_t i, count = flecs_sparse_count(events);
+    for (i = 0; i < count; i ++) {
+        flecs_event_fanout_remove(
+            flecs_sparse_get_dense_t(events, ecs_event_record_t, i), id);
     }
-
-    it->event_cur = event_cur;
-    it->up_fields = 0;
 }
 
-static
-void flecs_emit_propagate(
+void flecs_event_fanout_invoke(
     ecs_world_t *world,
+    ecs_event_record_t *er,
+    ecs_event_fanout_t *fanout,
+    ecs_id_t id,
     ecs_iter_t *it,
-    ecs_component_record_t *cdr,
-    ecs_component_record_t *tgt_idr,
-    ecs_entity_t propagate_trav,
-    ecs_event_id_record_t **iders,
-    int32_t ider_count)
+    ecs_table_t *table)
 {
-    ecs_assert(tgt_idr != NULL, ECS_INTERNAL_ERROR, NULL);    
+    if (fanout->version != er->fanout_version) {
+        flecs_event_fanout_build(er, fanout, id);
+    }
 
-    if (ecs_should_log_3()) {
-        char *idstr = ecs_id_str(world, tgt_idr->id);
-        ecs_dbg_3("propagate events/invalidate cache for %s", idstr);
-        ecs_os_free(idstr);
+    if (!ecs_vec_count(&fanout->observers)) {
+        return;
     }
 
-    ecs_log_push_3();
+    ecs_table_lock(it->world, table);
 
-    /* Propagate to records of traversable relationships */
-    ecs_component_record_t *cur = tgt_idr;
-    while ((cur = flecs_component_trav_next(cur))) {
-        cur->pair->reachable.generation ++; /* Invalidate cache */
+    int32_t i;
+    for (i = 0; i < ecs_vec_count(&fanout->observers); i ++) {
+        ecs_observer_t *o = ecs_vec_get_t(
+            &fanout->observers, ecs_observer_t*, i)[0];
+        flecs_uni_observer_invoke(world, o, it, table, 0);
 
-        /* Get traversed relationship */
-        ecs_entity_t trav = ECS_PAIR_FIRST(cur->id);
-        if (propagate_trav && propagate_trav != trav) {
-            if (propagate_trav != EcsIsA) {
-                continue;
-            }
+        /* If an observer created or deleted observers, rebuild the list so
+         * that no deleted observers are invoked. The fanout is only freed when
+         * the component record of the id is deleted, which can't happen while
+         * the locked table has the id, so it's safe to continue. */
+        if (fanout->version != er->fanout_version) {
+            flecs_event_fanout_build(er, fanout, id);
         }
+    }
 
-        flecs_emit_propagate_id(
-            world, it, cdr, cur, trav, iders, ider_count);
+    ecs_table_unlock(it->world, table);
+}
+
+bool flecs_observers_exist(
+    ecs_observable_t *observable,
+    ecs_id_t id,
+    ecs_entity_t event)
+{
+    const ecs_event_record_t *er = flecs_event_record_get_if(observable, event);
+    if (!er) {
+        return false;
     }
 
-    ecs_log_pop_3();
+    return flecs_event_id_record_get_if(er, id) != NULL;
 }
 
 static
@@ -12630,6 +13465,144 @@ void flecs_emit_propagate_invalidate(
     }
 }
 
+static
+void flecs_propagate_cache_build(
+    ecs_world_t *world,
+    ecs_propagate_cache_t *pc,
+    ecs_component_record_t *tgt_idr,
+    ecs_entity_t propagate_trav)
+{
+    /* Same traversal as flecs_emit_propagate */
+    ecs_allocator_t *a = &world->allocator;
+    ecs_component_record_t *cur = tgt_idr;
+    while ((cur = flecs_component_trav_next(cur))) {
+        ecs_vec_append_t(a, &pc->records, ecs_component_record_t*)[0] = cur;
+
+        ecs_entity_t trav = ECS_PAIR_FIRST(cur->id);
+        if (propagate_trav && propagate_trav != trav) {
+            if (propagate_trav != EcsIsA) {
+                continue;
+            }
+        }
+
+        ecs_table_cache_iter_t idt;
+        if (!flecs_table_cache_all_iter(&cur->cache, &idt)) {
+            continue;
+        }
+
+        const ecs_table_record_t *tr;
+        while ((tr = flecs_table_cache_next(&idt, ecs_table_record_t))) {
+            ecs_table_t *table = tr->hdr.table;
+
+            /* Empty tables are stored, so that adding entities to them doesn't
+             * invalidate the cache. */
+            ecs_propagate_elem_t *elem = ecs_vec_append_t(
+                a, &pc->tables, ecs_propagate_elem_t);
+            elem->table = table;
+            elem->trav = trav;
+
+            if (!table->_->traversable_count) {
+                continue;
+            }
+
+            int32_t e, entity_count = ecs_table_count(table);
+            const ecs_entity_t *entities = ecs_table_entities(table);
+            for (e = 0; e < entity_count; e ++) {
+                ecs_record_t *r = flecs_entities_get(world, entities[e]);
+                ecs_assert(r != NULL, ECS_INTERNAL_ERROR, NULL);
+                if (r->cdr) {
+                    flecs_propagate_cache_build(world, pc, r->cdr, trav);
+                }
+            }
+        }
+    }
+}
+
+static
+ecs_propagate_cache_t* flecs_propagate_cache_get(
+    ecs_world_t *world,
+    ecs_component_record_t *tgt_idr)
+{
+    ecs_assert(tgt_idr->pair != NULL, ECS_INTERNAL_ERROR, NULL);
+    ecs_propagate_cache_t *pc = &tgt_idr->pair->propagate;
+    if (pc->version != world->propagate_version) {
+        ecs_vec_clear(&pc->tables);
+        ecs_vec_clear(&pc->records);
+        flecs_propagate_cache_build(world, pc, tgt_idr, 0);
+        pc->version = world->propagate_version;
+    }
+    return pc;
+}
+
+/* Equivalent to flecs_emit_propagate for the entities that are reachable from
+ * the target, but uses the flattened list of tables from the cache. */
+static
+void flecs_emit_propagate_cached(
+    ecs_world_t *world,
+    ecs_iter_t *it,
+    ecs_component_record_t *cdr,
+    ecs_component_record_t *tgt_idr,
+    ecs_event_id_record_t **iders,
+    int32_t ider_count)
+{
+    if (ecs_should_log_3()) {
+        char *idstr = ecs_id_str(world, tgt_idr->id);
+        ecs_dbg_3("propagate events/invalidate cache for %s", idstr);
+        ecs_os_free(idstr);
+    }
+
+    ecs_propagate_cache_t *pc = flecs_propagate_cache_get(world, tgt_idr);
+
+    ecs_component_record_t **records = ecs_vec_first(&pc->records);
+    int32_t i, count = ecs_vec_count(&pc->records);
+    for (i = 0; i < count; i ++) {
+        records[i]->pair->reachable.generation ++; /* Invalidate cache */
+    }
+
+    int32_t event_cur = it->event_cur;
+    int32_t version = pc->version;
+    for (i = 0; i < ecs_vec_count(&pc->tables); i ++) {
+        ecs_propagate_elem_t *elem = ecs_vec_get_t(
+            &pc->tables, ecs_propagate_elem_t, i);
+        ecs_table_t *table = elem->table;
+        int32_t entity_count = ecs_table_count(table);
+        if (!entity_count) {
+            continue;
+        }
+
+        bool owned = flecs_component_get_table(cdr, table) != NULL;
+        ecs_entity_t trav = elem->trav;
+
+        it->table = table;
+        it->other_table = NULL;
+        it->offset = 0;
+        it->count = entity_count;
+        it->up_fields = 1;
+        it->entities = ecs_table_entities(table);
+
+        int32_t ider_i;
+        for (ider_i = 0; ider_i < ider_count; ider_i ++) {
+            ecs_event_id_record_t *ider = iders[ider_i];
+            flecs_observers_invoke(world, &ider->up, it, table, trav);
+
+            if (!owned) {
+                /* Owned takes precedence */
+                flecs_observers_invoke(world, &ider->self_up, it, table, trav);
+            }
+        }
+
+        if (version != world->propagate_version) {
+            /* An observer changed the hierarchy. Rebuild the cache, so that
+             * it doesn't contain deleted tables. */
+            pc = flecs_propagate_cache_get(world, tgt_idr);
+            version = pc->version;
+        }
+    }
+
+    it->event_cur = event_cur;
+    it->up_fields = 0;
+}
+
 static
 void flecs_propagate_entities(
     ecs_world_t *world,
@@ -12666,8 +13639,8 @@ void flecs_propagate_entities(
             /* Entity is used as target in traversable pairs, propagate */
             ecs_entity_t e = src ? src : entities[i];
             it->sources[0] = e;
-            flecs_emit_propagate(
-                world, it, cdr, idr_t, 0, iders, ider_count);
+            flecs_emit_propagate_cached(
+                world, it, cdr, idr_t, iders, ider_count);
         }
     }
     
@@ -13315,6 +14288,190 @@ void flecs_emit_forward(
     }
 }
 
+/* Maximum number of distinct event batches before batches are flushed */
+#define FLECS_EVENT_BATCH_COUNT_MAX (16)
+
+static
+bool flecs_emit_batch_push(
+    ecs_world_t *world,
+    const ecs_event_desc_t *desc)
+{
+    ecs_entity_t event = desc->event;
+    if (event != EcsOnAdd && event != EcsOnSet) {
+        return false;
+    }
+
+    /* Only batch plain notifications for a range of entities */
+    if (desc->param || desc->const_param || !desc->count) {
+        return false;
+    }
+    if ((desc->flags & EcsEventTableOnly) || desc->observable != world) {
+        return false;
+    }
+
+    /* Events for tables with IsA relationships can instantiate prefab children
+     * and initialize overridden components (which is what the set mask is used
+     * for), which must happen before the operation returns. Events for 
+     * entities that are relationship targets invalidate caches of the entities
+     * that reach them. */
+    ecs_table_t *table = desc->table;
+    if (table->flags & (EcsTableHasIsA|EcsTableHasTraversable)) {
+        return false;
+    }
+
+    const ecs_type_t *ids = desc->ids;
+    ecs_event_batch_t *batches = ecs_vec_first(&world->event_batches);
+    int32_t i, count = ecs_vec_count(&world->event_batches);
+    ecs_event_batch_t *batch = NULL;
+
+    /* The most recently created batch is the most likely to match */
+    for (i = count - 1; i >= 0; i --) {
+        ecs_event_batch_t *b = &batches[i];
+        if (b->event != event || b->other_table != desc->other_table) {
+            continue;
+        }
+        if (b->flags != desc->flags || b->ids.count != ids->count) {
+            continue;
+        }
+        if (ecs_os_memcmp(b->ids.array, ids->array, 
+            ECS_SIZEOF(ecs_id_t) * ids->count)) 
+        {
+            continue;
+        }
+        batch = b;
+        break;
+    }
+
+    if (!batch) {
+        if (count == FLECS_EVENT_BATCH_COUNT_MAX) {
+            return false;
+        }
+
+        batch = ecs_vec_append_t(
+            &world->allocator, &world->event_batches, ecs_event_batch_t);
+        batch->event = event;
+        batch->ids = flecs_type_copy(world, ids);
+        batch->other_table = desc->other_table;
+        batch->flags = desc->flags;
+        ecs_vec_init_t(&world->allocator, &batch->entities, ecs_entity_t, 0);
+    }
+
+    int32_t entity_count = desc->count;
+    ecs_entity_t *entities = ecs_vec_grow_t(&world->allocator, 
+        &batch->entities, ecs_entity_t, entity_count);
+    ecs_os_memcpy_n(entities, &ecs_table_entities(table)[desc->offset], 
+        ecs_entity_t, entity_count);
+
+    return true;
+}
+
+static
+void flecs_emit_batch_flush(
+    ecs_world_t *world)
+{
+    int32_t i, count = ecs_vec_count(&world->event_batches);
+    if (!count) {
+        return;
+    }
+
+    /* Events emitted by observers are not added to the batch */
+    world->event_batching = false;
+
+    /* Operations of observers are deferred, as they would be if the observers
+     * had been invoked by the operation that emitted the event. */
+    ecs_stage_t *stage = world->stages[0];
+    flecs_defer_begin(world, stage);
+
+    ecs_event_batch_t *batches = ecs_vec_first(&world->event_batches);
+    for (i = 0; i < count; i ++) {
+        ecs_event_batch_t *b = &batches[i];
+        const ecs_entity_t *entities = ecs_vec_first(&b->entities);
+        int32_t e = 0, e_count = ecs_vec_count(&b->entities);
+
+        while (e < e_count) {
+            /* Entity can be deleted by a command or observer after the event
+             * was added to the batch */
+            if (!flecs_entities_is_alive(world, entities[e])) {
+                e ++;
+                continue;
+            }
+
+            ecs_record_t *r = flecs_entities_get(world, entities[e]);
+            ecs_table_t *table = r->table;
+            int32_t row = ECS_RECORD_TO_ROW(r->row);
+            int32_t table_count = ecs_table_count(table);
+            const ecs_entity_t *table_entities = ecs_table_entities(table);
+
+            /* Find the largest range of entities stored in consecutive rows,
+             * so that observers are invoked once for the range. */
+            int32_t range = 1;
+            while ((e + range) < e_count && (row + range) < table_count) {
+                if (table_entities[row + range] != entities[e + range]) {
+                    break;
+                }
+                range ++;
+            }
+
+            flecs_emit(world, world, NULL, &(ecs_event_desc_t){
+                .event = b->event,
+                .ids = &b->ids,
+                .table = table,
+                .other_table = b->other_table,
+                .offset = row,
+                .count = range,
+                .observable = world,
+                .flags = b->flags
+            });
+
+            e += range;
+        }
+
+        flecs_type_free(world, &b->ids);
+        ecs_vec_fini_t(&world->allocator, &b->entities, ecs_entity_t);
+    }
+
+    ecs_vec_clear(&world->event_batches);
+    flecs_defer_end(world, stage);
+    world->event_batching = true;
+}
+
+bool flecs_emit_batch_begin(
+    ecs_world_t *world)
+{
+    if (world->event_batching) {
+        return false;
+    }
+
+    world->event_batching = true;
+    return true;
+}
+
+void flecs_emit_batch_end(
+    ecs_world_t *world)
+{
+    ecs_assert(world->event_batching, ECS_INTERNAL_ERROR, NULL);
+    flecs_emit_batch_flush(world);
+    world->event_batching = false;
+}
+
+bool flecs_emit_batch_suspend(
+    ecs_world_t *world)
+{
+    if (!world->event_batching) {
+        return false;
+    }
+
+    flecs_emit_batch_flush(world);
+    world->event_batching = false;
+    return true;
+}
+
+void flecs_emit_batch_resume(
+    ecs_world_t *world)
+{
+    world->event_batching = true;
+}
+
 /* The emit function is responsible for finding and invoking the observers 
  * matching the emitted event. The function is also capable of forwarding events
  * for newly reachable ids (after adding a relationship) and propagating events
@@ -13335,6 +14492,16 @@ void flecs_emit(
     ecs_check(desc->table != NULL, ECS_INVALID_PARAMETER, NULL);
     ecs_check(desc->observable != NULL, ECS_INVALID_PARAMETER, NULL);
 
+    if (world->event_batching) {
+        if (flecs_emit_batch_push(world, desc)) {
+            return;
+        }
+
+        /* Flush batched events first, so that observers for an entity never
+         * see a later event (like OnRemove) before an earlier one. */
+        flecs_emit_batch_flush(world);
+    }
+
     ecs_os_perf_trace_push("flecs.emit");
 
     ecs_time_t t = {0};
@@ -13458,7 +14625,7 @@ repeat_event:
         ecs_id_t id = id_array[i];
         ecs_assert(id == EcsAny || !ecs_id_is_wildcard(id), 
             ECS_INVALID_PARAMETER, "cannot emit wildcard ids");
-        int32_t ider_i, ider_count = 0;
+        int32_t ider_count = 0;
         bool is_pair = ECS_IS_PAIR(id);
         void *override_ptr = NULL;
         bool override_base_added = false;
@@ -13563,12 +14730,18 @@ repeat_event:
             }
         }
 
+        ecs_event_fanout_t *fanout = NULL;
         if (er) {
             /* Get observer sets for id. There can be multiple sets of matching
              * observers, in case an observer matches for wildcard ids. For
              * example, both observers for (ChildOf, p) and (ChildOf, *) would
-             * match an event for (ChildOf, p). */
-            ider_count = flecs_event_observers_get(er, id, iders);
+             * match an event for (ChildOf, p). The fanout caches the sets and
+             * the observers they contain for the id. */
+            fanout = flecs_event_fanout_get(
+                ECS_CONST_CAST(ecs_event_record_t*, er), id);
+            ider_count = fanout->ider_count;
+            ecs_os_memcpy_n(iders, fanout->iders, 
+                ecs_event_id_record_t*, ider_count);
             cdr = cdr ? cdr : flecs_components_get(world, id);
             ecs_assert(cdr != NULL, ECS_INTERNAL_ERROR, NULL);
         }
@@ -13694,11 +14867,9 @@ repeat_event:
         }
 
         /* Actually invoke observers for this event/id */
-        for (ider_i = 0; ider_i < ider_count; ider_i ++) {
-            ecs_event_id_record_t *ider = iders[ider_i];
-            flecs_observers_invoke(world, &ider->self, &it, table, 0);
-            ecs_assert(it.event_cur == evtx, ECS_INTERNAL_ERROR, NULL);
-            flecs_observers_invoke(world, &ider->self_up, &it, table, 0);
+        if (ider_count) {
+            flecs_event_fanout_invoke(world, 
+                ECS_CONST_CAST(ecs_event_record_t*, er), fanout, id, &it, table);
             ecs_assert(it.event_cur == evtx, ECS_INTERNAL_ERROR, NULL);
         }
 
@@ -13861,6 +15032,9 @@ void flecs_inc_observer_count(
 {
     ecs_event_id_record_t *idt = flecs_event_id_record_ensure(world, evt, id);
     ecs_assert(idt != NULL, ECS_INTERNAL_ERROR, NULL);
+
+    /* Invalidate flattened observer lists for event */
+    evt->fanout_version ++;
     
     int32_t result = idt->observer_count += value;
     if (result == 1) {
@@ -14094,11 +15268,139 @@ void flecs_default_uni_observer_run_callback(ecs_iter_t *it) {
     o->callback(it);
 }
 
+static
+void flecs_observer_async_push(
+    ecs_world_t *world,
+    ecs_observer_async_t *async,
+    const ecs_iter_t *it)
+{
+    int32_t i, count = it->count;
+    for (i = 0; i < count; i ++) {
+        ecs_entity_t e = it->entities[i];
+        ecs_map_val_t *index = ecs_map_get(&async->index, e);
+        if (index && index[0] >= flecs_ito(uint64_t, async->processed)) {
+            /* Coalesce with the event already queued for the entity */
+            ecs_observer_async_event_t *queued = ecs_vec_get_t(
+                &async->queue, ecs_observer_async_event_t, (int32_t)index[0]);
+            queued->event = it->event;
+            continue;
+        }
+
+        /* Events that were processed but not yet flushed aren't reused */
+        uint64_t queue_index = flecs_ito(uint64_t, 
+            ecs_vec_count(&async->queue));
+        if (index) {
+            index[0] = queue_index;
+        } else {
+            ecs_map_insert(&async->index, e, queue_index);
+        }
+
+        ecs_observer_async_event_t *ev = ecs_vec_append_t(&world->allocator,
+            &async->queue, ecs_observer_async_event_t);
+        ev->entity = e;
+        ev->event = it->event;
+    }
+}
+
+void flecs_observer_async_run(
+    ecs_world_t *stage,
+    ecs_observer_t *o,
+    int32_t stage_index,
+    int32_t stage_count)
+{
+    ecs_observer_async_t *async = flecs_observer_impl(o)->async;
+    const ecs_world_t *world = ecs_get_world(stage);
+    const ecs_observer_async_event_t *events = ecs_vec_first(&async->queue);
+    int32_t count = ecs_vec_count(&async->queue);
+    int32_t i = count * stage_index / stage_count;
+    int32_t last = count * (stage_index + 1) / stage_count;
+
+    while (i < last) {
+        ecs_entity_t e = events[i].entity;
+        ecs_entity_t event = events[i].event;
+        if (!ecs_is_alive(world, e)) {
+            i ++;
+            continue;
+        }
+
+        ecs_record_t *r = flecs_entities_get(world, e);
+        ecs_table_t *table = r->table;
+        int32_t row = ECS_RECORD_TO_ROW(r->row);
+        int32_t table_count = ecs_table_count(table);
+        const ecs_entity_t *entities = ecs_table_entities(table);
+
+        /* Invoke observer once for entities in consecutive rows */
+        int32_t range = 1;
+        while ((i + range) < last && (row + range) < table_count) {
+            const ecs_observer_async_event_t *next = &events[i + range];
+            if (entities[row + range] != next->entity || next->event != event) {
+                break;
+            }
+            range ++;
+        }
+
+        /* Evaluate the query for the range, as the entities may no longer
+         * match the observer by the time the queue is processed. */
+        ecs_iter_t it = ecs_query_iter(stage, o->query);
+        ecs_iter_set_var_as_range(&it, 0, &(ecs_table_range_t){
+            .table = table, .offset = row, .count = range });
+        it.system = o->entity;
+        it.ctx = o->ctx;
+        it.callback_ctx = o->callback_ctx;
+        it.callback = o->callback;
+        it.event = event;
+        while (ecs_query_next(&it)) {
+            it.event = event;
+            o->callback(&it);
+        }
+
+        i += range;
+    }
+
+    if (!stage_index) {
+        /* No events are added until all workers are done. The events are 
+         * removed by the flush system, which runs after the workers synced. */
+        async->processed = count;
+    }
+}
+
+void flecs_observer_async_flush(
+    ecs_world_t *world,
+    ecs_observer_t *o)
+{
+    ecs_observer_async_t *async = flecs_observer_impl(o)->async;
+    int32_t processed = async->processed;
+    if (!processed) {
+        return;
+    }
+
+    /* Keep events that were added after the queue was processed */
+    ecs_observer_async_event_t *events = ecs_vec_first(&async->queue);
+    int32_t i, remaining = ecs_vec_count(&async->queue) - processed;
+    ecs_map_clear(&async->index);
+    for (i = 0; i < remaining; i ++) {
+        events[i] = events[processed + i];
+        ecs_map_insert(&async->index, events[i].entity, flecs_ito(uint64_t, i));
+    }
+
+    ecs_vec_set_count_t(&world->allocator, &async->queue, 
+        ecs_observer_async_event_t, remaining);
+    async->processed = 0;
+}
+
 static
 void flecs_observer_invoke(
     ecs_observer_t *o,
     ecs_iter_t *it)
 {
+    ecs_observer_async_t *async = flecs_observer_impl(o)->async;
+    if (async) {
+        flecs_observer_async_push(it->real_world, async, it);
+        return;
+    }
+
+    ecs_os_perf_trace_push("flecs.observer");
+
     if (o->run) {
         it->next = flecs_default_next_callback;
         it->callback = o->callback;
@@ -14114,9 +15416,10 @@ void flecs_observer_invoke(
         it->callback = callback;
         callback(it);
     }
+
+    ecs_os_perf_trace_pop("flecs.observer");
 }
 
-static
 void flecs_uni_observer_invoke(
     ecs_world_t *world,
     ecs_observer_t *o,
@@ -14340,7 +15643,9 @@ void flecs_multi_observer_invoke(
             world->stages[0], o->entity);
         ecs_table_lock(it->world, table);
 
-        if (o->run) {
+        if (impl->async) {
+            flecs_observer_async_push(world, impl->async, &user_it);
+        } else if (o->run) {
             user_it.next = flecs_default_next_callback;
             o->run(&user_it);
         } else {
@@ -14384,7 +15689,10 @@ void flecs_multi_observer_invoke_no_query(
         world->stages[0], o->entity);
     ecs_table_lock(it->world, table);
 
-    if (o->run) {
+    ecs_observer_async_t *async = flecs_observer_impl(o)->async;
+    if (async) {
+        flecs_observer_async_push(world, async, &user_it);
+    } else if (o->run) {
         user_it.next = flecs_default_next_callback;
         o->run(&user_it);
     } else {
@@ -14745,6 +16053,52 @@ void flecs_observer_poly_fini(void *ptr) {
     flecs_observer_fini(ptr);
 }
 
+static
+int flecs_observer_async_init(
+    ecs_world_t *world,
+    ecs_observer_t *o,
+    const ecs_observer_desc_t *desc)
+{
+#ifdef FLECS_SYSTEM
+    ecs_check(!o->run, ECS_INVALID_PARAMETER,
+        "async observers cannot have a run callback");
+    ecs_check(o->query->flags & EcsQueryMatchThis, ECS_UNSUPPORTED,
+        "async observers must match $this");
+
+    /* Component values are read when the queue is processed, which is not
+     * possible for components that were removed. */
+    int32_t i;
+    for (i = 0; i < o->event_count; i ++) {
+        ecs_entity_t event = o->events[i];
+        ecs_check(event == EcsOnAdd || event == EcsOnSet, ECS_UNSUPPORTED,
+            "async observers only support OnAdd and OnSet events");
+    }
+
+    ecs_observer_impl_t *impl = flecs_observer_impl(o);
+    ecs_observer_async_t *async = impl->async = flecs_calloc_t(
+        &world->allocator, ecs_observer_async_t);
+    ecs_vec_init_t(&world->allocator, &async->queue, 
+        ecs_observer_async_event_t, 0);
+    ecs_map_init(&async->index, &world->allocator);
+
+    async->system = flecs_observer_async_system_init(
+        world, o, desc->async_phase);
+    if (!async->system) {
+        return -1;
+    }
+
+    return 0;
+error:
+    return -1;
+#else
+    (void)world;
+    (void)o;
+    (void)desc;
+    ecs_err("async observers require the system addon");
+    return -1;
+#endif
+}
+
 ecs_observer_t* flecs_observer_init(
     ecs_world_t *world,
     ecs_entity_t entity,
@@ -14886,6 +16240,12 @@ ecs_observer_t* flecs_observer_init(
         }
     }
 
+    if (desc->async_phase) {
+        if (flecs_observer_async_init(world, o, desc)) {
+            goto error;
+        }
+    }
+
     if (impl->flags & EcsObserverYieldOnCreate) {
         flecs_observer_yield_existing(world, o, false);
     }
@@ -15041,6 +16401,15 @@ void flecs_observer_fini(
         ecs_query_fini(impl->not_query);
     }
 
+    /* The async system is a child of the observer, and is deleted with it */
+    ecs_observer_async_t *async = impl->async;
+    if (async) {
+        ecs_vec_fini_t(&world->allocator, &async->queue, 
+            ecs_observer_async_event_t);
+        ecs_map_fini(&async->index);
+        flecs_free_t(&world->allocator, ecs_observer_async_t, async);
+    }
+
     /* Cleanup context */
     if (o->ctx_free) {
         o->ctx_free(o->ctx);
@@ -15436,11 +16805,58 @@ void ecs_os_strset(char **str, const char *value) {
     ecs_os_free(old);
 }
 
+#ifdef FLECS_PERF_TRACE
+/* Fiber that is running on the calling thread */
+static FLECS_PERF_TRACE_TLS ecs_perf_trace_fiber_t *flecs_perf_trace_fiber;
+
+void flecs_perf_trace_fiber_enter(
+    ecs_perf_trace_fiber_t *fiber)
+{
+    fiber->prev = flecs_perf_trace_fiber;
+    flecs_perf_trace_fiber = fiber;
+
+    if (ecs_os_api.perf_trace_push_) {
+        int32_t i, count = ECS_MIN(fiber->depth, FLECS_PERF_TRACE_FIBER_DEPTH);
+        for (i = 0; i < count; i ++) {
+            ecs_os_api.perf_trace_push_(fiber->scopes[i].file, 
+                fiber->scopes[i].line, fiber->scopes[i].name);
+        }
+    }
+}
+
+void flecs_perf_trace_fiber_leave(
+    ecs_perf_trace_fiber_t *fiber)
+{
+    flecs_perf_trace_fiber = fiber->prev;
+    fiber->prev = NULL;
+
+    if (ecs_os_api.perf_trace_pop_) {
+        int32_t i = ECS_MIN(fiber->depth, FLECS_PERF_TRACE_FIBER_DEPTH);
+        while (i --) {
+            ecs_os_api.perf_trace_pop_(fiber->scopes[i].file, 
+                fiber->scopes[i].line, fiber->scopes[i].name);
+        }
+    }
+}
+#endif
+
 void ecs_os_perf_trace_push_(
     const char *file,
     size_t line,
     const char *name)
 {
+#ifdef FLECS_PERF_TRACE
+    ecs_perf_trace_fiber_t *fiber = flecs_perf_trace_fiber;
+    if (fiber) {
+        int32_t depth = fiber->depth ++;
+        if (depth < FLECS_PERF_TRACE_FIBER_DEPTH) {
+            fiber->scopes[depth].file = file;
+            fiber->scopes[depth].line = line;
+            fiber->scopes[depth].name = name;
+        }
+    }
+#endif
+
     if (ecs_os_api.perf_trace_push_) {
         ecs_os_api.perf_trace_push_(file, line, name);
     }
@@ -15451,6 +16867,13 @@ void ecs_os_perf_trace_pop_(
     size_t line,
     const char *name)
 {
+#ifdef FLECS_PERF_TRACE
+    ecs_perf_trace_fiber_t *fiber = flecs_perf_trace_fiber;
+    if (fiber && fiber->depth) {
+        fiber->depth --;
+    }
+#endif
+
     if (ecs_os_api.perf_trace_pop_) {
         ecs_os_api.perf_trace_pop_(file, line, name);
     }
@@ -15598,6 +17021,18 @@ bool ecs_os_has_task_support(void) {
         (ecs_os_api.task_join_ != NULL);
 }
 
+bool ecs_os_has_thread_affinity(void) {
+    return ecs_os_api.thread_set_affinity_ != NULL;
+}
+
+bool ecs_os_has_fibers(void) {
+    return
+        (ecs_os_api.fiber_new_ != NULL) &&
+        (ecs_os_api.fiber_free_ != NULL) &&
+        (ecs_os_api.fiber_resume_ != NULL) &&
+        (ecs_os_api.fiber_yield_ != NULL);
+}
+
 bool ecs_os_has_time(void) {
     return 
         (ecs_os_api.get_time_ != NULL) &&
@@ -16254,13 +17689,24 @@ static
 ecs_cmd_t* flecs_cmd_new(
     ecs_stage_t *stage)
 {
-    ecs_cmd_t *cmd = ecs_vec_append_t(&stage->allocator, &stage->cmd->queue, 
-        ecs_cmd_t);
+    ecs_vec_t *queue = &stage->cmd->queue;
+    int32_t index = ecs_vec_count(queue);
+    ecs_cmd_t *cmd = ecs_vec_append_t(&stage->allocator, queue, ecs_cmd_t);
     cmd->is._1.value = NULL;
     cmd->id = 0;
     cmd->next_for_entity = 0;
     cmd->entry = NULL;
-    cmd->system = stage->system;
+
+    if (stage->world->on_commands_active) {
+        /* Commands are being captured, keep track of which system enqueued
+         * the command. Commands enqueued before capturing started have 0. */
+        ecs_vec_t *systems = &stage->cmd->systems;
+        ecs_vec_set_min_count_zeromem_t(
+            &stage->allocator, systems, ecs_entity_t, index);
+        ecs_vec_append_t(&stage->allocator, systems, ecs_entity_t)[0] = 
+            stage->system;
+    }
+
     return cmd;
 }
 
@@ -16330,6 +17776,7 @@ void flecs_stage_merge(
 
     ecs_dbg_3("#[magenta]merge");
     ecs_log_push_3();
+    ecs_os_perf_trace_push("flecs.merge");
 
     if (is_stage) {
         /* Check for consistency if force_merge is enabled. In practice this
@@ -16361,7 +17808,8 @@ void flecs_stage_merge(
     if (stage->id == -1) {
         flecs_defer_begin(world, stage);
     }
-    
+
+    ecs_os_perf_trace_pop("flecs.merge");
     ecs_log_pop_3();
 }
 
@@ -16727,7 +18175,6 @@ void* flecs_defer_set(
         /* If component didn't exist yet, insert command that will create it */
         cmd->kind = cmd_kind;
         cmd->id = id;
-        cmd->cdr = cdr;
         cmd->entity = entity;
         cmd->is._1.size = size;
         cmd->is._1.value = cmd_value;
@@ -16813,6 +18260,517 @@ void flecs_enqueue(
     }
 }
 
+bool flecs_stage_merge_parallel_begin(
+    ecs_world_t *world)
+{
+    if (world->on_commands_active) {
+        /* Commands are captured with the queue as it is when merged */
+        return false;
+    }
+
+    int32_t i, total = 0, stage_count = world->stage_count;
+    for (i = 0; i < stage_count; i ++) {
+        total += ecs_vec_count(&world->stages[i]->cmd->queue);
+    }
+
+    if (total < FLECS_PARALLEL_MERGE_MIN_COMMANDS) {
+        return false;
+    }
+
+    /* Commands that are not batched per entity (like delete) can affect any
+     * entity, in which case moving a command ahead of them could change the
+     * outcome of the merge. */
+    for (i = 0; i < stage_count; i ++) {
+        ecs_vec_t *queue = &world->stages[i]->cmd->queue;
+        ecs_cmd_t *cmds = ecs_vec_first_t(queue, ecs_cmd_t);
+        int32_t c, count = ecs_vec_count(queue);
+        for (c = 0; c < count; c ++) {
+            if (!cmds[c].entry && cmds[c].kind != EcsCmdSkip) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/* Last column lookup, commands for subsequent entities often are for the same
+ * component and table. */
+typedef struct ecs_cmd_column_cache_t {
+    ecs_table_t *table;
+    ecs_id_t id;
+    int32_t column;
+} ecs_cmd_column_cache_t;
+
+/* Get column for command id, or -1 if the table doesn't have the component or
+ * if the component has an OnSet hook. */
+static
+int32_t flecs_stage_cmd_column(
+    ecs_world_t *world,
+    ecs_cmd_column_cache_t *cache,
+    ecs_table_t *table,
+    ecs_id_t id)
+{
+    if (cache->table == table && cache->id == id) {
+        return cache->column;
+    }
+
+    int32_t column = -1;
+    ecs_component_record_t *cdr = flecs_components_get(world, id);
+    if (cdr) {
+        const ecs_table_record_t *tr = flecs_component_get_table(cdr, table);
+        if (tr && tr->column != -1) {
+            if (!table->data.columns[tr->column].ti->hooks.on_set) {
+                column = tr->column;
+            }
+        }
+    }
+
+    cache->table = table;
+    cache->id = id;
+    cache->column = column;
+    return column;
+}
+
+/* Returns whether the commands for an entity only assign values to components
+ * the entity already has, without invoking hooks or observers. This is the 
+ * case for set commands for existing components, and for the add commands 
+ * that are inserted when a component that already exists is set or ensured. */
+static
+bool flecs_stage_cmds_parallel_safe(
+    ecs_world_t *world,
+    ecs_cmd_column_cache_t *cache,
+    ecs_cmd_t *cmds,
+    int32_t start,
+    ecs_table_t *table)
+{
+    if (table->flags & EcsTableHasOnSet) {
+        return false;
+    }
+
+    int32_t cur = start;
+    do {
+        ecs_cmd_t *cmd = &cmds[cur];
+        ecs_cmd_kind_t kind = cmd->kind;
+        if (kind != EcsCmdSet && kind != EcsCmdAdd && 
+            kind != EcsCmdAddModified) 
+        {
+            return false;
+        }
+
+        if (flecs_stage_cmd_column(world, cache, table, cmd->id) == -1) {
+            return false;
+        }
+
+        cur = cmd->next_for_entity;
+        if (cur < 0) {
+            cur *= -1;
+        }
+    } while (cur);
+
+    return true;
+}
+
+/* Returns whether another stage has commands for the entity */
+static
+bool flecs_stage_cmds_shared(
+    ecs_world_t *world,
+    ecs_stage_t *stage,
+    ecs_entity_t e)
+{
+    int32_t i, stage_count = world->stage_count;
+    for (i = 0; i < stage_count; i ++) {
+        ecs_stage_t *other = world->stages[i];
+        if (other == stage) {
+            continue;
+        }
+
+        ecs_cmd_entry_t *entry = flecs_sparse_get_any_t(
+            &other->cmd->entries, ecs_cmd_entry_t, e);
+        if (entry && entry->first != -1) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Apply commands for entities that have no commands in other stages, and that
+ * only assign existing components that have no OnSet hooks or observers.
+ * Since these commands only write the component storage of a single entity, 
+ * they can be applied by multiple threads at the same time, and in any order
+ * relative to the commands of other entities. Applied commands are turned into
+ * skip commands with a 0 entity, which the regular merge ignores. 
+ * Change detection state is shared between entities and is updated by 
+ * flecs_stage_merge_parallel_end. */
+static
+void flecs_stage_merge_parallel_cmds(
+    ecs_world_t *world,
+    ecs_stage_t *stage,
+    ecs_commands_t *commands,
+    bool check_shared)
+{
+    ecs_vec_t *queue = &commands->queue;
+    ecs_cmd_t *cmds = ecs_vec_first_t(queue, ecs_cmd_t);
+    int32_t i, count = ecs_vec_count(queue);
+    ecs_cmd_column_cache_t cache = {0};
+
+    for (i = 0; i < count; i ++) {
+        ecs_cmd_t *cmd = &cmds[i];
+        ecs_cmd_entry_t *entry = cmd->entry;
+        if (!entry || entry->first != i) {
+            /* Only start from first command for entity */
+            continue;
+        }
+
+        ecs_entity_t e = cmd->entity;
+        ecs_record_t *r = flecs_entities_try(world, e);
+        if (!r || !r->table) {
+            continue;
+        }
+
+        ecs_table_t *table = r->table;
+        if (!flecs_stage_cmds_parallel_safe(world, &cache, cmds, i, table)) {
+            continue;
+        }
+
+        if (check_shared && flecs_stage_cmds_shared(world, stage, e)) {
+            continue;
+        }
+
+        int32_t row = ECS_RECORD_TO_ROW(r->row);
+        bool track_changes = table->dirty_state || table->_->chunk_ticks;
+        int32_t cur = i;
+        do {
+            cmd = &cmds[cur];
+
+            if (cmd->kind == EcsCmdSet) {
+                /* Component was added by another command after the value was
+                 * stored in the command, copy it to the storage. */
+                ecs_column_t *column = &table->data.columns[
+                    flecs_stage_cmd_column(world, &cache, table, cmd->id)];
+                const ecs_type_info_t *ti = column->ti;
+                void *ptr = ECS_ELEM(column->data, ti->size, row);
+                void *value = cmd->is._1.value;
+
+                ecs_move_t move = ti->hooks.move_dtor;
+                if (move) {
+                    move(ptr, value, 1, ti);
+                } else {
+                    ecs_os_memcpy(ptr, value, ti->size);
+                }
+
+                flecs_stack_free(value, cmd->is._1.size);
+                cmd->is._1.value = NULL;
+            }
+
+            if (cmd->kind != EcsCmdAdd) {
+                if (track_changes) {
+                    ecs_cmd_dirty_t *dirty = ecs_vec_append_t(
+                        &stage->allocator, &stage->parallel_dirty, 
+                            ecs_cmd_dirty_t);
+                    dirty->table = table;
+                    dirty->row = row;
+                    dirty->id = cmd->id;
+                }
+                stage->parallel_set_count ++;
+            }
+
+            cmd->kind = EcsCmdSkip;
+            cmd->entity = 0;
+
+            cur = cmd->next_for_entity;
+            if (cur < 0) {
+                cur *= -1;
+            }
+
+            cmd->next_for_entity = 0;
+        } while (cur);
+    }
+}
+
+void flecs_stage_merge_parallel(
+    ecs_world_t *world,
+    ecs_stage_t *stage)
+{
+    ecs_os_perf_trace_push("flecs.merge.parallel");
+    flecs_stage_merge_parallel_cmds(world, stage, stage->cmd, true);
+    ecs_os_perf_trace_pop("flecs.merge.parallel");
+}
+
+void flecs_stage_merge_parallel_end(
+    ecs_world_t *world)
+{
+    int32_t i, stage_count = world->stage_count;
+    for (i = 0; i < stage_count; i ++) {
+        ecs_stage_t *stage = world->stages[i];
+        ecs_cmd_dirty_t *dirty = ecs_vec_first_t(
+            &stage->parallel_dirty, ecs_cmd_dirty_t);
+        int32_t d, count = ecs_vec_count(&stage->parallel_dirty);
+        for (d = 0; d < count; d ++) {
+            flecs_table_mark_dirty(
+                world, dirty[d].table, dirty[d].row, dirty[d].id);
+        }
+
+        ecs_vec_clear(&stage->parallel_dirty);
+        world->info.cmd.set_count += stage->parallel_set_count;
+        world->info.cmd.batched_command_count += stage->parallel_set_count;
+        stage->parallel_set_count = 0;
+    }
+}
+
+bool flecs_stage_cmds_assign_only(
+    ecs_world_t *world,
+    ecs_vec_t *ids)
+{
+    if (world->on_commands_active) {
+        return false;
+    }
+
+    int32_t i, total = 0, stage_count = world->stage_count;
+    for (i = 0; i < stage_count; i ++) {
+        total += ecs_vec_count(&world->stages[i]->cmd->queue);
+    }
+
+    if (total < FLECS_PARALLEL_MERGE_MIN_COMMANDS) {
+        return false;
+    }
+
+    ecs_cmd_column_cache_t cache = {0};
+    for (i = 0; i < stage_count; i ++) {
+        ecs_vec_t *queue = &world->stages[i]->cmd->queue;
+        ecs_cmd_t *cmds = ecs_vec_first_t(queue, ecs_cmd_t);
+        int32_t c, count = ecs_vec_count(queue);
+        for (c = 0; c < count; c ++) {
+            ecs_cmd_t *cmd = &cmds[c];
+            ecs_cmd_entry_t *entry = cmd->entry;
+            if (!entry) {
+                if (cmd->kind != EcsCmdSkip) {
+                    return false;
+                }
+                continue;
+            }
+
+            if (entry->first != c) {
+                continue;
+            }
+
+            ecs_entity_t e = cmd->entity;
+            if (!flecs_entities_is_alive(world, e)) {
+                /* Commands for deleted entities are discarded */
+                continue;
+            }
+
+            ecs_record_t *r = flecs_entities_get(world, e);
+            if (!r->table || !flecs_stage_cmds_parallel_safe(
+                world, &cache, cmds, c, r->table))
+            {
+                return false;
+            }
+
+            int32_t cur = c;
+            do {
+                ecs_id_t id = cmds[cur].id;
+                ecs_id_t *ptr = ecs_vec_first_t(ids, ecs_id_t);
+                int32_t k, id_count = ecs_vec_count(ids);
+                if (!id_count || ptr[id_count - 1] != id) {
+                    for (k = 0; k < id_count; k ++) {
+                        if (ptr[k] == id) {
+                            break;
+                        }
+                    }
+                    if (k == id_count) {
+                        ecs_vec_append_t(
+                            &world->allocator, ids, ecs_id_t)[0] = id;
+                    }
+                }
+
+                cur = cmds[cur].next_for_entity;
+                if (cur < 0) {
+                    cur *= -1;
+                }
+            } while (cur);
+        }
+    }
+
+    return true;
+}
+
+static
+ecs_commands_t* flecs_stage_cmd_inactive(
+    ecs_stage_t *stage)
+{
+    if (stage->cmd == &stage->cmd_stack[0]) {
+        return &stage->cmd_stack[1];
+    } else {
+        return &stage->cmd_stack[0];
+    }
+}
+
+void flecs_stage_merge_overlap_begin(
+    ecs_world_t *world)
+{
+    int32_t i, stage_count = world->stage_count;
+    for (i = 0; i < stage_count; i ++) {
+        ecs_stage_t *stage = world->stages[i];
+        ecs_commands_t *cmd = flecs_stage_cmd_inactive(stage);
+        ecs_assert(!ecs_vec_count(&cmd->queue), ECS_INTERNAL_ERROR, NULL);
+        stage->cmd = cmd;
+    }
+}
+
+/* Apply the commands of all stages from the main thread, while workers run 
+ * systems that enqueue commands in the other command buffer of their stage.
+ * The commands are applied in stage order, which is the same order in which
+ * the regular merge would apply them, so entities with commands in multiple
+ * stages don't have to be skipped. */
+void flecs_stage_merge_overlap(
+    ecs_world_t *world)
+{
+    ecs_stage_t *main_stage = world->stages[0];
+    int32_t i, stage_count = world->stage_count;
+    ecs_os_perf_trace_push("flecs.merge.overlap");
+    for (i = 0; i < stage_count; i ++) {
+        ecs_stage_t *stage = world->stages[i];
+        flecs_stage_merge_parallel_cmds(world, main_stage, 
+            flecs_stage_cmd_inactive(stage), false);
+    }
+    ecs_os_perf_trace_pop("flecs.merge.overlap");
+}
+
+static
+void flecs_stage_cmd_overlap_swap(
+    ecs_stage_t *stage)
+{
+    ecs_commands_t tmp = *stage->cmd;
+    *stage->cmd = stage->cmd_overlap;
+    stage->cmd_overlap = tmp;
+}
+
+void flecs_stage_merge_overlap_end(
+    ecs_world_t *world)
+{
+    /* Move the commands of the systems that ran while merging out of the 
+     * stage, so the regular merge only flushes the commands of the current
+     * sync point. Restore the buffers with the applied commands. */
+    int32_t i, stage_count = world->stage_count;
+    for (i = 0; i < stage_count; i ++) {
+        ecs_stage_t *stage = world->stages[i];
+        ecs_assert(!ecs_vec_count(&stage->cmd_overlap.queue), 
+            ECS_INTERNAL_ERROR, NULL);
+        flecs_stage_cmd_overlap_swap(stage);
+        stage->cmd = flecs_stage_cmd_inactive(stage);
+    }
+
+    flecs_stage_merge_parallel_end(world);
+}
+
+void flecs_stage_merge_overlap_restore(
+    ecs_world_t *world)
+{
+    /* Systems that ran while merging belong to the next operation, so their
+     * commands are merged at the sync point of that operation. */
+    int32_t i, stage_count = world->stage_count;
+    for (i = 0; i < stage_count; i ++) {
+        ecs_stage_t *stage = world->stages[i];
+        ecs_assert(!ecs_vec_count(&stage->cmd->queue), 
+            ECS_INTERNAL_ERROR, NULL);
+        flecs_stage_cmd_overlap_swap(stage);
+    }
+}
+
+ecs_entity_t flecs_stage_new_id(
+    ecs_world_t *world,
+    ecs_stage_t *stage)
+{
+    if (!(world->flags & EcsWorldDeterministic) || 
+        !(world->flags & EcsWorldMultiThreaded)) 
+    {
+        return flecs_new_id(world);
+    }
+
+    /* The order in which threads create entities depends on timing. To get
+     * the same ids each run, stage N takes ids from the Nth block of each 
+     * group of blocks, where a group has a block for each stage. Blocks that
+     * the stage didn't use in a previous frame are used first. */
+    if (stage->id_next == stage->id_end) {
+        if (ecs_vec_count(&stage->id_blocks)) {
+            stage->id_next = *ecs_vec_last_t(
+                &stage->id_blocks, ecs_entity_t);
+            ecs_vec_remove_last(&stage->id_blocks);
+        } else {
+            ecs_entity_t block = flecs_ito(ecs_entity_t, 
+                stage->id_block_count * world->stage_count + stage->id);
+            stage->id_next = world->id_block_base + 
+                block * FLECS_DETERMINISTIC_ID_BLOCK + 1;
+            stage->id_block_count ++;
+        }
+        stage->id_end = stage->id_next + FLECS_DETERMINISTIC_ID_BLOCK;
+        ecs_assert(stage->id_end < UINT_MAX, ECS_INVALID_OPERATION, 
+            "thread safe ids exhausted");
+    }
+
+    ecs_entity_t entity = stage->id_next ++;
+
+    ecs_assert(!world->info.max_id || 
+        ecs_entity_t_lo(entity) <= world->info.max_id, 
+        ECS_OUT_OF_RANGE, NULL);
+
+    flecs_journal(world, EcsJournalNew, entity, 0, 0);
+
+    return entity;
+}
+
+void flecs_stage_id_blocks_begin(
+    ecs_world_t *world)
+{
+    world->id_block_base = flecs_entities_max_id(world);
+
+    int32_t i, stage_count = world->stage_count;
+    for (i = 0; i < stage_count; i ++) {
+        world->stages[i]->id_block_count = 0;
+    }
+}
+
+void flecs_stage_id_blocks_end(
+    ecs_world_t *world)
+{
+    int32_t i, b, stage_count = world->stage_count, block_count = 0;
+    for (i = 0; i < stage_count; i ++) {
+        ecs_stage_t *stage = world->stages[i];
+        if (stage->id_block_count > block_count) {
+            block_count = stage->id_block_count;
+        }
+    }
+
+    if (!block_count) {
+        return;
+    }
+
+    /* Skip over all ids that could have been handed out, so the next id 
+     * doesn't depend on which stage created the most entities. */
+    flecs_entities_max_id(world) = world->id_block_base + 
+        flecs_ito(ecs_entity_t, block_count * stage_count) * 
+            FLECS_DETERMINISTIC_ID_BLOCK;
+
+    /* Give blocks that a stage skipped back to the stage, so they're used the
+     * next time the stage creates entities. The remainder of the current block
+     * of a stage is also kept. Which blocks a stage gets only depends on how
+     * many entities the stages created, so ids remain deterministic. Blocks are
+     * added in reverse order so they're used from low to high. */
+    for (i = 0; i < stage_count; i ++) {
+        ecs_stage_t *stage = world->stages[i];
+        for (b = block_count - 1; b >= stage->id_block_count; b --) {
+            ecs_entity_t block = flecs_ito(ecs_entity_t, 
+                b * stage_count + stage->id);
+            ecs_vec_append_t(&stage->allocator, &stage->id_blocks, 
+                ecs_entity_t)[0] = world->id_block_base + 
+                    block * FLECS_DETERMINISTIC_ID_BLOCK + 1;
+        }
+        stage->id_block_count = 0;
+    }
+}
+
 void flecs_stage_merge_post_frame(
     ecs_world_t *world,
     ecs_stage_t *stage)
@@ -16833,6 +18791,7 @@ void flecs_commands_init(
 {
     flecs_stack_init(&cmd->stack);
     ecs_vec_init_t(&stage->allocator, &cmd->queue, ecs_cmd_t, 0);
+    ecs_vec_init_t(&stage->allocator, &cmd->systems, ecs_entity_t, 0);
     flecs_sparse_init_t(&cmd->entries, &stage->allocator,
         &stage->allocators.cmd_entry_chunk, ecs_cmd_entry_t);
 }
@@ -16846,6 +18805,7 @@ void flecs_commands_fini(
 
     flecs_stack_fini(&cmd->stack);
     ecs_vec_fini_t(&stage->allocator, &cmd->queue, ecs_cmd_t);
+    ecs_vec_fini_t(&stage->allocator, &cmd->systems, ecs_entity_t);
     flecs_sparse_fini(&cmd->entries);
 }
 
@@ -16879,11 +18839,16 @@ ecs_stage_t* flecs_stage_new(
 
     ecs_allocator_t *a = &stage->allocator;
     ecs_vec_init_t(a, &stage->post_frame_actions, ecs_action_elem_t, 0);
+    ecs_vec_init_t(a, &stage->parallel_dirty, ecs_cmd_dirty_t, 0);
+    ecs_vec_init_t(a, &stage->id_blocks, ecs_entity_t, 0);
+    stage->cpu = -1;
+    stage->numa_node = -1;
 
     int32_t i;
     for (i = 0; i < 2; i ++) {
         flecs_commands_init(stage, &stage->cmd_stack[i]);
     }
+    flecs_commands_init(stage, &stage->cmd_overlap);
 
     stage->cmd = &stage->cmd_stack[0];
     return stage;
@@ -16903,6 +18868,8 @@ void flecs_stage_free(
     ecs_allocator_t *a = &stage->allocator;
     
     ecs_vec_fini_t(a, &stage->post_frame_actions, ecs_action_elem_t);
+    ecs_vec_fini_t(a, &stage->parallel_dirty, ecs_cmd_dirty_t);
+    ecs_vec_fini_t(a, &stage->id_blocks, ecs_entity_t);
     ecs_vec_fini(NULL, &stage->variables, 0);
     ecs_vec_fini(NULL, &stage->operations, 0);
 
@@ -16910,6 +18877,7 @@ void flecs_stage_free(
     for (i = 0; i < 2; i ++) {
         flecs_commands_fini(stage, &stage->cmd_stack[i]);
     }
+    flecs_commands_fini(stage, &stage->cmd_overlap);
 
 #ifdef FLECS_SCRIPT
     if (stage->runtime) {
@@ -16917,6 +18885,12 @@ void flecs_stage_free(
     }
 #endif
 
+#ifdef FLECS_PERF_COUNTERS
+    if (stage->perf) {
+        flecs_system_perf_free(stage->perf);
+    }
+#endif
+
     flecs_stack_fini(&stage->allocators.iter_stack);
     flecs_stack_fini(&stage->allocators.deser_stack);
     flecs_ballocator_fini(&stage->allocators.cmd_entry_chunk);
@@ -17083,6 +19057,10 @@ bool ecs_readonly_begin(
 
     bool is_readonly = ECS_BIT_IS_SET(world->flags, EcsWorldReadonly);
 
+    if (multi_threaded && (world->flags & EcsWorldDeterministic)) {
+        flecs_stage_id_blocks_begin(world);
+    }
+
     /* From this point on, the world is "locked" for mutations, and it is only 
      * allowed to enqueue commands from stages */
     ECS_BIT_SET(world->flags, EcsWorldReadonly);
@@ -17098,6 +19076,10 @@ void ecs_readonly_end(
     ecs_check(world->flags & EcsWorldReadonly, ECS_INVALID_OPERATION,
         "world is not in readonly mode");
 
+    if (world->flags & EcsWorldDeterministic) {
+        flecs_stage_id_blocks_end(world);
+    }
+
     /* After this it is safe again to mutate the world directly */
     ECS_BIT_CLEAR(world->flags, EcsWorldReadonly);
     ECS_BIT_CLEAR(world->flags, EcsWorldMultiThreaded);
@@ -18231,6 +20213,12 @@ static const char *flecs_addons_info[] = {
 #ifdef FLECS_JOURNAL
     "FLECS_JOURNAL",
 #endif
+#ifdef FLECS_SHARD
+    "FLECS_SHARD",
+#endif
+#ifdef FLECS_RECORDER
+    "FLECS_RECORDER",
+#endif
 #ifdef FLECS_APP
     "FLECS_APP",
 #endif
@@ -18345,6 +20333,7 @@ ecs_world_t *ecs_mini(void) {
     flecs_poly_init(world, ecs_world_t);
 
     world->flags |= EcsWorldInit;
+    world->change_tick = 1;
 
     flecs_world_allocators_init(world);
     ecs_allocator_t *a = &world->allocator;
@@ -18359,6 +20348,8 @@ ecs_world_t *ecs_mini(void) {
     flecs_name_index_init(&world->symbols, a);
     ecs_vec_init_t(a, &world->fini_actions, ecs_action_elem_t, 0);
     ecs_vec_init_t(a, &world->component_ids, ecs_id_t, 0);
+    ecs_vec_init_t(a, &world->event_batches, ecs_event_batch_t, 0);
+    world->propagate_version = 1;
 
     world->info.time_scale = 1.0;
     if (ecs_os_has_time()) {
@@ -19105,8 +21096,10 @@ int ecs_fini(
     flecs_observable_fini(&world->observable);
     flecs_name_index_fini(&world->aliases);
     flecs_name_index_fini(&world->symbols);
+    flecs_query_expr_cache_fini(world);
     ecs_set_stage_count(world, 0);
     ecs_vec_fini_t(&world->allocator, &world->component_ids, ecs_id_t);
+    ecs_vec_fini_t(&world->allocator, &world->event_batches, ecs_event_batch_t);
     ecs_log_pop_1();
 
     flecs_world_allocators_fini(world);
@@ -19190,6 +21183,226 @@ void ecs_set_default_query_flags(
     world->default_query_flags = flags;
 }
 
+void ecs_set_deterministic(
+    ecs_world_t *world,
+    bool enable)
+{
+    flecs_poly_assert(world, ecs_world_t);
+    ecs_check(!(world->flags & EcsWorldReadonly), ECS_INVALID_OPERATION,
+        "cannot change deterministic mode while world is in readonly mode");
+
+    if (!enable) {
+        /* Free id blocks that stages reserved. The ids in the blocks are not
+         * reused, since the max id of the world was moved past them. */
+        int32_t i;
+        for (i = 0; i < world->stage_count; i ++) {
+            ecs_stage_t *stage = world->stages[i];
+            ecs_vec_fini_t(&stage->allocator, &stage->id_blocks, ecs_entity_t);
+            stage->id_next = stage->id_end = 0;
+        }
+    }
+
+    ECS_BIT_COND(world->flags, EcsWorldDeterministic, enable);
+error:
+    return;
+}
+
+static
+uint64_t flecs_state_hash_combine(
+    uint64_t hash,
+    uint64_t value)
+{
+    uint64_t data[2] = { hash, value };
+    return flecs_hash(data, ECS_SIZEOF(data));
+}
+
+/* Returns whether component is defined by flecs. Builtin components can store
+ * pointers (like function pointers or vectors) without having a copy hook. */
+static
+bool flecs_state_hash_is_builtin(
+    const ecs_world_t *world,
+    ecs_entity_t component)
+{
+    ecs_entity_t parent = component;
+    while ((parent = ecs_get_parent(world, parent))) {
+        if (parent == EcsFlecs) {
+            return true;
+        }
+    }
+    return false;
+}
+
+#ifdef FLECS_META
+/* Copy the members of a value described by serializer ops. Bytes of dst that
+ * are not covered by a member (padding) are left as is. */
+static
+void flecs_state_hash_copy_members(
+    const ecs_world_t *world,
+    const ecs_meta_type_op_t *ops,
+    int32_t op_count,
+    void *dst,
+    const void *src,
+    int32_t in_array)
+{
+    int32_t i;
+    for (i = 0; i < op_count; i ++) {
+        const ecs_meta_type_op_t *op = &ops[i];
+
+        if (in_array <= 0 && op->count > 1) {
+            /* Inline array, elements are op->size bytes apart */
+            int32_t e;
+            for (e = 0; e < op->count; e ++) {
+                flecs_state_hash_copy_members(world, op, op->op_count, 
+                    ECS_OFFSET(dst, e * op->size), 
+                    ECS_OFFSET(src, e * op->size), 1);
+            }
+            i += op->op_count - 1;
+            continue;
+        }
+
+        switch(op->kind) {
+        case EcsOpPush:
+            in_array --;
+            break;
+        case EcsOpPop:
+            in_array ++;
+            break;
+        case EcsOpArray: {
+            const EcsArray *a = ecs_get(world, op->type, EcsArray);
+            ecs_assert(a != NULL, ECS_INTERNAL_ERROR, NULL);
+            const EcsTypeSerializer *ser = ecs_get(
+                world, a->type, EcsTypeSerializer);
+            const ecs_type_info_t *ti = ecs_get_type_info(world, a->type);
+            ecs_assert(ser != NULL, ECS_INTERNAL_ERROR, NULL);
+            ecs_assert(ti != NULL, ECS_INTERNAL_ERROR, NULL);
+            int32_t e;
+            for (e = 0; e < a->count; e ++) {
+                flecs_state_hash_copy_members(world, ecs_vec_first(&ser->ops),
+                    ecs_vec_count(&ser->ops), 
+                    ECS_OFFSET(dst, op->offset + e * ti->size),
+                    ECS_OFFSET(src, op->offset + e * ti->size), 1);
+            }
+            break;
+        }
+        case EcsOpVector:
+        case EcsOpOpaque:
+        case EcsOpString:
+            /* Value is a pointer, which differs between runs */
+            break;
+        case EcsOpScope:
+        case EcsOpEnum:
+        case EcsOpBitmask:
+        case EcsOpPrimitive:
+        case EcsOpBool:
+        case EcsOpChar:
+        case EcsOpByte:
+        case EcsOpU8:
+        case EcsOpU16:
+        case EcsOpU32:
+        case EcsOpU64:
+        case EcsOpI8:
+        case EcsOpI16:
+        case EcsOpI32:
+        case EcsOpI64:
+        case EcsOpF32:
+        case EcsOpF64:
+        case EcsOpUPtr:
+        case EcsOpIPtr:
+        case EcsOpEntity:
+        case EcsOpId:
+        default:
+            ecs_os_memcpy(ECS_OFFSET(dst, op->offset), 
+                ECS_OFFSET(src, op->offset), op->size);
+            break;
+        }
+    }
+}
+#endif
+
+/* Hash component values of a column. For types with reflection data only the
+ * members are hashed, so the hash doesn't depend on the value of padding. */
+static
+uint64_t flecs_column_state_hash(
+    const ecs_world_t *world,
+    const ecs_column_t *column,
+    int32_t count)
+{
+    const ecs_type_info_t *ti = column->ti;
+#ifdef FLECS_META
+    const EcsTypeSerializer *ser = ecs_get(
+        world, ti->component, EcsTypeSerializer);
+    if (ser && count) {
+        ecs_size_t size = ti->size * count;
+        void *values = ecs_os_calloc(size);
+        const ecs_meta_type_op_t *ops = ecs_vec_first(&ser->ops);
+        int32_t i, op_count = ecs_vec_count(&ser->ops);
+        for (i = 0; i < count; i ++) {
+            flecs_state_hash_copy_members(world, ops, op_count, 
+                ECS_ELEM(values, ti->size, i), 
+                ECS_ELEM(column->data, ti->size, i), 0);
+        }
+
+        uint64_t hash = flecs_hash(values, size);
+        ecs_os_free(values);
+        return hash;
+    }
+#else
+    (void)world;
+#endif
+
+    return flecs_hash(column->data, ti->size * count);
+}
+
+static
+uint64_t flecs_table_state_hash(
+    const ecs_world_t *world,
+    const ecs_table_t *table)
+{
+    int32_t count = ecs_table_count(table);
+    uint64_t hash = flecs_hash(table->type.array, 
+        table->type.count * ECS_SIZEOF(ecs_id_t));
+    hash = flecs_state_hash_combine(hash, flecs_hash(table->data.entities,
+        count * ECS_SIZEOF(ecs_entity_t)));
+
+    int32_t i;
+    for (i = 0; i < table->column_count; i ++) {
+        const ecs_column_t *column = &table->data.columns[i];
+        const ecs_type_info_t *ti = column->ti;
+        if ((ti->hooks.flags & ECS_TYPE_HOOK_COPY) || 
+            flecs_state_hash_is_builtin(world, ti->component)) 
+        {
+            /* Value may contain pointers, which differ between runs */
+            continue;
+        }
+
+        hash = flecs_state_hash_combine(hash, 
+            flecs_column_state_hash(world, column, count));
+    }
+
+    return hash;
+}
+
+uint64_t ecs_world_state_hash(
+    const ecs_world_t *world)
+{
+    ecs_check(world != NULL, ECS_INVALID_PARAMETER, NULL);
+    world = ecs_get_world(world);
+
+    /* Combine table hashes with an addition so the result doesn't depend on 
+     * the order in which tables are stored. */
+    uint64_t hash = flecs_table_state_hash(world, &world->store.root);
+    int32_t i, count = flecs_sparse_count(&world->store.tables);
+    for (i = 0; i < count; i ++) {
+        const ecs_table_t *table = flecs_sparse_get_dense_t(
+            &world->store.tables, ecs_table_t, i);
+        hash += flecs_table_state_hash(world, table);
+    }
+
+    return hash;
+error:
+    return 0;
+}
+
 void* ecs_get_ctx(
     const ecs_world_t *world)
 {
@@ -21697,6 +23910,13 @@ typedef SOCKET ecs_http_socket_t;
 #ifdef __FreeBSD__
 #include <netinet/in.h>
 #endif
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <netinet/tcp.h>
+#define ECS_HTTP_EPOLL
+#endif
 typedef int ecs_http_socket_t;
 
 #if !defined(MSG_NOSIGNAL)
@@ -21732,6 +23952,15 @@ typedef int ecs_http_socket_t;
 /* Total number of outstanding send requests */
 #define ECS_HTTP_SEND_QUEUE_MAX (256)
 
+/* Max number of socket events handled per epoll_wait call */
+#define ECS_HTTP_EPOLL_EVENT_MAX (256)
+
+/* Timeout (ms) of epoll_wait, used to check whether the server should run */
+#define ECS_HTTP_EPOLL_TIMEOUT (1000)
+
+/* Timeout (s) before an idle connection is closed */
+#define ECS_HTTP_CONNECTION_IDLE_TIMEOUT (10.0)
+
 /* Global statistics */
 int64_t ecs_http_request_received_count = 0;
 int64_t ecs_http_request_invalid_count = 0;
@@ -21746,6 +23975,7 @@ int64_t ecs_http_busy_count = 0;
 /* Send request queue */
 typedef struct ecs_http_send_request_t {
     ecs_http_socket_t sock;
+    uint64_t conn_id; /* Connection of reply, used by epoll event loop */
     char *headers;
     int32_t header_length;
     char *content;
@@ -21806,6 +24036,12 @@ struct ecs_http_server_t {
     ecs_http_send_queue_t send_queue;
 
     ecs_hashmap_t request_cache;
+
+#ifdef ECS_HTTP_EPOLL
+    int epoll_fd; /* event loop of server thread */
+    int wake_fd; /* eventfd that wakes up the server thread */
+    ecs_vec_t send_ready; /* vector<ecs_http_send_request_t>, replies */
+#endif
 };
 
 /** Fragment state, used by HTTP request parser */
@@ -21842,9 +24078,18 @@ typedef struct {
     char *header_buf_ptr;
     char header_buf[32];
     bool parse_content_length;
+    bool parse_connection;
+    bool close; /* Client doesn't want to keep connection alive */
     bool invalid;
 } ecs_http_fragment_t;
 
+/** Connection state, used by the event loop of the server thread */
+typedef enum {
+    HttpConnStateRecv,      /* Receiving request */
+    HttpConnStateQueued,    /* Waiting for request to be handled */
+    HttpConnStateSend       /* Sending reply */
+} HttpConnState;
+
 /** Extend public connection type with fragment data */
 typedef struct {
     ecs_http_connection_t pub;
@@ -21855,6 +24100,21 @@ typedef struct {
      * timeout when a frame takes longer than usual */
     double dequeue_timeout;
     int32_t dequeue_retries;    
+
+#ifdef ECS_HTTP_EPOLL
+    HttpConnState state;
+    ecs_http_fragment_t frag;   /* Partially received request */
+    char *send_headers;         /* Reply that is being sent */
+    char *send_content;
+    int32_t send_header_length;
+    int32_t send_content_length;
+    int32_t send_offset;        /* Bytes of reply that have been sent */
+    bool keep_alive;            /* Keep connection open after reply */
+    char *recv_pending;         /* Received data of pipelined requests */
+    int32_t recv_pending_offset;
+    int32_t recv_pending_length;
+    uint64_t last_active;       /* Time (ns) of last socket activity */
+#endif
 } ecs_http_connection_impl_t;
 
 typedef struct {
@@ -21864,6 +24124,7 @@ typedef struct {
     int32_t req_len;
 } ecs_http_request_impl_t;
 
+#ifndef ECS_HTTP_EPOLL
 static
 ecs_size_t http_send(
     ecs_http_socket_t sock, 
@@ -21905,6 +24166,7 @@ ecs_size_t http_recv(
 
     return ret;
 }
+#endif
 
 static
 void http_sock_set_timeout(
@@ -21938,6 +24200,21 @@ void http_sock_keep_alive(
     }
 }
 
+#ifdef ECS_HTTP_EPOLL
+/* Replies to pipelined requests are sent one by one. Disable Nagle so that a
+ * reply isn't delayed until the client acknowledges the previous reply. */
+static
+void http_sock_nodelay(
+    ecs_http_socket_t sock)
+{
+    int v = 1;
+    if (setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char*)&v, sizeof v)) {
+        ecs_warn("http: failed to set socket NODELAY: %s",
+            ecs_os_strerror(errno));
+    }
+}
+#endif
+
 static
 void http_sock_nonblock(ecs_http_socket_t sock, bool enable) {
     (void)sock;
@@ -22073,6 +24350,16 @@ void http_connection_free(ecs_http_connection_impl_t *conn) {
         http_close(&conn->sock);
     }
 
+#ifdef ECS_HTTP_EPOLL
+    ecs_strbuf_reset(&conn->frag.buf);
+    ecs_os_free(conn->send_headers);
+    ecs_os_free(conn->send_content);
+    ecs_os_free(conn->recv_pending);
+    conn->send_headers = NULL;
+    conn->send_content = NULL;
+    conn->recv_pending = NULL;
+#endif
+
     flecs_sparse_remove_t(&conn->pub.server->connections, 
         ecs_http_connection_impl_t, conn_id);
 }
@@ -22146,10 +24433,24 @@ void http_header_buf_append(
         frag->header_buf_ptr[0] = ch;
         frag->header_buf_ptr ++;
     } else {
-        frag->header_buf_ptr[0] = '\0';
+        frag->header_buf_ptr[-1] = '\0';
     }
 }
 
+static
+bool http_header_buf_eq(
+    ecs_http_fragment_t *frag,
+    const char *str)
+{
+    const char *ptr = frag->header_buf;
+    for (; *ptr && *str; ptr ++, str ++) {
+        if (tolower((unsigned char)*ptr) != tolower((unsigned char)*str)) {
+            return false;
+        }
+    }
+    return *ptr == *str;
+}
+
 static
 uint64_t http_request_key_hash(const void *ptr) {
     const ecs_http_request_key_t *key = ptr;
@@ -22275,59 +24576,87 @@ char* http_decode_request(
     return res;
 }
 
+/* Must be called while the server is locked. The request is decoded before
+ * the lock is taken, and is owned by the queue or freed after this call. */
 static
-ecs_http_request_entry_t* http_enqueue_request(
+ecs_http_request_entry_t* http_enqueue_request_locked(
     ecs_http_connection_impl_t *conn,
     uint64_t conn_id,
-    ecs_http_fragment_t *frag)
+    ecs_http_fragment_t *frag,
+    ecs_http_request_impl_t *req)
 {
     ecs_http_server_t *srv = conn->pub.server;
-
-    ecs_os_mutex_lock(srv->lock);
     bool is_alive = conn->pub.id == conn_id;
 
-    if (!is_alive || frag->invalid) { 
-        /* Don't enqueue invalid requests or requests for purged connections */
-        ecs_strbuf_reset(&frag->buf);
-    } else {
-        ecs_http_request_impl_t req;
-        char *res = http_decode_request(&req, frag);
-        if (res) {
-            req.pub.conn = (ecs_http_connection_t*)conn;
-
-            /* Check cache for GET requests */
-            if (frag->method == EcsHttpGet) {
-                ecs_http_request_entry_t *entry = 
-                    http_find_request_entry(srv, res, frag->header_offsets[0]);
-                if (entry) {
-                    /* If an entry is found, don't enqueue a request. Instead
-                     * return the cached response immediately. */
-                    ecs_os_free(res);
-                    return entry;
-                }
-            }
+    if (!is_alive) { 
+        /* Don't enqueue requests for purged connections */
+        ecs_os_free(req->res);
+        return NULL;
+    }
+
+    req->pub.conn = (ecs_http_connection_t*)conn;
 
-            ecs_http_request_impl_t *req_ptr = flecs_sparse_add_t(
-                &srv->requests, ecs_http_request_impl_t);
-            *req_ptr = req;
-            req_ptr->pub.id = flecs_sparse_last_id(&srv->requests);
-            req_ptr->conn_id = conn->pub.id;
-            ecs_os_linc(&ecs_http_request_received_count);
+    /* Check cache for GET requests */
+    if (frag->method == EcsHttpGet) {
+        ecs_http_request_entry_t *entry = 
+            http_find_request_entry(srv, req->res, frag->header_offsets[0]);
+        if (entry) {
+            /* If an entry is found, don't enqueue a request. Instead return
+             * the cached response immediately. */
+            ecs_os_free(req->res);
+            return entry;
         }
     }
 
-    ecs_os_mutex_unlock(srv->lock);
+    ecs_http_request_impl_t *req_ptr = flecs_sparse_add_t(
+        &srv->requests, ecs_http_request_impl_t);
+    *req_ptr = *req;
+    req_ptr->pub.id = flecs_sparse_last_id(&srv->requests);
+    req_ptr->conn_id = conn->pub.id;
+    ecs_os_linc(&ecs_http_request_received_count);
+
     return NULL;
 }
 
+#ifndef ECS_HTTP_EPOLL
+static
+ecs_http_request_entry_t* http_enqueue_request(
+    ecs_http_connection_impl_t *conn,
+    uint64_t conn_id,
+    ecs_http_fragment_t *frag)
+{
+    ecs_http_server_t *srv = conn->pub.server;
+    ecs_http_request_impl_t req;
+
+    if (frag->invalid || !http_decode_request(&req, frag)) {
+        /* Don't enqueue invalid requests */
+        ecs_strbuf_reset(&frag->buf);
+        return NULL;
+    }
+
+    ecs_os_mutex_lock(srv->lock);
+    ecs_http_request_entry_t *entry = http_enqueue_request_locked(
+        conn, conn_id, frag, &req);
+    if (!entry) {
+        ecs_os_mutex_unlock(srv->lock);
+    }
+
+    /* If an entry is returned the lock is transferred to the caller */
+    return entry;
+}
+#endif
+
 static
 bool http_parse_request(
     ecs_http_fragment_t *frag,
     const char* req_frag, 
-    ecs_size_t req_frag_len) 
+    ecs_size_t req_frag_len,
+    ecs_size_t *parsed_len) 
 {
+    /* Stop at the end of the request, remaining data belongs to the next
+     * (pipelined) request on the connection */
     int32_t i;
-    for (i = 0; i < req_frag_len; i++) {
+    for (i = 0; i < req_frag_len && frag->state != HttpFragStateDone; i++) {
         char c = req_frag[i];
         switch (frag->state) {
         case HttpFragStateBegin:
@@ -22350,6 +24679,7 @@ bool http_parse_request(
             if (c == ' ') {
                 frag->state = HttpFragStateVersion;
                 ecs_strbuf_appendch(&frag->buf, '\0');
+                http_header_buf_reset(frag);
             } else {
                 if (c == '?' || c == '=' || c == '&') {
                     ecs_strbuf_appendch(&frag->buf, '\0');
@@ -22367,8 +24697,13 @@ bool http_parse_request(
             break;
         case HttpFragStateVersion:
             if (c == '\r') {
+                /* HTTP/1.0 connections are closed unless keep-alive is set */
+                http_header_buf_append(frag, '\0');
+                frag->close = http_header_buf_eq(frag, "HTTP/1.0");
                 frag->state = HttpFragStateCR;
-            } /* version is not stored */
+            } else { /* version is not stored */
+                http_header_buf_append(frag, c);
+            }
             break;
         case HttpFragStateHeaderStart:
             if (http_header_writable(frag)) {
@@ -22383,8 +24718,10 @@ bool http_parse_request(
             if (c == ':') {
                 frag->state = HttpFragStateHeaderValueStart;
                 http_header_buf_append(frag, '\0');
-                frag->parse_content_length = !ecs_os_strcmp(
-                    frag->header_buf, "Content-Length");
+                frag->parse_content_length = http_header_buf_eq(
+                    frag, "Content-Length");
+                frag->parse_connection = http_header_buf_eq(
+                    frag, "Connection");
 
                 if (http_header_writable(frag)) {
                     ecs_strbuf_appendch(&frag->buf, '\0');
@@ -22420,6 +24757,15 @@ bool http_parse_request(
                     }
                     frag->parse_content_length = false;
                 }
+                if (frag->parse_connection) {
+                    http_header_buf_append(frag, '\0');
+                    if (http_header_buf_eq(frag, "close")) {
+                        frag->close = true;
+                    } else if (http_header_buf_eq(frag, "keep-alive")) {
+                        frag->close = false;
+                    }
+                    frag->parse_connection = false;
+                }
                 if (http_header_writable(frag)) {
                     int32_t cur = ecs_strbuf_written(&frag->buf);
                     if (frag->header_offsets[frag->header_count] < cur &&
@@ -22431,7 +24777,7 @@ bool http_parse_request(
                 }
                 frag->state = HttpFragStateCR;
             } else {
-                if (frag->parse_content_length) {
+                if (frag->parse_content_length || frag->parse_connection) {
                     http_header_buf_append(frag, c);
                 }
                 if (http_header_writable(frag)) {
@@ -22480,6 +24826,10 @@ bool http_parse_request(
         }
     }
 
+    if (parsed_len) {
+        *parsed_len = i;
+    }
+
     if (frag->state == HttpFragStateDone) {
         return true;
     } else {
@@ -22487,6 +24837,7 @@ bool http_parse_request(
     }
 }
 
+#ifndef ECS_HTTP_EPOLL
 static
 ecs_http_send_request_t* http_send_queue_post(
     ecs_http_server_t *srv)
@@ -22586,6 +24937,7 @@ void* http_server_send_queue(void* arg) {
     }
     return NULL;
 }
+#endif
 
 static
 void http_append_send_headers(
@@ -22595,7 +24947,8 @@ void http_append_send_headers(
     const char* content_type,  
     ecs_strbuf_t *extra_headers,
     ecs_size_t content_len,
-    bool preflight)
+    bool preflight,
+    bool keep_alive)
 {
     ecs_strbuf_appendlit(hdrs, "HTTP/1.1 ");
     ecs_strbuf_appendint(hdrs, code);
@@ -22615,6 +24968,12 @@ void http_append_send_headers(
         ecs_strbuf_appendlit(hdrs, "\r\n");
     }
 
+    if (keep_alive) {
+        ecs_strbuf_appendlit(hdrs, "Connection: keep-alive\r\n");
+    } else {
+        ecs_strbuf_appendlit(hdrs, "Connection: close\r\n");
+    }
+
     ecs_strbuf_appendlit(hdrs, "Access-Control-Allow-Origin: *\r\n");
     if (preflight) {
         ecs_strbuf_appendlit(hdrs, "Access-Control-Allow-Private-Network: true\r\n");
@@ -22627,12 +24986,66 @@ void http_append_send_headers(
     ecs_strbuf_appendlit(hdrs, "\r\n");
 }
 
+#ifdef ECS_HTTP_EPOLL
+/* Wake up event loop, for example when replies are ready to be sent */
+static
+void http_wake(
+    ecs_http_server_t *srv)
+{
+    uint64_t one = 1;
+    if (write(srv->wake_fd, &one, sizeof(one)) != sizeof(one)) {
+        ecs_dbg("http: failed to wake server thread: %s", 
+            ecs_os_strerror(errno));
+    }
+}
+
+/* Create message for reply. The message is written by the event loop of the
+ * server thread, which owns the connection socket. */
+static
+void http_send_request_init(
+    ecs_http_send_request_t *req,
+    ecs_http_connection_impl_t* conn, 
+    ecs_http_reply_t* reply,
+    bool preflight)
+{
+    ecs_strbuf_t hdrs = ECS_STRBUF_INIT;
+    int32_t content_length = reply->body.length;
+    char *content = ecs_strbuf_get(&reply->body);
+
+    http_append_send_headers(&hdrs, reply->code, reply->status, 
+        reply->content_type, &reply->headers, content_length, preflight,
+        conn->keep_alive);
+    req->sock = HTTP_SOCKET_INVALID;
+    req->conn_id = conn->pub.id;
+    req->header_length = ecs_strbuf_written(&hdrs);
+    req->headers = ecs_strbuf_get(&hdrs);
+    req->content = content;
+    req->content_length = content ? content_length : 0;
+
+    /* Take ownership of values */
+    reply->body.content = NULL;
+}
+#endif
+
 static
 void http_send_reply(
     ecs_http_connection_impl_t* conn, 
     ecs_http_reply_t* reply,
     bool preflight) 
 {
+#ifdef ECS_HTTP_EPOLL
+    /* Hand reply to the server thread. The lock is only held while the reply
+     * is added to the queue. */
+    ecs_http_server_t *srv = conn->pub.server;
+    ecs_http_send_request_t req;
+    http_send_request_init(&req, conn, reply, preflight);
+
+    ecs_os_mutex_lock(srv->lock);
+    ecs_vec_append_t(NULL, &srv->send_ready, ecs_http_send_request_t)[0] = req;
+    ecs_os_mutex_unlock(srv->lock);
+
+    http_wake(srv);
+#else
     ecs_strbuf_t hdrs = ECS_STRBUF_INIT;
     int32_t content_length = reply->body.length;
     char *content = ecs_strbuf_get(&reply->body);
@@ -22650,7 +25063,8 @@ void http_send_reply(
     }
 
     http_append_send_headers(&hdrs, reply->code, reply->status, 
-        reply->content_type, &reply->headers, content_length, preflight);
+        reply->content_type, &reply->headers, content_length, preflight,
+        false);
     ecs_size_t headers_length = ecs_strbuf_written(&hdrs);
     char *headers = ecs_strbuf_get(&hdrs);
 
@@ -22677,8 +25091,10 @@ void http_send_reply(
     /* Take ownership of values */
     reply->body.content = NULL;
     conn->sock = HTTP_SOCKET_INVALID;
+#endif
 }
 
+#ifndef ECS_HTTP_EPOLL
 static
 void http_recv_connection(
     ecs_http_server_t *srv,
@@ -22703,7 +25119,7 @@ void http_recv_connection(
                 goto done;
             }
 
-            if (http_parse_request(&frag, recv_buf, bytes_read)) {
+            if (http_parse_request(&frag, recv_buf, bytes_read, NULL)) {
                 if (frag.method == EcsHttpOptions) {
                     ecs_http_reply_t reply;
                     reply.body = ECS_STRBUF_INIT;
@@ -22753,6 +25169,7 @@ done:
     ecs_os_free(recv_buf);
     ecs_strbuf_reset(&frag.buf);
 }
+#endif
 
 typedef struct {
     ecs_http_connection_impl_t *conn;
@@ -22769,15 +25186,26 @@ http_conn_res_t http_init_connection(
     http_sock_set_timeout(sock_conn, 100);
     http_sock_keep_alive(sock_conn);
     http_sock_nonblock(sock_conn, true);
+#ifdef ECS_HTTP_EPOLL
+    http_sock_nodelay(sock_conn);
+#endif
 
-    /* Create new connection */
+    /* Create new connection. With epoll connections are only accessed by the
+     * server thread, otherwise they are also purged by the main thread. */
+#ifndef ECS_HTTP_EPOLL
     ecs_os_mutex_lock(srv->lock);
+#endif
     ecs_http_connection_impl_t *conn = flecs_sparse_add_t(
         &srv->connections, ecs_http_connection_impl_t);
+    ecs_os_zeromem(conn); /* Element can be recycled */
     uint64_t conn_id = conn->pub.id = flecs_sparse_last_id(&srv->connections);
     conn->pub.server = srv;
     conn->sock = sock_conn;
+#ifdef ECS_HTTP_EPOLL
+    conn->last_active = ecs_os_now();
+#else
     ecs_os_mutex_unlock(srv->lock);
+#endif
 
     char *remote_host = conn->pub.host;
     char *remote_port = conn->pub.port;
@@ -22798,6 +25226,457 @@ http_conn_res_t http_init_connection(
     return (http_conn_res_t){ .conn = conn, .id = conn_id };
 }
 
+#ifdef ECS_HTTP_EPOLL
+
+/* Epoll data of the listen socket and wake eventfd. Connections use their id,
+ * which is never 0 or UINT64_MAX. */
+#define ECS_HTTP_EPOLL_LISTEN (0)
+#define ECS_HTTP_EPOLL_WAKE (UINT64_MAX)
+
+/* Write as much of the reply as the socket accepts. Returns true if the reply
+ * was sent completely. If the socket buffer is full, the rest of the reply is
+ * written when the socket becomes writable. */
+static
+bool http_conn_send(
+    ecs_http_connection_impl_t *conn)
+{
+    int32_t total = conn->send_header_length + conn->send_content_length;
+    while (conn->send_offset < total) {
+        struct iovec iov[2];
+        int iov_count = 0;
+        int32_t offset = conn->send_offset;
+        if (offset < conn->send_header_length) {
+            iov[iov_count].iov_base = &conn->send_headers[offset];
+            iov[iov_count].iov_len = flecs_itosize(
+                conn->send_header_length - offset);
+            iov_count ++;
+            offset = 0;
+        } else {
+            offset -= conn->send_header_length;
+        }
+        if (conn->send_content_length) {
+            iov[iov_count].iov_base = &conn->send_content[offset];
+            iov[iov_count].iov_len = flecs_itosize(
+                conn->send_content_length - offset);
+            iov_count ++;
+        }
+
+        /* Use sendmsg instead of writev so a closed connection doesn't raise
+         * SIGPIPE */
+        struct msghdr msg;
+        ecs_os_zeromem(&msg);
+        msg.msg_iov = iov;
+        msg.msg_iovlen = flecs_itosize(iov_count);
+
+        ssize_t written = sendmsg(conn->sock, &msg, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return false; /* Wait for EPOLLOUT */
+            }
+
+            ecs_err("http: failed to send reply to '%s:%s': %s",
+                conn->pub.host, conn->pub.port, ecs_os_strerror(errno));
+            ecs_os_linc(&ecs_http_send_error_count);
+            http_connection_free(conn);
+            return false;
+        }
+
+        conn->send_offset += flecs_itoi32(written);
+        conn->last_active = ecs_os_now();
+    }
+
+    ecs_os_linc(&ecs_http_send_ok_count);
+    return true;
+}
+
+/* Start sending a reply on the connection */
+static
+void http_conn_send_reply(
+    ecs_http_connection_impl_t *conn,
+    ecs_http_send_request_t *req)
+{
+    conn->send_headers = req->headers;
+    conn->send_header_length = req->header_length;
+    conn->send_content = req->content;
+    conn->send_content_length = req->content_length;
+    conn->send_offset = 0;
+    conn->state = HttpConnStateSend;
+}
+
+/* Reset connection after a reply was sent so it can receive the next request.
+ * Returns false if the connection was closed. */
+static
+bool http_conn_keep_alive(
+    ecs_http_connection_impl_t *conn)
+{
+    if (!conn->keep_alive) {
+        http_connection_free(conn);
+        return false;
+    }
+
+    ecs_os_free(conn->send_headers);
+    ecs_os_free(conn->send_content);
+    conn->send_headers = NULL;
+    conn->send_content = NULL;
+    conn->send_header_length = 0;
+    conn->send_content_length = 0;
+    conn->send_offset = 0;
+    conn->frag.state = HttpFragStateBegin;
+    conn->state = HttpConnStateRecv;
+    conn->last_active = ecs_os_now();
+    return true;
+}
+
+/* Handle a request that was fully received. Returns false if the connection
+ * was closed. */
+static
+bool http_conn_request(
+    ecs_http_connection_impl_t *conn)
+{
+    ecs_http_server_t *srv = conn->pub.server;
+    ecs_http_fragment_t *frag = &conn->frag;
+    ecs_http_reply_t reply = ECS_HTTP_REPLY_INIT;
+    ecs_http_send_request_t send;
+    ecs_http_request_impl_t req;
+
+    if (frag->invalid) {
+        ecs_os_linc(&ecs_http_request_invalid_count);
+        http_connection_free(conn);
+        return false;
+    }
+
+    conn->keep_alive = !frag->close;
+
+    if (frag->method == EcsHttpOptions) {
+        ecs_strbuf_reset(&frag->buf);
+        reply.code = 200;
+        reply.content_type = NULL;
+        http_send_request_init(&send, conn, &reply, true);
+        http_conn_send_reply(conn, &send);
+        ecs_os_linc(&ecs_http_request_preflight_count);
+        return true;
+    }
+
+    if (!http_decode_request(&req, frag)) {
+        ecs_os_linc(&ecs_http_request_invalid_count);
+        http_connection_free(conn);
+        return false;
+    }
+
+    /* Only hold the lock while the request is added to the queue, or while the
+     * cached response is copied. */
+    conn->state = HttpConnStateQueued;
+    ecs_os_mutex_lock(srv->lock);
+    ecs_http_request_entry_t *entry = 
+        http_enqueue_request_locked(conn, conn->pub.id, frag, &req);
+    if (entry) {
+        reply.code = entry->code;
+        ecs_strbuf_appendstrn(&reply.body, 
+            entry->content, entry->content_length);
+    }
+    ecs_os_mutex_unlock(srv->lock);
+
+    if (entry) {
+        /* Reply with cached response without waiting for the main thread */
+        http_send_request_init(&send, conn, &reply, false);
+        http_conn_send_reply(conn, &send);
+    }
+
+    return true;
+}
+
+/* Read until a request is complete or the socket has no more data. The request
+ * parser keeps its state in the connection, so requests can be received in
+ * parts. Returns true if a request was received. */
+static
+bool http_conn_recv(
+    ecs_http_connection_impl_t *conn,
+    char *recv_buf)
+{
+    ecs_http_fragment_t *frag = &conn->frag;
+    ecs_size_t parsed;
+
+    /* First parse data of pipelined requests that was received together with
+     * a previous request */
+    if (conn->recv_pending) {
+        bool done = http_parse_request(frag, 
+            &conn->recv_pending[conn->recv_pending_offset], 
+            conn->recv_pending_length - conn->recv_pending_offset, &parsed);
+        conn->recv_pending_offset += parsed;
+        if (conn->recv_pending_offset == conn->recv_pending_length) {
+            ecs_os_free(conn->recv_pending);
+            conn->recv_pending = NULL;
+            conn->recv_pending_offset = 0;
+            conn->recv_pending_length = 0;
+        }
+        if (done) {
+            return true;
+        }
+    }
+
+    for (;;) {
+        ssize_t bytes_read = recv(conn->sock, recv_buf, 
+            ECS_HTTP_SEND_RECV_BUFFER_SIZE, 0);
+        if (bytes_read > 0) {
+            ecs_size_t len = flecs_itoi32(bytes_read);
+            bool done = http_parse_request(frag, recv_buf, len, &parsed);
+            conn->last_active = ecs_os_now();
+
+            if (parsed < len) {
+                /* Keep data of next requests until this request is handled.
+                 * The socket isn't read while a request is being handled, which
+                 * limits how much data a client can pipeline. */
+                ecs_assert(conn->recv_pending == NULL, 
+                    ECS_INTERNAL_ERROR, NULL);
+                conn->recv_pending = ecs_os_memdup(
+                    &recv_buf[parsed], len - parsed);
+                conn->recv_pending_offset = 0;
+                conn->recv_pending_length = len - parsed;
+            }
+
+            if (done) {
+                return true;
+            }
+
+            if (ecs_strbuf_written(&frag->buf) > ECS_HTTP_REQUEST_LEN_MAX) {
+                ecs_warn("http: request exceeded max length (%d)",
+                    ECS_HTTP_REQUEST_LEN_MAX);
+                ecs_os_linc(&ecs_http_request_invalid_count);
+                http_connection_free(conn);
+                return false;
+            }
+        } else if (bytes_read == 0) {
+            ecs_dbg_2("http: connection closed by '%s:%s'", 
+                conn->pub.host, conn->pub.port);
+            http_connection_free(conn);
+            return false;
+        } else if (errno == EINTR) {
+            continue;
+        } else {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                ecs_dbg("recv failed: %s (sock = %d)", 
+                    ecs_os_strerror(errno), conn->sock);
+                http_connection_free(conn);
+            }
+            return false;
+        }
+    }
+}
+
+/* Run connection until it has to wait for the socket or for the main thread.
+ * Requests on a connection are handled one at a time, so replies to pipelined
+ * requests are sent in the order in which requests were received. */
+static
+void http_conn_process(
+    ecs_http_connection_impl_t *conn,
+    char *recv_buf)
+{
+    for (;;) {
+        if (conn->state == HttpConnStateRecv) {
+            if (!http_conn_recv(conn, recv_buf)) {
+                return;
+            }
+            if (!http_conn_request(conn)) {
+                return;
+            }
+        } else if (conn->state == HttpConnStateSend) {
+            if (!http_conn_send(conn)) {
+                return;
+            }
+            if (!http_conn_keep_alive(conn)) {
+                return;
+            }
+        } else {
+            return; /* Request is handled by main thread */
+        }
+    }
+}
+
+static
+void http_conn_event(
+    ecs_http_server_t *srv,
+    uint64_t conn_id,
+    char *recv_buf)
+{
+    ecs_http_connection_impl_t *conn = flecs_sparse_try_t(
+        &srv->connections, ecs_http_connection_impl_t, conn_id);
+    if (conn) {
+        http_conn_process(conn, recv_buf);
+    }
+}
+
+/* Send replies of requests that were handled by the main thread. The queue is
+ * swapped with a vector owned by the server thread, so the lock is not held
+ * while replies are sent. */
+static
+void http_send_ready(
+    ecs_http_server_t *srv,
+    ecs_vec_t *replies,
+    char *recv_buf)
+{
+    uint64_t value;
+    if (read(srv->wake_fd, &value, sizeof(value)) != sizeof(value)) {
+        /* Nothing to read, can happen when woken up multiple times */
+    }
+
+    ecs_os_mutex_lock(srv->lock);
+    ecs_vec_t queue = srv->send_ready;
+    srv->send_ready = *replies;
+    *replies = queue;
+    ecs_os_mutex_unlock(srv->lock);
+
+    int32_t i, count = ecs_vec_count(replies);
+    ecs_http_send_request_t *reqs = ecs_vec_first_t(
+        replies, ecs_http_send_request_t);
+    for (i = 0; i < count; i ++) {
+        ecs_http_send_request_t *req = &reqs[i];
+        ecs_http_connection_impl_t *conn = flecs_sparse_try_t(
+            &srv->connections, ecs_http_connection_impl_t, req->conn_id);
+        if (conn && conn->state == HttpConnStateQueued) {
+            http_conn_send_reply(conn, req);
+            http_conn_process(conn, recv_buf);
+        } else {
+            ecs_os_free(req->headers);
+            ecs_os_free(req->content);
+        }
+    }
+    ecs_vec_clear(replies);
+}
+
+/* Close connections that haven't received or sent data for a while. This
+ * includes kept alive connections without new requests and clients that don't
+ * finish sending a request or don't read a reply. */
+static
+void http_purge_idle_connections(
+    ecs_http_server_t *srv)
+{
+    uint64_t now = ecs_os_now();
+    uint64_t timeout = (uint64_t)(ECS_HTTP_CONNECTION_IDLE_TIMEOUT * 1e9);
+
+    int32_t i, count = flecs_sparse_count(&srv->connections);
+    for (i = count - 1; i >= 1; i --) {
+        ecs_http_connection_impl_t *conn = flecs_sparse_get_dense_t(
+            &srv->connections, ecs_http_connection_impl_t, i);
+        if (conn->state == HttpConnStateQueued) {
+            continue; /* Request is handled by main thread */
+        }
+
+        if ((now - conn->last_active) > timeout) {
+            ecs_dbg_2("http: closing idle connection '%s:%s' (sock = %d)", 
+                conn->pub.host, conn->pub.port, conn->sock);
+            http_connection_free(conn);
+        }
+    }
+}
+
+static
+void http_accept_ready(
+    ecs_http_server_t *srv)
+{
+    while (srv->should_run) {
+        struct sockaddr_storage remote_addr;
+        ecs_size_t remote_addr_len = ECS_SIZEOF(remote_addr);
+        ecs_http_socket_t sock_conn = http_accept(srv->sock, 
+            (struct sockaddr*)&remote_addr, &remote_addr_len);
+        if (!http_socket_is_valid(sock_conn)) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK && srv->should_run) {
+                ecs_dbg("http: connection attempt failed: %s", 
+                    ecs_os_strerror(errno));
+            }
+            return;
+        }
+
+        http_conn_res_t conn = http_init_connection(srv, sock_conn, 
+            &remote_addr, remote_addr_len);
+
+        /* Edge triggered, socket is read & written until it would block */
+        struct epoll_event ev;
+        ecs_os_zeromem(&ev);
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.u64 = conn.id;
+        if (epoll_ctl(srv->epoll_fd, EPOLL_CTL_ADD, sock_conn, &ev)) {
+            ecs_err("http: failed to add connection to event loop: %s",
+                ecs_os_strerror(errno));
+            http_connection_free(conn.conn);
+        }
+    }
+}
+
+/* Event loop of server thread. All sockets are non-blocking, so a slow client
+ * can't stall other connections. Connections are owned by the server thread,
+ * the lock is only used to exchange requests and replies with the main 
+ * thread. */
+static
+void http_event_loop(
+    ecs_http_server_t *srv)
+{
+    struct epoll_event ev;
+    ecs_os_zeromem(&ev);
+    ev.events = EPOLLIN;
+    ev.data.u64 = ECS_HTTP_EPOLL_LISTEN;
+    http_sock_nonblock(srv->sock, true);
+    if (epoll_ctl(srv->epoll_fd, EPOLL_CTL_ADD, srv->sock, &ev)) {
+        ecs_err("http: failed to add socket to event loop: %s",
+            ecs_os_strerror(errno));
+        return;
+    }
+
+    ev.data.u64 = ECS_HTTP_EPOLL_WAKE;
+    if (epoll_ctl(srv->epoll_fd, EPOLL_CTL_ADD, srv->wake_fd, &ev)) {
+        ecs_err("http: failed to add eventfd to event loop: %s",
+            ecs_os_strerror(errno));
+        return;
+    }
+
+    struct epoll_event *events = ecs_os_malloc_n(
+        struct epoll_event, ECS_HTTP_EPOLL_EVENT_MAX);
+    char *recv_buf = ecs_os_malloc(ECS_HTTP_SEND_RECV_BUFFER_SIZE);
+    uint64_t purge_time = ecs_os_now();
+    ecs_vec_t replies;
+    ecs_vec_init_t(NULL, &replies, ecs_http_send_request_t, 0);
+
+    while (srv->should_run) {
+        int i, count = epoll_wait(srv->epoll_fd, events, 
+            ECS_HTTP_EPOLL_EVENT_MAX, ECS_HTTP_EPOLL_TIMEOUT);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ecs_err("http: epoll_wait failed: %s", ecs_os_strerror(errno));
+            break;
+        }
+
+        for (i = 0; i < count; i ++) {
+            uint64_t data = events[i].data.u64;
+            if (data == ECS_HTTP_EPOLL_LISTEN) {
+                http_accept_ready(srv);
+            } else if (data == ECS_HTTP_EPOLL_WAKE) {
+                http_send_ready(srv, &replies, recv_buf);
+            } else {
+                http_conn_event(srv, data, recv_buf);
+            }
+        }
+
+        uint64_t now = ecs_os_now();
+        if ((now - purge_time) > (ECS_HTTP_EPOLL_TIMEOUT * 1000 * 1000ull)) {
+            http_purge_idle_connections(srv);
+            purge_time = now;
+        }
+    }
+
+    ecs_vec_fini_t(NULL, &replies, ecs_http_send_request_t);
+    ecs_os_free(recv_buf);
+    ecs_os_free(events);
+}
+
+#endif
+
 static
 int http_accept_connections(
     ecs_http_server_t* srv, 
@@ -22898,6 +25777,11 @@ int http_accept_connections(
     }
     ecs_os_mutex_unlock(srv->lock);
 
+#ifdef ECS_HTTP_EPOLL
+    if (http_socket_is_valid(srv->sock)) {
+        http_event_loop(srv);
+    }
+#else
     struct sockaddr_storage remote_addr;
     ecs_size_t remote_addr_len = 0;
 
@@ -22917,6 +25801,7 @@ int http_accept_connections(
         http_conn_res_t conn = http_init_connection(srv, sock_conn, &remote_addr, remote_addr_len);
         http_recv_connection(srv, conn.conn, conn.id, sock_conn);
     }
+#endif
 
 done:
     ecs_os_mutex_lock(srv->lock);
@@ -23013,7 +25898,14 @@ void http_handle_request(
         }
 
         if (req->pub.method == EcsHttpGet) {
+#ifdef ECS_HTTP_EPOLL
+            /* Cache is shared with the server thread */
+            ecs_os_mutex_lock(srv->lock);
             http_insert_request_entry(srv, req, &reply);
+            ecs_os_mutex_unlock(srv->lock);
+#else
+            http_insert_request_entry(srv, req, &reply);
+#endif
         }
 
         http_send_reply(conn, &reply, false);
@@ -23023,8 +25915,13 @@ void http_handle_request(
     }
 
     http_reply_fini(&reply);
+#ifdef ECS_HTTP_EPOLL
+    /* Request was taken from the queue by http_dequeue_requests */
+    ecs_os_free(req->res);
+#else
     http_request_fini(req);
     http_connection_free(conn);
+#endif
 }
 
 static
@@ -23058,6 +25955,45 @@ void http_purge_request_cache(
     }
 }
 
+#ifdef ECS_HTTP_EPOLL
+static
+int32_t http_dequeue_requests(
+    ecs_http_server_t *srv,
+    double delta_time)
+{
+    (void)delta_time; /* Idle connections are closed by the server thread */
+
+    /* Take requests from the queue, so that the lock isn't held while request
+     * handlers run. This lets the server thread receive new requests and send
+     * replies, including cached replies, while a slow handler runs. */
+    ecs_vec_t requests;
+    ecs_vec_init_t(NULL, &requests, ecs_http_request_impl_t, 0);
+
+    ecs_os_mutex_lock(srv->lock);
+    int32_t i, request_count = flecs_sparse_count(&srv->requests);
+    for (i = request_count - 1; i >= 1; i --) {
+        ecs_http_request_impl_t *req = flecs_sparse_get_dense_t(
+            &srv->requests, ecs_http_request_impl_t, i);
+        ecs_vec_append_t(NULL, &requests, ecs_http_request_impl_t)[0] = *req;
+        flecs_sparse_remove_t(&srv->requests, ecs_http_request_impl_t, 
+            req->pub.id);
+    }
+    ecs_os_mutex_unlock(srv->lock);
+
+    ecs_http_request_impl_t *reqs = ecs_vec_first_t(
+        &requests, ecs_http_request_impl_t);
+    for (i = 0; i < request_count - 1; i ++) {
+        http_handle_request(srv, &reqs[i]);
+    }
+    ecs_vec_fini_t(NULL, &requests, ecs_http_request_impl_t);
+
+    ecs_os_mutex_lock(srv->lock);
+    http_purge_request_cache(srv, false);
+    ecs_os_mutex_unlock(srv->lock);
+
+    return request_count - 1;
+}
+#else
 static
 int32_t http_dequeue_requests(
     ecs_http_server_t *srv,
@@ -23091,10 +26027,12 @@ int32_t http_dequeue_requests(
     }
 
     http_purge_request_cache(srv, false);
+
     ecs_os_mutex_unlock(srv->lock);
 
     return request_count - 1;
 }
+#endif
 
 const char* ecs_http_get_header(
     const ecs_http_request_t* req,
@@ -23196,6 +26134,24 @@ int ecs_http_server_start(
     ecs_check(ecs_os_has_threading(), ECS_UNSUPPORTED,
         "missing OS API implementation");
 
+#ifdef ECS_HTTP_EPOLL
+    srv->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (srv->epoll_fd == -1) {
+        ecs_err("http: failed to create epoll instance: %s", 
+            ecs_os_strerror(errno));
+        goto error;
+    }
+
+    srv->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (srv->wake_fd == -1) {
+        ecs_err("http: failed to create eventfd: %s", ecs_os_strerror(errno));
+        close(srv->epoll_fd);
+        goto error;
+    }
+
+    ecs_vec_init_t(NULL, &srv->send_ready, ecs_http_send_request_t, 0);
+#endif
+
     srv->should_run = true;
 
     ecs_dbg("http: starting server thread");
@@ -23205,10 +26161,12 @@ int ecs_http_server_start(
         goto error;
     }
 
+#ifndef ECS_HTTP_EPOLL
     srv->send_queue.thread = ecs_os_thread_new(http_server_send_queue, srv);
     if (!srv->send_queue.thread) {
         goto error;
     }
+#endif
 
     return 0;
 error:
@@ -23234,10 +26192,28 @@ void ecs_http_server_stop(
     if (http_socket_is_valid(srv->sock)) {
         http_close(&srv->sock);
     }
+#ifdef ECS_HTTP_EPOLL
+    http_wake(srv);
+#endif
     ecs_os_mutex_unlock(srv->lock);
 
     ecs_os_thread_join(srv->thread);
+#ifdef ECS_HTTP_EPOLL
+    close(srv->epoll_fd);
+    close(srv->wake_fd);
+
+    /* Free replies that weren't sent */
+    int32_t r, reply_count = ecs_vec_count(&srv->send_ready);
+    ecs_http_send_request_t *replies = ecs_vec_first_t(
+        &srv->send_ready, ecs_http_send_request_t);
+    for (r = 0; r < reply_count; r ++) {
+        ecs_os_free(replies[r].headers);
+        ecs_os_free(replies[r].content);
+    }
+    ecs_vec_fini_t(NULL, &srv->send_ready, ecs_http_send_request_t);
+#else
     ecs_os_thread_join(srv->send_queue.thread);
+#endif
     ecs_trace("http: server threads shut down");
 
     /* Cleanup all outstanding requests */
@@ -23314,7 +26290,7 @@ int ecs_http_server_http_request(
     }
 
     ecs_http_fragment_t frag = {0};
-    if (!http_parse_request(&frag, req, len)) {
+    if (!http_parse_request(&frag, req, len, NULL)) {
         ecs_strbuf_reset(&frag.buf);
         reply_out->code = 400;
         return -1;
@@ -25375,6 +28351,994 @@ error:
 
 #endif
 
+/**
+ * @file addons/shard.c
+ * @brief Shard addon.
+ */
+
+
+#ifdef FLECS_SHARD
+
+/* Default number of entity ids reserved for each shard */
+#define FLECS_SHARD_IDS_DEFAULT (1u << 24)
+
+typedef enum ecs_shard_msg_kind_t {
+    EcsShardMsgSet,
+    EcsShardMsgAdd,
+    EcsShardMsgRemove,
+    EcsShardMsgDelete,
+    EcsShardMsgMigrate
+} ecs_shard_msg_kind_t;
+
+/* Message posted to the mailbox of a shard. Set messages store the component
+ * value directly after the message header. */
+typedef struct ecs_shard_msg_t {
+    struct ecs_shard_msg_t *next;
+    ecs_entity_t entity;
+    ecs_id_t id;
+    ecs_size_t size;
+    int32_t shard;               /* Destination shard for migrate messages */
+    ecs_shard_msg_kind_t kind;
+} ecs_shard_msg_t;
+
+typedef struct ecs_shard_t {
+    ecs_world_t *world;
+    ecs_shard_msg_t *mailbox;    /* Lock-free stack of posted messages */
+    ecs_os_thread_t task;
+    ecs_ftime_t delta_time;
+    bool result;
+} ecs_shard_t;
+
+struct ecs_shard_group_t {
+    ecs_shard_t *shards;
+    int32_t count;
+    uint64_t id_base;            /* First entity id owned by shard 0 */
+    uint64_t ids_per_shard;
+    ecs_map_t forward;           /* Entities migrated in last sync */
+    ecs_map_t forward_prev;      /* Entities migrated in sync before last */
+};
+
+#define FLECS_SHARD_MSG_VALUE(msg)\
+    ECS_OFFSET(msg, ECS_SIZEOF(ecs_shard_msg_t))
+
+ecs_shard_group_t* ecs_shard_group_init(
+    const ecs_shard_group_desc_t *desc)
+{
+    ecs_check(desc != NULL, ECS_INVALID_PARAMETER, NULL);
+    ecs_check(desc->shard_count > 0, ECS_INVALID_PARAMETER, NULL);
+
+    /* Keep the OS API initialized for the lifetime of the group, so that the
+     * mailboxes can be used before the first and after the last world. */
+    ecs_os_init();
+    if (!ecs_os_api.acas_) {
+        ecs_err("shard group requires the acas OS API function");
+        ecs_os_fini();
+        return NULL;
+    }
+
+    ecs_shard_group_t *result = ecs_os_calloc_t(ecs_shard_group_t);
+    int32_t i, count = result->count = desc->shard_count;
+    result->shards = ecs_os_calloc_n(ecs_shard_t, count);
+    result->ids_per_shard = desc->ids_per_shard;
+    if (!result->ids_per_shard) {
+        result->ids_per_shard = FLECS_SHARD_IDS_DEFAULT;
+    }
+
+    ecs_map_init(&result->forward, NULL);
+    ecs_map_init(&result->forward_prev, NULL);
+
+    /* Entities created by the init callback exist in all shards, so shard
+     * ranges start after the highest id used by any of the shards. */
+    uint64_t max_id = 0;
+    for (i = 0; i < count; i ++) {
+        ecs_world_t *world = result->shards[i].world = ecs_init();
+        if (desc->init) {
+            desc->init(world, i, desc->ctx);
+        }
+
+        uint64_t world_max_id = ecs_get_max_id(world);
+        if (i && world_max_id != max_id) {
+            ecs_warn("shard %d has a different number of entities than "
+                "shard 0, ids of shared entities may not match", i);
+        }
+        if (world_max_id > max_id) {
+            max_id = world_max_id;
+        }
+    }
+
+    result->id_base = max_id + 1;
+
+    uint64_t id_end = result->id_base + result->ids_per_shard * 
+        flecs_uto(uint64_t, count);
+    if (id_end > UINT32_MAX) {
+        ecs_err("shard id ranges exceed 32 bit entity id space");
+        ecs_shard_group_fini(result);
+        return NULL;
+    }
+
+    for (i = 0; i < count; i ++) {
+        uint64_t start = result->id_base + result->ids_per_shard * 
+            flecs_uto(uint64_t, i);
+        ecs_set_entity_range(result->shards[i].world, 
+            start, start + result->ids_per_shard - 1);
+    }
+
+    return result;
+error:
+    return NULL;
+}
+
+static
+ecs_shard_msg_t* flecs_shard_mailbox_take(
+    ecs_shard_t *shard)
+{
+    /* Take ownership of all posted messages by replacing the head with NULL */
+    void *head = NULL;
+    for (;;) {
+        void *prev = ecs_os_acas((void**)&shard->mailbox, head, NULL);
+        if (prev == head) {
+            break;
+        }
+        head = prev;
+    }
+
+    /* Messages are pushed on a stack, reverse to get posting order */
+    ecs_shard_msg_t *msg = head, *result = NULL;
+    while (msg) {
+        ecs_shard_msg_t *next = msg->next;
+        msg->next = result;
+        result = msg;
+        msg = next;
+    }
+
+    return result;
+}
+
+void ecs_shard_group_fini(
+    ecs_shard_group_t *group)
+{
+    ecs_check(group != NULL, ECS_INVALID_PARAMETER, NULL);
+
+    int32_t i;
+    for (i = 0; i < group->count; i ++) {
+        ecs_shard_t *shard = &group->shards[i];
+        ecs_shard_msg_t *msg = flecs_shard_mailbox_take(shard);
+        while (msg) {
+            ecs_shard_msg_t *next = msg->next;
+            ecs_os_free(msg);
+            msg = next;
+        }
+
+        if (shard->world) {
+            ecs_fini(shard->world);
+        }
+    }
+
+    ecs_map_fini(&group->forward);
+    ecs_map_fini(&group->forward_prev);
+    ecs_os_free(group->shards);
+    ecs_os_free(group);
+    ecs_os_fini();
+error:
+    return;
+}
+
+int32_t ecs_shard_count(
+    const ecs_shard_group_t *group)
+{
+    ecs_check(group != NULL, ECS_INVALID_PARAMETER, NULL);
+    return group->count;
+error:
+    return 0;
+}
+
+ecs_world_t* ecs_shard_world(
+    const ecs_shard_group_t *group,
+    int32_t shard)
+{
+    ecs_check(group != NULL, ECS_INVALID_PARAMETER, NULL);
+    ecs_check(shard >= 0 && shard < group->count, ECS_OUT_OF_RANGE, NULL);
+    return group->shards[shard].world;
+error:
+    return NULL;
+}
+
+int32_t ecs_shard_of(
+    const ecs_shard_group_t *group,
+    ecs_entity_t entity)
+{
+    ecs_check(group != NULL, ECS_INVALID_PARAMETER, NULL);
+    uint64_t index = (uint32_t)entity;
+    if (index < group->id_base) {
+        return -1;
+    }
+
+    uint64_t shard = (index - group->id_base) / group->ids_per_shard;
+    if (shard >= flecs_uto(uint64_t, group->count)) {
+        return -1;
+    }
+
+    return flecs_uto(int32_t, shard);
+error:
+    return -1;
+}
+
+static
+void flecs_shard_post(
+    ecs_shard_group_t *group,
+    ecs_shard_msg_t *msg)
+{
+    int32_t shard = ecs_shard_of(group, msg->entity);
+    if (shard == -1) {
+        ecs_os_free(msg);
+        ecs_throw(ECS_INVALID_PARAMETER, "entity is not owned by a shard");
+    }
+
+    /* Push message on the mailbox stack. The previous head is obtained from
+     * the compare and swap, so the mailbox is never read non-atomically. */
+    void **head = (void**)&group->shards[shard].mailbox;
+    ecs_shard_msg_t *next = NULL;
+    for (;;) {
+        msg->next = next;
+        void *prev = ecs_os_acas(head, next, msg);
+        if (prev == next) {
+            break;
+        }
+        next = prev;
+    }
+error:
+    return;
+}
+
+static
+ecs_shard_msg_t* flecs_shard_msg_new(
+    ecs_shard_msg_kind_t kind,
+    ecs_entity_t entity,
+    ecs_id_t id,
+    ecs_size_t size)
+{
+    ecs_shard_msg_t *msg = ecs_os_malloc(ECS_SIZEOF(ecs_shard_msg_t) + size);
+    msg->next = NULL;
+    msg->entity = entity;
+    msg->id = id;
+    msg->size = size;
+    msg->shard = -1;
+    msg->kind = kind;
+    return msg;
+}
+
+void ecs_shard_set_id(
+    ecs_shard_group_t *group,
+    ecs_entity_t entity,
+    ecs_id_t id,
+    size_t size,
+    const void *ptr)
+{
+    ecs_check(group != NULL, ECS_INVALID_PARAMETER, NULL);
+    ecs_check(ptr != NULL, ECS_INVALID_PARAMETER, NULL);
+    ecs_check(size != 0, ECS_INVALID_PARAMETER, NULL);
+    ecs_size_t msg_size = flecs_uto(ecs_size_t, size);
+    ecs_shard_msg_t *msg = flecs_shard_msg_new(
+        EcsShardMsgSet, entity, id, msg_size);
+    ecs_os_memcpy(FLECS_SHARD_MSG_VALUE(msg), ptr, msg_size);
+    flecs_shard_post(group, msg);
+error:
+    return;
+}
+
+void ecs_shard_add_id(
+    ecs_shard_group_t *group,
+    ecs_entity_t entity,
+    ecs_id_t id)
+{
+    ecs_check(group != NULL, ECS_INVALID_PARAMETER, NULL);
+    flecs_shard_post(group, flecs_shard_msg_new(EcsShardMsgAdd, entity, id, 0));
+error:
+    return;
+}
+
+void ecs_shard_remove_id(
+    ecs_shard_group_t *group,
+    ecs_entity_t entity,
+    ecs_id_t id)
+{
+    ecs_check(group != NULL, ECS_INVALID_PARAMETER, NULL);
+    flecs_shard_post(group, 
+        flecs_shard_msg_new(EcsShardMsgRemove, entity, id, 0));
+error:
+    return;
+}
+
+void ecs_shard_delete(
+    ecs_shard_group_t *group,
+    ecs_entity_t entity)
+{
+    ecs_check(group != NULL, ECS_INVALID_PARAMETER, NULL);
+    flecs_shard_post(group, 
+        flecs_shard_msg_new(EcsShardMsgDelete, entity, 0, 0));
+error:
+    return;
+}
+
+void ecs_shard_migrate(
+    ecs_shard_group_t *group,
+    ecs_entity_t entity,
+    int32_t shard)
+{
+    ecs_check(group != NULL, ECS_INVALID_PARAMETER, NULL);
+    ecs_check(shard >= 0 && shard < group->count, ECS_OUT_OF_RANGE, NULL);
+    ecs_shard_msg_t *msg = flecs_shard_msg_new(
+        EcsShardMsgMigrate, entity, 0, 0);
+    msg->shard = shard;
+    flecs_shard_post(group, msg);
+error:
+    return;
+}
+
+static
+ecs_entity_t flecs_shard_forward_once(
+    const ecs_shard_group_t *group,
+    ecs_entity_t entity)
+{
+    ecs_map_val_t *ptr = ecs_map_get(&group->forward, entity);
+    if (!ptr) {
+        ptr = ecs_map_get(&group->forward_prev, entity);
+    }
+    if (ptr) {
+        return ptr[0];
+    }
+    return 0;
+}
+
+ecs_entity_t ecs_shard_forward(
+    const ecs_shard_group_t *group,
+    ecs_entity_t entity)
+{
+    ecs_check(group != NULL, ECS_INVALID_PARAMETER, NULL);
+
+    /* An entity can migrate once per sync, so it is forwarded at most once
+     * for each of the two syncs that are tracked. */
+    int32_t i;
+    for (i = 0; i < 2; i ++) {
+        ecs_entity_t next = flecs_shard_forward_once(group, entity);
+        if (!next) {
+            break;
+        }
+        entity = next;
+    }
+
+    return entity;
+error:
+    return 0;
+}
+
+/* Returns whether an id of the source shard means the same in destination */
+static
+bool flecs_shard_id_migrates(
+    const ecs_world_t *src,
+    const ecs_world_t *dst,
+    ecs_id_t id)
+{
+    if (ECS_IS_PAIR(id)) {
+        ecs_entity_t first = ECS_PAIR_FIRST(id);
+        if (first == ecs_id(EcsIdentifier)) {
+            /* Names are migrated separately to prevent conflicts */
+            return false;
+        }
+        if (!ecs_get_alive(dst, first)) {
+            return false;
+        }
+        if (!ecs_get_alive(dst, ECS_PAIR_SECOND(id))) {
+            return false;
+        }
+    } else if (!ecs_get_alive(dst, id & ECS_COMPONENT_MASK)) {
+        return false;
+    }
+
+    const ecs_type_info_t *src_ti = ecs_get_type_info(src, id);
+    const ecs_type_info_t *dst_ti = ecs_get_type_info(dst, id);
+    if (!src_ti || !dst_ti) {
+        return src_ti == dst_ti;
+    }
+
+    return src_ti->size == dst_ti->size;
+}
+
+/* Migrate entity and its children. Children are migrated before the entity is
+ * deleted from the source shard, as deleting it also deletes its children. */
+static
+ecs_entity_t flecs_shard_migrate_entity(
+    ecs_shard_group_t *group,
+    ecs_world_t *src,
+    ecs_world_t *dst,
+    ecs_entity_t entity,
+    ecs_entity_t parent)
+{
+    ecs_entity_t result = ecs_new(dst);
+
+    /* Commands for the same entity are merged when the queue is flushed, so 
+     * the new entity is moved to its final table at once. */
+    ecs_defer_begin(dst);
+
+    if (parent) {
+        ecs_add_pair(dst, result, EcsChildOf, parent);
+    }
+
+    const ecs_type_t *type = ecs_get_type(src, entity);
+    int32_t i, count = type ? type->count : 0;
+    for (i = 0; i < count; i ++) {
+        ecs_id_t id = type->array[i];
+        if (!flecs_shard_id_migrates(src, dst, id)) {
+            continue;
+        }
+
+        const ecs_type_info_t *ti = ecs_get_type_info(src, id);
+        if (!ti) {
+            ecs_add_id(dst, result, id);
+            continue;
+        }
+
+        /* The source entity is deleted afterwards, so values can be moved */
+        void *src_ptr = ECS_CONST_CAST(void*, ecs_get_id(src, entity, id));
+        void *dst_ptr = ecs_ensure_modified_id(dst, result, id);
+        ecs_move_t move = ti->hooks.move;
+        if (move) {
+            move(dst_ptr, src_ptr, 1, ti);
+        } else {
+            ecs_os_memcpy(dst_ptr, src_ptr, ti->size);
+        }
+    }
+
+    ecs_defer_end(dst);
+
+    const char *name = ecs_get_name(src, entity);
+    if (name) {
+        if (!ecs_lookup_child(dst, ecs_get_parent(dst, result), name)) {
+            ecs_set_name(dst, result, name);
+        }
+    }
+
+    /* Collect children first, as migrating a child deletes it from the source
+     * shard, which modifies the tables that are iterated. */
+    ecs_vec_t children;
+    ecs_vec_init_t(NULL, &children, ecs_entity_t, 0);
+    ecs_iter_t it = ecs_children(src, entity);
+    while (ecs_children_next(&it)) {
+        for (i = 0; i < it.count; i ++) {
+            ecs_vec_append_t(NULL, &children, ecs_entity_t)[0] = 
+                it.entities[i];
+        }
+    }
+
+    ecs_entity_t *child_ids = ecs_vec_first_t(&children, ecs_entity_t);
+    count = ecs_vec_count(&children);
+    for (i = 0; i < count; i ++) {
+        ecs_entity_t child = flecs_shard_migrate_entity(
+            group, src, dst, child_ids[i], result);
+        ecs_map_insert(&group->forward, child_ids[i], child);
+    }
+
+    ecs_vec_fini_t(NULL, &children, ecs_entity_t);
+
+    ecs_delete(src, entity);
+
+    return result;
+}
+
+static
+void flecs_shard_apply(
+    ecs_shard_group_t *group,
+    ecs_shard_msg_t *msg)
+{
+    ecs_entity_t entity = msg->entity;
+    int32_t shard = ecs_shard_of(group, entity);
+    ecs_world_t *world = group->shards[shard].world;
+
+    if (!ecs_is_alive(world, entity)) {
+        /* Forward messages for entities that migrated to another shard */
+        entity = ecs_shard_forward(group, entity);
+        if (entity == msg->entity) {
+            return;
+        }
+
+        shard = ecs_shard_of(group, entity);
+        world = group->shards[shard].world;
+        if (!ecs_is_alive(world, entity)) {
+            return;
+        }
+    }
+
+    switch(msg->kind) {
+    case EcsShardMsgSet:
+        ecs_set_id(world, entity, msg->id, 
+            flecs_ito(size_t, msg->size), FLECS_SHARD_MSG_VALUE(msg));
+        break;
+    case EcsShardMsgAdd:
+        ecs_add_id(world, entity, msg->id);
+        break;
+    case EcsShardMsgRemove:
+        ecs_remove_id(world, entity, msg->id);
+        break;
+    case EcsShardMsgDelete:
+        ecs_delete(world, entity);
+        break;
+    case EcsShardMsgMigrate:
+        if (msg->shard != shard) {
+            ecs_entity_t result = flecs_shard_migrate_entity(group,
+                world, group->shards[msg->shard].world, entity, 0);
+            ecs_map_insert(&group->forward, entity, result);
+        }
+        break;
+    }
+}
+
+int32_t ecs_shard_group_sync(
+    ecs_shard_group_t *group)
+{
+    ecs_check(group != NULL, ECS_INVALID_PARAMETER, NULL);
+
+    /* Forwarding information is kept for two syncs, so that ids obtained by
+     * a system in the frame before a migration can still be used. */
+    ecs_map_fini(&group->forward_prev);
+    group->forward_prev = group->forward;
+    ecs_map_init(&group->forward, NULL);
+
+    int32_t i, applied = 0;
+    for (i = 0; i < group->count; i ++) {
+        ecs_shard_msg_t *msg = flecs_shard_mailbox_take(&group->shards[i]);
+        while (msg) {
+            ecs_shard_msg_t *next = msg->next;
+            flecs_shard_apply(group, msg);
+            ecs_os_free(msg);
+            applied ++;
+            msg = next;
+        }
+    }
+
+    return applied;
+error:
+    return 0;
+}
+
+static
+void* flecs_shard_progress(
+    void *arg)
+{
+    ecs_shard_t *shard = arg;
+    shard->result = ecs_progress(shard->world, shard->delta_time);
+    return NULL;
+}
+
+bool ecs_shard_group_progress(
+    ecs_shard_group_t *group,
+    ecs_ftime_t delta_time)
+{
+    ecs_check(group != NULL, ECS_INVALID_PARAMETER, NULL);
+    ecs_check(group->count == 1 || ecs_os_has_task_support(),
+        ECS_MISSING_OS_API, "task");
+
+    int32_t i, count = group->count;
+    for (i = 0; i < count; i ++) {
+        group->shards[i].delta_time = delta_time;
+    }
+
+    for (i = 1; i < count; i ++) {
+        ecs_shard_t *shard = &group->shards[i];
+        shard->task = ecs_os_task_new(flecs_shard_progress, shard);
+    }
+
+    flecs_shard_progress(&group->shards[0]);
+
+    bool result = true;
+    for (i = 0; i < count; i ++) {
+        ecs_shard_t *shard = &group->shards[i];
+        if (i) {
+            ecs_os_task_join(shard->task);
+        }
+        result &= shard->result;
+    }
+
+    ecs_shard_group_sync(group);
+
+    return result;
+error:
+    return false;
+}
+
+#endif
+
+/**
+ * @file addons/recorder.c
+ * @brief Event recorder addon.
+ * 
+ * Events are stored in a byte ring buffer with a single producer and a single
+ * consumer. Each record consists of an ecs_recorded_event_t header, followed by
+ * the payload. Records don't wrap around the end of the buffer: if a record
+ * doesn't fit in the remaining space, the producer skips to the start of the
+ * buffer, and marks the skipped space with a header for event 0 if it is large
+ * enough to store a header.
+ * 
+ * The producer publishes its write position (head) after recording the events
+ * of an observer invocation, and the consumer publishes its read position 
+ * (tail) after draining. Positions increase monotonically and are stored in
+ * pointer-sized variables, so that they can be accessed with ecs_os_acas.
+ */
+
+
+#ifdef FLECS_RECORDER
+
+/* Default size of the ring buffer in bytes */
+#define FLECS_RECORDER_CAPACITY_DEFAULT (4 * 1024 * 1024)
+
+#define FLECS_RECORDER_HDR_SIZE ECS_SIZEOF(ecs_recorded_event_t)
+
+struct ecs_recorder_t {
+    ecs_world_t *world;
+    char *buffer;
+    uintptr_t capacity;          /* Power of two */
+    void *head;                  /* Published write position */
+    void *tail;                  /* Published read position */
+    uintptr_t write;             /* Producer write position */
+    uintptr_t tail_cached;       /* Last tail read by producer */
+    uintptr_t read;              /* Consumer read position */
+    int64_t dropped;
+    ecs_entity_t observers[2];
+    bool payload;
+};
+
+static
+uintptr_t flecs_recorder_load(
+    void **ptr)
+{
+    /* Compare-and-swap that doesn't change the value is an atomic load */
+    return (uintptr_t)ecs_os_acas(ptr, NULL, NULL);
+}
+
+static
+void flecs_recorder_store(
+    void **ptr,
+    uintptr_t prev,
+    uintptr_t value)
+{
+    /* Each position is only written by one thread, so this always succeeds */
+    void *result = ecs_os_acas(ptr, (void*)prev, (void*)value);
+    ecs_assert(result == (void*)prev, ECS_INTERNAL_ERROR, NULL);
+    (void)result;
+}
+
+static
+bool flecs_recorder_write(
+    ecs_recorder_t *r,
+    const ecs_recorded_event_t *hdr,
+    const void *payload)
+{
+    uintptr_t capacity = r->capacity;
+    uintptr_t size = flecs_ito(uintptr_t, ECS_ALIGN(
+        FLECS_RECORDER_HDR_SIZE + flecs_ito(size_t, hdr->size), 8));
+    uintptr_t pos = r->write;
+    uintptr_t offset = pos & (capacity - 1);
+    uintptr_t remaining = capacity - offset;
+    uintptr_t needed = size;
+    if (remaining < size) {
+        needed += remaining;
+    }
+
+    if ((pos + needed - r->tail_cached) > capacity) {
+        r->tail_cached = flecs_recorder_load(&r->tail);
+        if ((pos + needed - r->tail_cached) > capacity) {
+            return false;
+        }
+    }
+
+    if (remaining < size) {
+        if (remaining >= (uintptr_t)FLECS_RECORDER_HDR_SIZE) {
+            ecs_recorded_event_t *skip = ECS_OFFSET(r->buffer, offset);
+            skip->event = 0;
+        }
+        pos += remaining;
+        offset = 0;
+    }
+
+    ecs_recorded_event_t *dst = ECS_OFFSET(r->buffer, offset);
+    *dst = *hdr;
+    if (hdr->size) {
+        ecs_os_memcpy(ECS_OFFSET(dst, FLECS_RECORDER_HDR_SIZE), 
+            payload, hdr->size);
+    }
+
+    r->write = pos + size;
+    return true;
+}
+
+static
+void flecs_recorder_observer(
+    ecs_iter_t *it)
+{
+    ecs_recorder_t *r = it->ctx;
+    if (it->sources[0]) {
+        /* Don't record events for inherited components */
+        return;
+    }
+
+    ecs_table_t *table = it->table;
+    const ecs_table_record_t *tr = it->trs[0];
+    ecs_component_record_t *cdr = NULL;
+    const ecs_type_info_t *ti = NULL;
+    void *column = NULL;
+    if (r->payload && tr && it->sizes[0]) {
+        cdr = (ecs_component_record_t*)tr->hdr.cache;
+        ti = cdr->type_info;
+        if (ti->hooks.copy || ti->hooks.dtor) {
+            ti = NULL;
+        } else if (!(cdr->flags & EcsIdIsSparse)) {
+            ecs_assert(tr->column != -1, ECS_INTERNAL_ERROR, NULL);
+            column = table->data.columns[tr->column].data;
+        }
+    }
+
+    ecs_recorded_event_t hdr = {
+        .event = it->event,
+        .id = it->event_id,
+        .table = table->id,
+        .table_version = flecs_get_table_version(it->real_world, table->id),
+        .size = ti ? ti->size : 0
+    };
+
+    /* Head is published at the end of each invocation */
+    uintptr_t head = r->write;
+
+    int32_t i, count = it->count;
+    for (i = 0; i < count; i ++) {
+        const void *payload = NULL;
+        hdr.entity = it->entities[i];
+        if (column) {
+            payload = ECS_ELEM(column, ti->size, it->offset + i);
+        } else if (ti) {
+            payload = flecs_sparse_get_any(cdr->sparse, ti->size, hdr.entity);
+        }
+
+        if (!flecs_recorder_write(r, &hdr, payload)) {
+            r->dropped += count - i;
+            break;
+        }
+    }
+
+    if (r->write != head) {
+        flecs_recorder_store(&r->head, head, r->write);
+    }
+}
+
+ecs_recorder_t* ecs_recorder_init(
+    ecs_world_t *world,
+    const ecs_recorder_desc_t *desc)
+{
+    flecs_poly_assert(world, ecs_world_t);
+    ecs_check(desc != NULL, ECS_INVALID_PARAMETER, NULL);
+    ecs_check(desc->capacity >= 0, ECS_INVALID_PARAMETER, NULL);
+
+    if (!ecs_os_api.acas_) {
+        ecs_err("recorder requires the acas OS API function");
+        return NULL;
+    }
+
+    ecs_recorder_t *r = ecs_os_calloc_t(ecs_recorder_t);
+    r->world = world;
+    r->payload = desc->payload;
+    r->capacity = FLECS_RECORDER_CAPACITY_DEFAULT;
+    if (desc->capacity) {
+        r->capacity = flecs_ito(uintptr_t, 
+            flecs_next_pow_of_2(desc->capacity));
+    }
+    r->buffer = ecs_os_malloc(flecs_uto(ecs_size_t, r->capacity));
+
+    ecs_observer_desc_t o_desc = {
+        .query.flags = EcsQueryMatchPrefab|EcsQueryMatchDisabled,
+        .callback = flecs_recorder_observer,
+        .ctx = r
+    };
+
+    if (desc->events[0]) {
+        ecs_os_memcpy_n(o_desc.events, desc->events, 
+            ecs_entity_t, FLECS_EVENT_DESC_MAX);
+    } else {
+        o_desc.events[0] = EcsOnAdd;
+        o_desc.events[1] = EcsOnRemove;
+        o_desc.events[2] = EcsOnSet;
+    }
+
+    /* One observer for regular ids and one for pairs */
+    o_desc.query.terms[0] = (ecs_term_t){ 
+        .id = EcsWildcard, .src.id = EcsSelf };
+    r->observers[0] = ecs_observer_init(world, &o_desc);
+    o_desc.query.terms[0] = (ecs_term_t){ 
+        .id = ecs_pair(EcsWildcard, EcsWildcard), .src.id = EcsSelf };
+    r->observers[1] = ecs_observer_init(world, &o_desc);
+
+    if (!r->observers[0] || !r->observers[1]) {
+        ecs_recorder_fini(r);
+        return NULL;
+    }
+
+    return r;
+error:
+    return NULL;
+}
+
+void ecs_recorder_fini(
+    ecs_recorder_t *r)
+{
+    ecs_check(r != NULL, ECS_INVALID_PARAMETER, NULL);
+    if (r->observers[0]) {
+        ecs_delete(r->world, r->observers[0]);
+    }
+    if (r->observers[1]) {
+        ecs_delete(r->world, r->observers[1]);
+    }
+    ecs_os_free(r->buffer);
+    ecs_os_free(r);
+error:
+    return;
+}
+
+int32_t ecs_recorder_drain(
+    ecs_recorder_t *r,
+    ecs_recorder_action_t action,
+    void *ctx)
+{
+    ecs_check(r != NULL, ECS_INVALID_PARAMETER, NULL);
+    ecs_check(action != NULL, ECS_INVALID_PARAMETER, NULL);
+
+    uintptr_t capacity = r->capacity;
+    uintptr_t start = r->read, pos = start;
+    uintptr_t head = flecs_recorder_load(&r->head);
+    int32_t count = 0;
+
+    while (pos != head) {
+        uintptr_t offset = pos & (capacity - 1);
+        uintptr_t remaining = capacity - offset;
+        if (remaining < (uintptr_t)FLECS_RECORDER_HDR_SIZE) {
+            pos += remaining;
+            continue;
+        }
+
+        const ecs_recorded_event_t *hdr = ECS_OFFSET(r->buffer, offset);
+        if (!hdr->event) {
+            /* Record didn't fit at end of buffer */
+            pos += remaining;
+            continue;
+        }
+
+        const void *payload = NULL;
+        if (hdr->size) {
+            payload = ECS_OFFSET(hdr, FLECS_RECORDER_HDR_SIZE);
+        }
+
+        action(hdr, payload, ctx);
+        pos += flecs_ito(uintptr_t, ECS_ALIGN(
+            FLECS_RECORDER_HDR_SIZE + flecs_ito(size_t, hdr->size), 8));
+        count ++;
+    }
+
+    if (pos != start) {
+        r->read = pos;
+        flecs_recorder_store(&r->tail, start, pos);
+    }
+
+    return count;
+error:
+    return 0;
+}
+
+static
+bool flecs_recorder_ensure(
+    ecs_world_t *world,
+    ecs_entity_t e)
+{
+    ecs_entity_t alive = ecs_get_alive(world, (uint32_t)e);
+    if (alive == e) {
+        return true;
+    }
+
+    if (alive) {
+        /* Deleting an entity doesn't emit an event, so if the recorded entity
+         * has a newer generation the alive entity was deleted in the recorded
+         * world. */
+        if (ECS_GENERATION(e) <= ECS_GENERATION(alive)) {
+            return false;
+        }
+        ecs_delete(world, alive);
+    }
+
+    ecs_make_alive(world, e);
+    return true;
+}
+
+void ecs_recorder_replay_event(
+    ecs_world_t *world,
+    const ecs_recorded_event_t *ev,
+    const void *payload)
+{
+    ecs_check(world != NULL, ECS_INVALID_PARAMETER, NULL);
+    ecs_check(ev != NULL, ECS_INVALID_PARAMETER, NULL);
+
+    ecs_entity_t e = ev->entity, event = ev->event;
+    ecs_id_t id = ev->id;
+    if (!e) {
+        return;
+    }
+
+    if (event == EcsOnRemove) {
+        if (ecs_is_alive(world, e)) {
+            ecs_remove_id(world, e, id);
+        }
+        return;
+    }
+
+    if (!flecs_recorder_ensure(world, e)) {
+        return;
+    }
+
+    if (ECS_IS_PAIR(id)) {
+        /* Pair elements don't store the generation, so any alive version of
+         * the relationship and target is valid. */
+        ecs_entity_t first = ECS_PAIR_FIRST(id), second = ECS_PAIR_SECOND(id);
+        if (!ecs_get_alive(world, first)) {
+            ecs_make_alive(world, first);
+        }
+        if (!ecs_get_alive(world, second)) {
+            ecs_make_alive(world, second);
+        }
+    } else if (!flecs_recorder_ensure(world, id)) {
+        return;
+    }
+
+    if (event == EcsOnAdd) {
+        ecs_add_id(world, e, id);
+    } else if (event == EcsOnSet) {
+        const ecs_type_info_t *ti = ecs_get_type_info(world, id);
+        if (payload && ti && ti->size == ev->size) {
+            ecs_set_id(world, e, id, flecs_itosize(ev->size), payload);
+        } else {
+            ecs_add_id(world, e, id);
+        }
+    } else {
+        ecs_enqueue(world, &(ecs_event_desc_t){
+            .event = event,
+            .ids = &(ecs_type_t){ .array = &id, .count = 1 },
+            .entity = e
+        });
+    }
+error:
+    return;
+}
+
+static
+void flecs_recorder_replay_action(
+    const ecs_recorded_event_t *event,
+    const void *payload,
+    void *ctx)
+{
+    ecs_recorder_replay_event(ctx, event, payload);
+}
+
+int32_t ecs_recorder_replay(
+    ecs_recorder_t *r,
+    ecs_world_t *world)
+{
+    return ecs_recorder_drain(r, flecs_recorder_replay_action, world);
+}
+
+int64_t ecs_recorder_dropped(
+    const ecs_recorder_t *r)
+{
+    ecs_check(r != NULL, ECS_INVALID_PARAMETER, NULL);
+    return r->dropped;
+error:
+    return 0;
+}
+
+#endif
+
 /**
  * @file addons/rest.c
  * @brief Rest addon.
@@ -25401,6 +29365,25 @@ typedef struct ecs_pipeline_op_t {
     bool immediate;           /* Whether systems are staged or not */
 } ecs_pipeline_op_t;
 
+/** Counters used by workers to distribute tasks of a multi threaded system. */
+typedef struct ecs_worker_tasks_t {
+    int32_t claimed;            /* Number of tasks claimed by workers */
+    int32_t finished;           /* Number of workers that finished the system */
+} ecs_worker_tasks_t;
+
+/** Range in deps vector with the systems a system has to wait for. */
+typedef struct ecs_system_deps_t {
+    int32_t offset;
+    int32_t count;
+} ecs_system_deps_t;
+
+/** Low priority system considered by frame budget scheduler. */
+typedef struct ecs_system_sched_t {
+    ecs_system_t *sys;
+    int32_t index;              /* Index in systems vector */
+    int32_t overdue;            /* Frames system is past its decimation */
+} ecs_system_sched_t;
+
 struct ecs_pipeline_state_t {
     ecs_query_t *query;         /* Pipeline query */
     ecs_vec_t ops;              /* Pipeline schedule */
@@ -25412,6 +29395,19 @@ struct ecs_pipeline_state_t {
     int32_t rebuild_count;      /* Number of pipeline rebuilds */
     ecs_iter_t *iters;          /* Iterator for worker(s) */
     int32_t iter_count;
+    ecs_vec_t tasks;            /* vector<ecs_worker_tasks_t>, one per system */
+    ecs_vec_t deps;             /* vector<int32_t>, indices in systems vector */
+    ecs_vec_t system_deps;      /* vector<ecs_system_deps_t>, one per system */
+
+    /* Systems that run on workers while the main thread merges */
+    ecs_vec_t overlap_ids;      /* vector<ecs_id_t>, components being merged */
+    ecs_vec_t overlap_systems;  /* vector<ecs_system_t*>, systems in next op */
+    bool overlapping;           /* Workers run overlap_systems */
+
+    /* Frame budget scheduler */
+    ecs_vec_t schedule;         /* vector<ecs_system_sched_t> */
+    ecs_time_t frame_start;     /* Time at which schedule was computed */
+    bool decimated;             /* Are systems skipped or delta time adjusted */
 
     /* Members for continuing pipeline iteration after pipeline rebuild */
     ecs_pipeline_op_t *cur_op;  /* Current pipeline op */
@@ -25446,6 +29442,13 @@ int32_t flecs_run_pipeline_ops(
     int32_t stage_count,
     ecs_ftime_t delta_time);
 
+void flecs_run_pipeline_overlap(
+    ecs_world_t* world,
+    ecs_stage_t* stage,
+    int32_t stage_index,
+    int32_t stage_count,
+    ecs_ftime_t delta_time);
+
 ////////////////////////////////////////////////////////////////////////////////
 //// Worker API
 ////////////////////////////////////////////////////////////////////////////////
@@ -25467,6 +29470,19 @@ void flecs_signal_workers(
 void flecs_wait_for_sync(
     ecs_world_t *world);
 
+void flecs_workers_merge(
+    ecs_world_t *world);
+
+void flecs_sync_wait(
+    ecs_world_t *world,
+    ecs_os_cond_t cond,
+    int32_t *value,
+    int32_t expect);
+
+void flecs_sync_wake(
+    ecs_world_t *world,
+    ecs_os_cond_t cond);
+
 #endif
 
 
@@ -26310,6 +30326,8 @@ void flecs_world_stats_to_json(
     ECS_COUNTER_APPEND(reply, stats, commands.discard_count, "Commands for already deleted entities");
     ECS_COUNTER_APPEND(reply, stats, commands.batched_entity_count, "Entities with batched commands");
     ECS_COUNTER_APPEND(reply, stats, commands.batched_count, "Number of commands batched");
+    ECS_COUNTER_APPEND(reply, stats, commands.folded_count, "Add/remove commands folded before merging");
+    ECS_COUNTER_APPEND(reply, stats, commands.queue_bytes, "Command queue memory merged, in bytes");
 
     ECS_COUNTER_APPEND(reply, stats, frame.merge_count, "Number of merges (sync points)");
     ECS_COUNTER_APPEND(reply, stats, frame.pipeline_build_count, "Pipeline rebuilds (happen when systems become active/enabled)");
@@ -26380,6 +30398,13 @@ void flecs_system_stats_to_json(
     }
 
     ECS_COUNTER_APPEND_T(reply, stats, time_spent, stats->query.t, "");
+#ifdef FLECS_PERF_COUNTERS
+    ECS_COUNTER_APPEND_T(reply, stats, cycles, stats->query.t, "");
+    ECS_COUNTER_APPEND_T(reply, stats, instructions, stats->query.t, "");
+    ECS_COUNTER_APPEND_T(reply, stats, l1d_misses, stats->query.t, "");
+    ECS_COUNTER_APPEND_T(reply, stats, llc_misses, stats->query.t, "");
+    ECS_COUNTER_APPEND_T(reply, stats, branch_misses, stats->query.t, "");
+#endif
     ecs_strbuf_list_pop(reply, "}");
 }
 
@@ -26762,7 +30787,8 @@ static
 void flecs_rest_cmd_to_json(
     ecs_world_t *world,
     ecs_strbuf_t *buf,
-    ecs_cmd_t *cmd)
+    ecs_cmd_t *cmd,
+    ecs_entity_t system)
 {
     ecs_strbuf_list_push(buf, "{", ",");
 
@@ -26778,9 +30804,9 @@ void flecs_rest_cmd_to_json(
             ecs_os_free(idstr);
     }
 
-    if (cmd->system) {
+    if (system) {
         ecs_strbuf_list_appendlit(buf, "\"system\":\"");
-            char *sysstr = ecs_get_path(world, cmd->system);
+            char *sysstr = ecs_get_path(world, system);
             ecs_strbuf_appendstr(buf, sysstr);
             ecs_strbuf_appendlit(buf, "\"");
             ecs_os_free(sysstr); 
@@ -26817,7 +30843,7 @@ void flecs_rest_cmd_to_json(
 static
 void flecs_rest_on_commands(
     const ecs_stage_t *stage,
-    const ecs_vec_t *commands,
+    const ecs_commands_t *commands,
     void *ctx)
 {
     ecs_world_t *world = stage->world;
@@ -26829,15 +30855,18 @@ void flecs_rest_on_commands(
         ecs_rest_cmd_sync_capture_t *sync = ecs_vec_append_t(
             NULL, &capture->syncs, ecs_rest_cmd_sync_capture_t);
 
-        int32_t i, count = ecs_vec_count(commands);
-        ecs_cmd_t *cmds = ecs_vec_first(commands);
+        int32_t i, count = ecs_vec_count(&commands->queue);
+        ecs_cmd_t *cmds = ecs_vec_first(&commands->queue);
+        int32_t system_count = ecs_vec_count(&commands->systems);
+        ecs_entity_t *systems = ecs_vec_first(&commands->systems);
         sync->buf = ECS_STRBUF_INIT;
         ecs_strbuf_list_push(&sync->buf, "{", ",");
         ecs_strbuf_list_appendlit(&sync->buf, "\"commands\":");
             ecs_strbuf_list_push(&sync->buf, "[", ",");
             for (i = 0; i < count; i ++) {
                 ecs_strbuf_list_next(&sync->buf);
-                flecs_rest_cmd_to_json(world, &sync->buf, &cmds[i]);
+                flecs_rest_cmd_to_json(world, &sync->buf, &cmds[i], 
+                    i < system_count ? systems[i] : 0);
             }
             ecs_strbuf_list_pop(&sync->buf, "]");
 
@@ -27204,6 +31233,19 @@ void FlecsRestImport(
 
 extern ecs_mixins_t ecs_system_t_mixins;
 
+/* State of a system that runs on a fiber */
+typedef struct ecs_system_fiber_t {
+    ecs_iter_t it;                  /* System iterator, must be first member */
+    ecs_iter_fini_action_t it_fini; /* Fini action of query iterator */
+    ecs_os_fiber_t fiber;           /* Fiber (0 if system isn't suspended) */
+    ecs_time_t resumed;             /* Time at which fiber was resumed */
+#ifdef FLECS_PERF_TRACE
+    ecs_perf_trace_fiber_t trace;   /* Trace scopes that are open on fiber */
+#endif
+    bool it_active;                 /* Is iterator not yet finalized */
+    bool done;                      /* Has system callback returned */
+} ecs_system_fiber_t;
+
 /* Invoked when system becomes active / inactive */
 void ecs_system_activate(
     ecs_world_t *world,
@@ -27220,7 +31262,8 @@ ecs_entity_t flecs_run_intern(
     int32_t stage_current,
     int32_t stage_count,
     ecs_ftime_t delta_time,
-    void *param);
+    void *param,
+    int32_t *tasks_claimed);
 
 #endif
 
@@ -35148,6 +39191,392 @@ int flecs_query_finalize_terms(
     return 0;
 }
 
+#ifdef FLECS_QUERY_DSL
+/* Normalize expression so that expressions that only differ in insignificant
+ * whitespace map to the same cache entry. Newlines are preserved, as they
+ * separate terms, as is anything between quotes. */
+static
+ecs_size_t flecs_query_expr_normalize(
+    const char *expr,
+    char *out)
+{
+    const char *ptr = expr;
+    char *dst = out;
+    bool in_str = false;
+    char ch;
+
+    while ((ch = *ptr) == ' ' || ch == '\t' || ch == '\n') {
+        ptr ++;
+    }
+
+    for (; (ch = *ptr); ptr ++) {
+        if (ch == '"' && (ptr == expr || ptr[-1] != '\\')) {
+            in_str = !in_str;
+        }
+
+        if (!in_str && (ch == ' ' || ch == '\t')) {
+            if (dst != out && dst[-1] == ' ') {
+                continue;
+            }
+            ch = ' ';
+        }
+
+        *dst = ch;
+        dst ++;
+    }
+
+    while (dst != out && 
+        (dst[-1] == ' ' || dst[-1] == '\t' || dst[-1] == '\n')) 
+    {
+        dst --;
+    }
+
+    *dst = '\0';
+    return flecs_ito(ecs_size_t, dst - out);
+}
+
+/* The parser resolves traversal relationships with ecs_lookup, so the result
+ * of parsing an expression depends on the scope and lookup path. */
+typedef struct {
+    const char *expr;
+    ecs_size_t expr_len;
+    ecs_entity_t scope;
+    const ecs_entity_t *lookup_path;
+    int32_t lookup_path_count;
+    uint64_t hash;
+} ecs_query_expr_key_t;
+
+static
+void flecs_query_expr_key_init(
+    const ecs_world_t *world,
+    ecs_query_expr_key_t *key,
+    const char *expr,
+    ecs_size_t expr_len)
+{
+    key->expr = expr;
+    key->expr_len = expr_len;
+    key->scope = ecs_get_scope(world);
+    key->lookup_path = ecs_get_lookup_path(world);
+    key->lookup_path_count = 0;
+    if (key->lookup_path) {
+        while (key->lookup_path[key->lookup_path_count]) {
+            key->lookup_path_count ++;
+        }
+    }
+
+    uint64_t hashes[3] = {
+        flecs_hash(expr, expr_len),
+        key->scope,
+        flecs_hash(key->lookup_path, 
+            key->lookup_path_count * ECS_SIZEOF(ecs_entity_t))
+    };
+
+    key->hash = flecs_hash(hashes, ECS_SIZEOF(hashes));
+}
+
+static
+void flecs_query_expr_rebase_name(
+    ecs_term_ref_t *ref,
+    const char *old_tokens,
+    ecs_size_t tokens_len,
+    char *new_tokens)
+{
+    const char *name = ref->name;
+    if (name && (name >= old_tokens) && (name < &old_tokens[tokens_len])) {
+        ref->name = &new_tokens[name - old_tokens];
+    }
+}
+
+/* Copy terms & token buffer, and point term names to the new buffer. */
+static
+void flecs_query_expr_copy_terms(
+    ecs_term_t *dst_terms,
+    char *dst_tokens,
+    const ecs_term_t *src_terms,
+    const char *src_tokens,
+    int32_t term_count,
+    ecs_size_t tokens_len)
+{
+    if (term_count) {
+        ecs_os_memcpy_n(dst_terms, src_terms, ecs_term_t, term_count);
+    }
+    ecs_os_memcpy(dst_tokens, src_tokens, tokens_len);
+
+    int32_t i;
+    for (i = 0; i < term_count; i ++) {
+        ecs_term_t *term = &dst_terms[i];
+        flecs_query_expr_rebase_name(
+            &term->src, src_tokens, tokens_len, dst_tokens);
+        flecs_query_expr_rebase_name(
+            &term->first, src_tokens, tokens_len, dst_tokens);
+        flecs_query_expr_rebase_name(
+            &term->second, src_tokens, tokens_len, dst_tokens);
+    }
+}
+
+static
+void flecs_query_expr_entry_unlink(
+    ecs_query_expr_cache_t *cache,
+    ecs_query_expr_entry_t *entry)
+{
+    if (entry->prev) {
+        entry->prev->next = entry->next;
+    } else {
+        cache->first = entry->next;
+    }
+
+    if (entry->next) {
+        entry->next->prev = entry->prev;
+    } else {
+        cache->last = entry->prev;
+    }
+
+    entry->prev = NULL;
+    entry->next = NULL;
+}
+
+static
+void flecs_query_expr_entry_push(
+    ecs_query_expr_cache_t *cache,
+    ecs_query_expr_entry_t *entry)
+{
+    entry->next = cache->first;
+    entry->prev = NULL;
+    if (cache->first) {
+        cache->first->prev = entry;
+    } else {
+        cache->last = entry;
+    }
+    cache->first = entry;
+}
+
+static
+void flecs_query_expr_entry_free(
+    ecs_world_t *world,
+    ecs_query_expr_entry_t *entry)
+{
+    flecs_wfree(world, entry->expr_len + 1, entry->expr);
+    flecs_wfree_n(world, ecs_entity_t, entry->lookup_path_count, 
+        entry->lookup_path);
+    flecs_wfree_n(world, ecs_term_t, entry->term_count, entry->terms);
+    flecs_wfree(world, entry->tokens_len, entry->tokens);
+    flecs_wfree_t(world, ecs_query_expr_entry_t, entry);
+}
+
+static
+void flecs_query_expr_entry_remove(
+    ecs_world_t *world,
+    ecs_query_expr_entry_t *entry)
+{
+    ecs_query_expr_cache_t *cache = &world->query_expr_cache;
+    flecs_query_expr_entry_unlink(cache, entry);
+    ecs_map_remove(&cache->index, entry->hash);
+    flecs_query_expr_entry_free(world, entry);
+    cache->count --;
+}
+
+/* The cache is not thread safe, so don't use it while the world may be 
+ * accessed by multiple threads. */
+static
+bool flecs_query_expr_cache_enabled(
+    const ecs_world_t *world)
+{
+    return FLECS_QUERY_EXPR_CACHE_SIZE > 0 && 
+        !(world->flags & EcsWorldReadonly);
+}
+
+static
+ecs_query_expr_entry_t* flecs_query_expr_cache_get(
+    ecs_world_t *world,
+    const ecs_query_expr_key_t *key)
+{
+    ecs_query_expr_cache_t *cache = &world->query_expr_cache;
+    if (!ecs_map_is_init(&cache->index)) {
+        return NULL;
+    }
+
+    ecs_query_expr_entry_t *entry = ecs_map_get_deref(
+        &cache->index, ecs_query_expr_entry_t, key->hash);
+    if (!entry) {
+        return NULL;
+    }
+
+    if (entry->expr_len != key->expr_len || 
+        ecs_os_strcmp(entry->expr, key->expr)) 
+    {
+        return NULL; /* Hash collision */
+    }
+
+    if (entry->scope != key->scope || 
+        entry->lookup_path_count != key->lookup_path_count ||
+        (key->lookup_path_count && ecs_os_memcmp(entry->lookup_path, 
+            key->lookup_path, ECS_SIZEOF(ecs_entity_t) * 
+                key->lookup_path_count)))
+    {
+        return NULL; /* Hash collision */
+    }
+
+    /* Traversal relationships are resolved by the parser. Make sure they're
+     * still valid before reusing the parser output. */
+    int32_t i;
+    for (i = 0; i < entry->term_count; i ++) {
+        ecs_entity_t trav = entry->terms[i].trav;
+        if (trav && !ecs_is_alive(world, trav)) {
+            flecs_query_expr_entry_remove(world, entry);
+            return NULL;
+        }
+    }
+
+    flecs_query_expr_entry_unlink(cache, entry);
+    flecs_query_expr_entry_push(cache, entry);
+
+    return entry;
+}
+
+static
+void flecs_query_expr_cache_insert(
+    ecs_world_t *world,
+    const ecs_query_expr_key_t *key,
+    const ecs_term_t *terms,
+    int32_t term_count,
+    const char *tokens,
+    ecs_size_t tokens_len)
+{
+    ecs_query_expr_cache_t *cache = &world->query_expr_cache;
+    if (!ecs_map_is_init(&cache->index)) {
+        ecs_map_init(&cache->index, &world->allocator);
+    }
+
+    ecs_query_expr_entry_t *entry = ecs_map_get_deref(
+        &cache->index, ecs_query_expr_entry_t, key->hash);
+    if (entry) {
+        /* Hash collision with different expression, replace entry */
+        flecs_query_expr_entry_remove(world, entry);
+    }
+
+    if (cache->count == FLECS_QUERY_EXPR_CACHE_SIZE) {
+        flecs_query_expr_entry_remove(world, cache->last);
+    }
+
+    entry = flecs_walloc_t(world, ecs_query_expr_entry_t);
+    entry->expr = flecs_wdup(world, key->expr_len + 1, key->expr);
+    entry->expr_len = key->expr_len;
+    entry->scope = key->scope;
+    entry->lookup_path = NULL;
+    entry->lookup_path_count = key->lookup_path_count;
+    if (key->lookup_path_count) {
+        entry->lookup_path = flecs_wdup_n(world, ecs_entity_t,
+            key->lookup_path_count, key->lookup_path);
+    }
+    entry->hash = key->hash;
+    entry->term_count = term_count;
+    entry->terms = flecs_walloc_n(world, ecs_term_t, term_count);
+    entry->tokens = flecs_walloc(world, tokens_len);
+    entry->tokens_len = tokens_len;
+    flecs_query_expr_copy_terms(entry->terms, entry->tokens, 
+        terms, tokens, term_count, tokens_len);
+
+    ecs_map_insert_ptr(&cache->index, key->hash, entry);
+    flecs_query_expr_entry_push(cache, entry);
+    cache->count ++;
+}
+
+static
+int flecs_query_parse_expr(
+    ecs_world_t *world,
+    ecs_stage_t *stage,
+    ecs_query_t *q,
+    const ecs_query_desc_t *desc,
+    int32_t *term_count)
+{
+    const char *expr = desc->expr;
+    ecs_query_impl_t *impl = flecs_query_impl(q);
+    /* The "0" expression resets the terms that were set before the
+     * expression, which can't be expressed as terms to append. */
+    bool use_cache = flecs_query_expr_cache_enabled(world) && 
+        ecs_os_strcmp(expr, "0");
+    ecs_query_expr_key_t key = {0};
+    char *key_expr = NULL;
+
+    /* Allocate buffer that's large enough to tokenize the query string */
+    ecs_size_t token_buffer_size = ecs_os_strlen(expr) * 2 + 1;
+
+    if (use_cache) {
+        key_expr = flecs_alloc(&stage->allocator, token_buffer_size);
+        flecs_query_expr_key_init(world, &key, key_expr,
+            flecs_query_expr_normalize(expr, key_expr));
+
+        ecs_query_expr_entry_t *entry = flecs_query_expr_cache_get(
+            world, &key);
+        if (entry) {
+            flecs_free(&stage->allocator, token_buffer_size, key_expr);
+
+            if ((*term_count + entry->term_count) > FLECS_TERM_COUNT_MAX) {
+                ecs_err("max number of terms (%d) reached, increase "
+                    "FLECS_TERM_COUNT_MAX to support more",
+                    FLECS_TERM_COUNT_MAX);
+                return -1;
+            }
+
+            impl->tokens = flecs_alloc(&stage->allocator, entry->tokens_len);
+            impl->tokens_len = flecs_ito(int16_t, entry->tokens_len);
+            flecs_query_expr_copy_terms(&q->terms[*term_count], impl->tokens,
+                entry->terms, entry->tokens, entry->term_count, 
+                entry->tokens_len);
+            *term_count += entry->term_count;
+            return 0;
+        }
+    }
+
+    const char *name = desc->entity ? 
+        ecs_get_name(world, desc->entity) : NULL;
+
+    char *token_buffer = flecs_alloc(&stage->allocator, token_buffer_size);
+    int32_t parsed_offset = *term_count;
+
+    if (flecs_terms_parse(world, name, expr, token_buffer, 
+        &q->terms[*term_count], term_count))
+    {
+        flecs_free(&stage->allocator, token_buffer_size, token_buffer);
+        if (key_expr) {
+            flecs_free(&stage->allocator, token_buffer_size, key_expr);
+        }
+        return -1;
+    }
+
+    if (use_cache) {
+        flecs_query_expr_cache_insert(world, &key, 
+            &q->terms[parsed_offset], *term_count - parsed_offset,
+            token_buffer, token_buffer_size);
+        flecs_free(&stage->allocator, token_buffer_size, key_expr);
+    }
+
+    /* Store on query object so we can free later */
+    impl->tokens = token_buffer;
+    impl->tokens_len = flecs_ito(int16_t, token_buffer_size);
+
+    return 0;
+}
+#endif
+
+void flecs_query_expr_cache_fini(
+    ecs_world_t *world)
+{
+#ifdef FLECS_QUERY_DSL
+    ecs_query_expr_cache_t *cache = &world->query_expr_cache;
+    ecs_query_expr_entry_t *cur, *next;
+    for (cur = cache->first; cur; cur = next) {
+        next = cur->next;
+        flecs_query_expr_entry_free(world, cur);
+    }
+
+    ecs_map_fini(&cache->index);
+    ecs_os_zeromem(cache);
+#else
+    (void)world;
+#endif
+}
+
 static
 int flecs_query_query_populate_terms(
     ecs_world_t *world,
@@ -35173,24 +39602,9 @@ int flecs_query_query_populate_terms(
     const char *expr = desc->expr;
     if (expr && expr[0]) {
     #ifdef FLECS_QUERY_DSL
-        const char *name = desc->entity ? 
-            ecs_get_name(world, desc->entity) : NULL;
-        
-        /* Allocate buffer that's large enough to tokenize the query string */
-        ecs_size_t token_buffer_size = ecs_os_strlen(expr) * 2 + 1;
-        char *token_buffer = flecs_alloc(
-            &flecs_query_impl(q)->stage->allocator, token_buffer_size);
-
-        if (flecs_terms_parse(world, name, expr, token_buffer, &q->terms[term_count], 
-            &term_count))
-        {
-            flecs_free(&stage->allocator, token_buffer_size, token_buffer);
+        if (flecs_query_parse_expr(world, stage, q, desc, &term_count)) {
             goto error;
         }
-
-        /* Store on query object so we can free later */
-        flecs_query_impl(q)->tokens = token_buffer;
-        flecs_query_impl(q)->tokens_len = flecs_ito(int16_t, token_buffer_size);
     #else
         (void)world;
         (void)stage;
@@ -35579,6 +39993,7 @@ void flecs_insert_id_elem(
 
         if (cdr->flags & EcsIdTraversable) {
             flecs_component_elem_insert(widr, cdr, &pair->trav);
+            world->propagate_version ++;
         }
     }
 }
@@ -35862,6 +40277,7 @@ ecs_component_record_t* flecs_component_new(
             /* Flag used to determine if object should be traversed when
              * propagating events or with super/subset queries */
             flecs_record_add_flag(tgt_r, EcsEntityIsTraversable);
+            world->propagate_version ++;
 
             /* Add reference to (*, tgt) component record to entity record */
             tgt_r->cdr = idr_t;
@@ -35937,6 +40353,9 @@ void flecs_component_free(
                 /* If id is not a wildcard, remove it from the wildcard lists */
                 flecs_remove_id_elem(cdr, ecs_pair(rel, EcsWildcard));
                 flecs_remove_id_elem(cdr, ecs_pair(EcsWildcard, tgt));
+                if (cdr->flags & EcsIdTraversable) {
+                    world->propagate_version ++;
+                }
             }
         } else {
             ecs_log_push_2();
@@ -35976,6 +40395,9 @@ void flecs_component_free(
     world->info.component_id_count -= cdr->type_info != NULL;
     world->info.tag_id_count -= cdr->type_info == NULL;
 
+    /* Free observer lists that were cached for emitting events for the id */
+    flecs_observable_fanout_remove(&world->observable, id);
+
     /* Unregister the component record from the world & free resources */
     ecs_table_cache_fini(&cdr->cache);
 
@@ -35983,6 +40405,10 @@ void flecs_component_free(
         flecs_name_index_free(cdr->pair->name_index);
         ecs_vec_fini_t(&world->allocator, &cdr->pair->reachable.ids, 
             ecs_reachable_elem_t);
+        ecs_vec_fini_t(&world->allocator, &cdr->pair->propagate.tables, 
+            ecs_propagate_elem_t);
+        ecs_vec_fini_t(&world->allocator, &cdr->pair->propagate.records, 
+            ecs_component_record_t*);
         flecs_bfree_w_dbg_info(&world->allocators.pair_id_record, 
                 cdr->pair, "ecs_pair_id_record_t");
     }
@@ -37279,6 +41705,11 @@ void flecs_table_init(
     /* Initialize event flags for any record */
     table->flags |= world->idr_any->flags & EcsIdEventMask;
 
+    if (table->flags & EcsTableHasPairs) {
+        /* Table may be reachable through traversable relationships */
+        world->propagate_version ++;
+    }
+
     table->component_map = flecs_wcalloc_n(
         world, int16_t, FLECS_HI_COMPONENT_ID);
 
@@ -37325,6 +41756,10 @@ void flecs_table_records_unregister(
         flecs_component_release(world, (ecs_component_record_t*)cache);
     }
 
+    if (table->flags & EcsTableHasPairs) {
+        world->propagate_version ++;
+    }
+
     flecs_wfree_n(world, ecs_table_record_t, count, table->_->records);
 }
 
@@ -37707,6 +42142,8 @@ void flecs_table_fini(
     }
 
     flecs_wfree_n(world, int32_t, table->column_count + 1, table->dirty_state);
+    flecs_wfree_n(world, uint32_t, table->_->chunk_count * 
+        (table->column_count + 1), table->_->chunk_ticks);
     flecs_wfree_n(world, int16_t, table->column_count + table->type.count, 
         table->column_map);
     flecs_wfree_n(world, int16_t, FLECS_HI_COMPONENT_ID, table->component_map);
@@ -37784,12 +42221,13 @@ void flecs_table_mark_table_dirty(
 void flecs_table_mark_dirty(
     ecs_world_t *world,
     ecs_table_t *table,
+    int32_t row,
     ecs_entity_t component)
 {
     ecs_assert(!table->_->lock, ECS_LOCKED_STORAGE, FLECS_LOCKED_STORAGE_MSG);
     ecs_assert(table != NULL, ECS_INTERNAL_ERROR, NULL);
 
-    if (table->dirty_state) {
+    if (table->dirty_state || table->_->chunk_ticks) {
         int32_t column;
         if (component < FLECS_HI_COMPONENT_ID) {
             column = table->component_map[component];
@@ -37812,10 +42250,105 @@ void flecs_table_mark_dirty(
 
         /* Column is offset by 1, 0 is reserved for entity column. */
 
-        table->dirty_state[column] ++;
+        if (table->dirty_state) {
+            table->dirty_state[column] ++;
+        }
+
+        flecs_table_mark_rows_dirty(world, table, column, row, 1);
+    }
+}
+
+/* Make sure there are enough chunks to track the rows in the table */
+static
+void flecs_table_ensure_chunks(
+    ecs_world_t *world,
+    ecs_table_t *table,
+    int32_t row_count)
+{
+    ecs_table__t *meta = table->_;
+    int32_t chunk_count = ((row_count - 1) >> FLECS_CHANGE_CHUNK_BITS) + 1;
+    if (chunk_count <= meta->chunk_count) {
+        return;
+    }
+
+    int32_t stride = table->column_count + 1;
+    int32_t new_count = meta->chunk_count * 2;
+    if (new_count < chunk_count) {
+        new_count = chunk_count;
+    }
+
+    meta->chunk_ticks = flecs_wrealloc_n(world, uint32_t, 
+        new_count * stride, meta->chunk_count * stride, meta->chunk_ticks);
+
+    /* New chunks don't contain rows yet, any row that's added will mark the
+     * chunk dirty. */
+    ecs_os_memset_n(&meta->chunk_ticks[meta->chunk_count * stride], 0, 
+        uint32_t, flecs_ito(size_t, (new_count - meta->chunk_count) * stride));
+    meta->chunk_count = new_count;
+}
+
+void flecs_table_mark_rows_dirty(
+    ecs_world_t *world,
+    ecs_table_t *table,
+    int32_t index,
+    int32_t row,
+    int32_t count)
+{
+    ecs_table__t *meta = table->_;
+    if (!meta->chunk_ticks || !count) {
+        return;
+    }
+
+    /* Rows can only be added from the thread that owns the table, so chunks 
+     * are only reallocated when called from structural operations. */
+    flecs_table_ensure_chunks(world, table, row + count);
+
+    uint32_t tick = world->change_tick;
+    uint32_t *ticks = meta->chunk_ticks;
+    int32_t stride = table->column_count + 1;
+    int32_t chunk = row >> FLECS_CHANGE_CHUNK_BITS;
+    int32_t last = (row + count - 1) >> FLECS_CHANGE_CHUNK_BITS;
+
+    for (; chunk <= last; chunk ++) {
+        uint32_t *chunk_ticks = &ticks[chunk * stride];
+        if (index == -1) {
+            int32_t i;
+            for (i = 0; i < stride; i ++) {
+                chunk_ticks[i] = tick;
+            }
+        } else {
+            chunk_ticks[index] = tick;
+        }
     }
 }
 
+/* Get (or create) chunk ticks of table. Used for chunk change detection. */
+uint32_t* flecs_table_get_chunk_ticks(
+    ecs_world_t *world,
+    ecs_table_t *table)
+{
+    flecs_poly_assert(world, ecs_world_t);
+    ecs_assert(table != NULL, ECS_INTERNAL_ERROR, NULL);
+    ecs_table__t *meta = table->_;
+    if (!meta->chunk_ticks) {
+        int32_t count = ecs_table_count(table);
+        int32_t stride = table->column_count + 1;
+        int32_t chunk_count = count ? 
+            ((count - 1) >> FLECS_CHANGE_CHUNK_BITS) + 1 : 1;
+        int32_t i;
+
+        meta->chunk_ticks = flecs_walloc_n(world, uint32_t, 
+            chunk_count * stride);
+        meta->chunk_count = chunk_count;
+
+        /* Existing rows are reported as changed the first time */
+        for (i = 0; i < chunk_count * stride; i ++) {
+            meta->chunk_ticks[i] = world->change_tick;
+        }
+    }
+    return meta->chunk_ticks;
+}
+
 /* Get (or create) dirty state of table. Used by queries for change tracking */
 int32_t* flecs_table_get_dirty_state(
     ecs_world_t *world,
@@ -38048,6 +42581,7 @@ int32_t flecs_table_grow_data(
 
     /* If the table is monitored indicate that there has been a change */
     flecs_table_mark_table_dirty(world, table, 0);
+    flecs_table_mark_rows_dirty(world, table, -1, count, to_add);
 
     /* Return index of first added entity */
     return count;
@@ -38101,6 +42635,7 @@ int32_t flecs_table_append(
  
     /* If the table is monitored indicate that there has been a change */
     flecs_table_mark_table_dirty(world, table, 0);
+    flecs_table_mark_rows_dirty(world, table, -1, count, 1);
     ecs_assert(count >= 0, ECS_INTERNAL_ERROR, NULL);
 
     /* Fast path: no switch columns, no lifecycle actions */
@@ -38214,6 +42749,9 @@ void flecs_table_delete(
 
     /* If the table is monitored indicate that there has been a change */
     flecs_table_mark_table_dirty(world, table, 0);    
+    if (row != count) {
+        flecs_table_mark_rows_dirty(world, table, -1, row, 1);
+    }
 
     /* Destruct component data */
     ecs_column_t *columns = table->data.columns;
@@ -38534,6 +43072,8 @@ void flecs_table_swap(
 
     /* If the table is monitored indicate that there has been a change */
     flecs_table_mark_table_dirty(world, table, 0);    
+    flecs_table_mark_rows_dirty(world, table, -1, row_1, 1);
+    flecs_table_mark_rows_dirty(world, table, -1, row_2, 1);
 
     ecs_entity_t *entities = table->data.entities;
     ecs_entity_t e1 = entities[row_1];
@@ -38776,6 +43316,8 @@ void flecs_table_merge_data(
     dst_table->data.count = dst_entities.count;
     dst_table->data.size = dst_entities.size;
 
+    flecs_table_mark_rows_dirty(world, dst_table, -1, dst_count, src_count);
+
     src_table->data.entities = src_entities.array;
     src_table->data.count = src_entities.count;
     src_table->data.size = src_entities.size;
@@ -38814,6 +43356,7 @@ void flecs_table_merge(
     flecs_table_merge_data(world, dst_table, src_table, dst_count, src_count);
 
     if (src_count) {
+        world->propagate_version += src_table->_->traversable_count != 0;
         flecs_table_traversable_add(dst_table, src_table->_->traversable_count);
         flecs_table_traversable_add(src_table, -src_table->_->traversable_count);
         ecs_assert(src_table->_->traversable_count == 0, ECS_INTERNAL_ERROR, NULL);
@@ -54424,6 +58967,386 @@ void ecs_meta_type_serialized_init(
 
 
 #ifdef FLECS_OS_API_IMPL
+/**
+ * @file addons/os_api_impl/perf_trace.inl
+ * @brief Builtin tracer for ecs_os_perf_trace_push/ecs_os_perf_trace_pop.
+ * 
+ * Each thread records its scopes in its own ring buffer, so that the push/pop 
+ * hooks don't need a lock. A push stores a timestamp on a small per-thread 
+ * stack, a pop writes the completed scope to the ring buffer. When the buffer 
+ * is full the oldest scopes are overwritten. Timestamps are read from the TSC 
+ * where available, and are converted to wall time when the trace is written, 
+ * by comparing the TSC with ecs_os_now() at start and stop.
+ * 
+ * A thread marks its record as busy while it writes to its ring buffer. When
+ * the trace is stopped, the tracer waits until no thread is busy before it 
+ * reads and frees the ring buffers. Thread records are never freed, as a 
+ * thread may load its record at any time.
+ */
+
+#ifdef FLECS_PERF_TRACE
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define FLECS_PERF_TRACE_DEPTH (64)
+#define FLECS_PERF_TRACE_BUFFER_SIZE (64 * 1024)
+
+typedef struct ecs_perf_trace_scope_t {
+    const char *name;
+    uint64_t start;
+    uint64_t stop;
+} ecs_perf_trace_scope_t;
+
+typedef struct ecs_perf_trace_thread_t {
+    ecs_perf_trace_scope_t *scopes;   /* Ring buffer with completed scopes */
+    uint64_t count;                   /* Total number of completed scopes */
+    uint64_t stack[FLECS_PERF_TRACE_DEPTH]; /* Start times of open scopes */
+    int32_t depth;
+    int32_t id;
+    int32_t generation;               /* Trace the ring buffer belongs to */
+    int32_t busy;                     /* Set while thread is inside a hook */
+    struct ecs_perf_trace_thread_t *next;
+} ecs_perf_trace_thread_t;
+
+static struct {
+    ecs_os_mutex_t lock;              /* Protects thread registration */
+    ecs_perf_trace_thread_t *threads;
+    int32_t thread_count;             /* Threads that joined current trace */
+    int32_t capacity;                 /* Scopes per thread (power of 2) */
+    int32_t generation;               /* Last started trace */
+    int32_t active;                   /* Generation if started, 0 if stopped */
+    uint64_t tsc_start;
+    uint64_t time_start;
+} flecs_perf_trace;
+
+static FLECS_PERF_TRACE_TLS ecs_perf_trace_thread_t *flecs_perf_trace_tls;
+
+static
+int32_t flecs_perf_trace_load(
+    const int32_t *value)
+{
+#if defined(__GNUC__)
+    return __atomic_load_n(value, __ATOMIC_SEQ_CST);
+#elif defined(_MSC_VER) && defined(_M_ARM64)
+    return (int32_t)__ldar32((volatile unsigned __int32*)value);
+#elif defined(_MSC_VER)
+    return (int32_t)_InterlockedOr((volatile long*)value, 0);
+#else
+    return *(const volatile int32_t*)value;
+#endif
+}
+
+static
+void flecs_perf_trace_store(
+    int32_t *value,
+    int32_t new_value)
+{
+#if defined(__GNUC__)
+    __atomic_store_n(value, new_value, __ATOMIC_SEQ_CST);
+#elif defined(_MSC_VER)
+    _InterlockedExchange((volatile long*)value, (long)new_value);
+#else
+    *(volatile int32_t*)value = new_value;
+#endif
+}
+
+static
+void flecs_perf_trace_release(
+    int32_t *value)
+{
+#if defined(__GNUC__)
+    __atomic_store_n(value, 0, __ATOMIC_RELEASE);
+#elif defined(_MSC_VER)
+    _InterlockedExchange((volatile long*)value, 0);
+#else
+    *(volatile int32_t*)value = 0;
+#endif
+}
+
+static
+uint64_t flecs_perf_trace_tsc(void) {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    return __rdtsc();
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    return __rdtsc();
+#else
+    return ecs_os_now();
+#endif
+}
+
+/* Returns the record of the current thread marked as busy, or NULL if the 
+ * trace is not started. The caller must call flecs_perf_trace_leave when a
+ * record is returned. */
+static
+ecs_perf_trace_thread_t* flecs_perf_trace_enter(void) {
+    /* Cheap check first, so hooks don't pay for a barrier when not tracing */
+    if (!flecs_perf_trace_load(&flecs_perf_trace.active)) {
+        return NULL;
+    }
+
+    ecs_perf_trace_thread_t *t = flecs_perf_trace_tls;
+    if (!t) {
+        t = ecs_os_calloc_t(ecs_perf_trace_thread_t);
+        ecs_os_mutex_lock(flecs_perf_trace.lock);
+        t->next = flecs_perf_trace.threads;
+        flecs_perf_trace.threads = t;
+        ecs_os_mutex_unlock(flecs_perf_trace.lock);
+        flecs_perf_trace_tls = t;
+    }
+
+    /* Mark busy before checking whether the trace is still active. Both are
+     * sequentially consistent, so either ecs_perf_trace_stop sees the busy
+     * flag and waits, or this thread sees that the trace was stopped. */
+    flecs_perf_trace_store(&t->busy, 1);
+
+    int32_t active = flecs_perf_trace_load(&flecs_perf_trace.active);
+    if (!active) {
+        flecs_perf_trace_release(&t->busy);
+        return NULL;
+    }
+
+    if (t->generation != active) {
+        /* First scope recorded by this thread since the trace was started */
+        t->scopes = ecs_os_malloc_n(
+            ecs_perf_trace_scope_t, flecs_perf_trace.capacity);
+        t->count = 0;
+        t->depth = 0;
+        t->generation = active;
+
+        ecs_os_mutex_lock(flecs_perf_trace.lock);
+        t->id = flecs_perf_trace.thread_count ++;
+        ecs_os_mutex_unlock(flecs_perf_trace.lock);
+    }
+
+    return t;
+}
+
+static
+void flecs_perf_trace_leave(
+    ecs_perf_trace_thread_t *t)
+{
+    flecs_perf_trace_release(&t->busy);
+}
+
+static
+void flecs_perf_trace_push(
+    const char *filename,
+    size_t line,
+    const char *name)
+{
+    (void)filename;
+    (void)line;
+    (void)name;
+
+    /* A push only writes to the thread record, which is never freed, so it
+     * doesn't have to mark the thread as busy once it joined the trace. */
+    int32_t active = flecs_perf_trace_load(&flecs_perf_trace.active);
+    ecs_perf_trace_thread_t *t = flecs_perf_trace_tls;
+    if (!active) {
+        return;
+    }
+
+    if (!t || t->generation != active) {
+        if (!(t = flecs_perf_trace_enter())) {
+            return;
+        }
+        flecs_perf_trace_leave(t);
+    }
+
+    int32_t depth = t->depth ++;
+    if (depth < FLECS_PERF_TRACE_DEPTH) {
+        t->stack[depth] = flecs_perf_trace_tsc();
+    }
+}
+
+static
+void flecs_perf_trace_pop(
+    const char *filename,
+    size_t line,
+    const char *name)
+{
+    (void)filename;
+    (void)line;
+
+    ecs_perf_trace_thread_t *t = flecs_perf_trace_enter();
+    if (!t) {
+        return;
+    }
+
+    if (!t->depth) {
+        /* Scope was pushed before the trace was started */
+        flecs_perf_trace_leave(t);
+        return;
+    }
+
+    int32_t depth = -- t->depth;
+    if (depth < FLECS_PERF_TRACE_DEPTH) {
+        ecs_perf_trace_scope_t *scope = &t->scopes[
+            t->count & (uint64_t)(flecs_perf_trace.capacity - 1)];
+        scope->name = name;
+        scope->start = t->stack[depth];
+        scope->stop = flecs_perf_trace_tsc();
+        t->count ++;
+    }
+
+    flecs_perf_trace_leave(t);
+}
+
+static
+void flecs_perf_trace_write_str(
+    FILE *file,
+    const char *str)
+{
+    char ch;
+    fputc('"', file);
+    while ((ch = *str ++)) {
+        if (ch == '"' || ch == '\\') {
+            fputc('\\', file);
+            fputc(ch, file);
+        } else if ((unsigned char)ch < 0x20) {
+            fprintf(file, "\\u%04x", (unsigned char)ch);
+        } else {
+            fputc(ch, file);
+        }
+    }
+    fputc('"', file);
+}
+
+static
+int flecs_perf_trace_write(
+    const char *filename,
+    double ticks_per_us)
+{
+    FILE *file;
+    ecs_os_fopen(&file, filename, "w");
+    if (!file) {
+        ecs_err("%s (%s)", ecs_os_strerror(errno), filename);
+        return -1;
+    }
+
+    const char *sep = "";
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+    ecs_perf_trace_thread_t *t;
+    for (t = flecs_perf_trace.threads; t; t = t->next) {
+        if (t->generation != flecs_perf_trace.generation) {
+            /* Thread didn't record scopes for this trace */
+            continue;
+        }
+
+        fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+            "\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}", sep, t->id, t->id);
+        sep = ",";
+
+        uint64_t i = 0, mask = (uint64_t)(flecs_perf_trace.capacity - 1);
+        if (t->count > (uint64_t)flecs_perf_trace.capacity) {
+            i = t->count - (uint64_t)flecs_perf_trace.capacity;
+        }
+
+        for (; i < t->count; i ++) {
+            ecs_perf_trace_scope_t *scope = &t->scopes[i & mask];
+            fprintf(file, ",\n{\"name\":");
+            flecs_perf_trace_write_str(file, scope->name ? scope->name : "");
+            fprintf(file, ",\"cat\":\"flecs\",\"ph\":\"X\",\"pid\":1,"
+                "\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", t->id,
+                (double)(scope->start - flecs_perf_trace.tsc_start) / 
+                    ticks_per_us,
+                (double)(scope->stop - scope->start) / ticks_per_us);
+        }
+    }
+
+    fprintf(file, "\n]}\n");
+
+    if (fclose(file)) {
+        ecs_err("%s (%s)", ecs_os_strerror(errno), filename);
+        return -1;
+    }
+
+    return 0;
+}
+
+void ecs_perf_trace_start(
+    int32_t events_per_thread)
+{
+    ecs_assert(!flecs_perf_trace_load(&flecs_perf_trace.active), 
+        ECS_INVALID_OPERATION, "perf trace is already started");
+    ecs_assert(events_per_thread >= 0, ECS_INVALID_PARAMETER, NULL);
+    ecs_assert(ecs_os_has_threading(), ECS_MISSING_OS_API, 
+        "perf trace requires mutex functions from the OS API");
+
+    if (!events_per_thread) {
+        events_per_thread = FLECS_PERF_TRACE_BUFFER_SIZE;
+    }
+
+    if (!flecs_perf_trace.lock) {
+        /* Not freed when the trace is stopped, as threads may still register
+         * after they loaded the active generation. */
+        flecs_perf_trace.lock = ecs_os_mutex_new();
+    }
+
+    flecs_perf_trace.thread_count = 0;
+    flecs_perf_trace.capacity = flecs_next_pow_of_2(events_per_thread);
+    if (!(++ flecs_perf_trace.generation)) {
+        flecs_perf_trace.generation ++; /* 0 means the trace is stopped */
+    }
+    flecs_perf_trace.time_start = ecs_os_now();
+    flecs_perf_trace.tsc_start = flecs_perf_trace_tsc();
+    flecs_perf_trace_store(&flecs_perf_trace.active, 
+        flecs_perf_trace.generation);
+}
+
+int ecs_perf_trace_stop(
+    const char *filename)
+{
+    ecs_assert(flecs_perf_trace_load(&flecs_perf_trace.active), 
+        ECS_INVALID_OPERATION, "perf trace is not started");
+
+    flecs_perf_trace_store(&flecs_perf_trace.active, 0);
+    uint64_t tsc_stop = flecs_perf_trace_tsc();
+    uint64_t time_stop = ecs_os_now();
+
+    /* Wait for threads that entered a hook before the trace was stopped. 
+     * Threads that enter a hook after this point don't touch ring buffers. 
+     * The lock keeps the thread list stable while the buffers are read. */
+    ecs_os_mutex_lock(flecs_perf_trace.lock);
+    ecs_perf_trace_thread_t *t;
+    for (t = flecs_perf_trace.threads; t; t = t->next) {
+        while (flecs_perf_trace_load(&t->busy)) {
+            ecs_os_sleep(0, 1000);
+        }
+    }
+
+    int result = 0;
+    if (filename) {
+        double ticks_per_us = 1000.0;
+        if (time_stop > flecs_perf_trace.time_start) {
+            ticks_per_us = (double)(tsc_stop - flecs_perf_trace.tsc_start) * 
+                1000.0 / (double)(time_stop - flecs_perf_trace.time_start);
+        }
+        if (ticks_per_us <= 0) {
+            ticks_per_us = 1000.0;
+        }
+
+        result = flecs_perf_trace_write(filename, ticks_per_us);
+    }
+
+    for (t = flecs_perf_trace.threads; t; t = t->next) {
+        if (t->generation == flecs_perf_trace.generation) {
+            ecs_os_free(t->scopes);
+            t->scopes = NULL;
+        }
+    }
+    ecs_os_mutex_unlock(flecs_perf_trace.lock);
+
+    return result;
+}
+
+#endif
+
 #ifdef ECS_TARGET_WINDOWS
 /**
  * @file addons/os_api_impl/posix_impl.inl
@@ -54512,6 +59435,16 @@ int64_t win_ladec(
     return InterlockedDecrement64(count);
 }
 
+static
+void* win_acas(
+    void **ptr,
+    void *expected,
+    void *value)
+{
+    return InterlockedCompareExchangePointer(
+        (PVOID volatile*)ptr, value, expected);
+}
+
 static
 ecs_os_mutex_t win_mutex_new(void) {
     CRITICAL_SECTION *mutex = ecs_os_malloc_t(CRITICAL_SECTION);
@@ -54697,6 +59630,7 @@ void ecs_set_os_api_impl(void) {
     api.adec_ = win_adec;
     api.lainc_ = win_lainc;
     api.ladec_ = win_ladec;
+    api.acas_ = win_acas;
     api.mutex_new_ = win_mutex_new;
     api.mutex_free_ = win_mutex_free;
     api.mutex_lock_ = win_mutex_lock;
@@ -54708,6 +59642,10 @@ void ecs_set_os_api_impl(void) {
     api.cond_wait_ = win_cond_wait;
     api.sleep_ = win_sleep;
     api.now_ = win_time_now;
+#ifdef FLECS_PERF_TRACE
+    api.perf_trace_push_ = flecs_perf_trace_push;
+    api.perf_trace_pop_ = flecs_perf_trace_pop;
+#endif
     api.fini_ = win_fini;
 
     win_time_setup();
@@ -54773,6 +59711,378 @@ ecs_os_thread_id_t posix_thread_self(void)
     return (ecs_os_thread_id_t)pthread_self();
 }
 
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define POSIX_AFFINITY_MAX (1024)
+#define POSIX_AFFINITY_WORD_BITS (8 * sizeof(unsigned long))
+#define POSIX_MPOL_PREFERRED (1)
+
+/* Affinity and memory policy of a thread */
+typedef struct posix_thread_affinity_t {
+    unsigned long cpus[POSIX_AFFINITY_MAX / POSIX_AFFINITY_WORD_BITS];
+    unsigned long nodes[POSIX_AFFINITY_MAX / POSIX_AFFINITY_WORD_BITS];
+    long cpus_size;
+    int mempolicy;
+    bool has_mempolicy;
+} posix_thread_affinity_t;
+
+#ifdef __GNUC__
+/* Affinity of the calling thread before it was first changed, so that it can
+ * be restored when the thread no longer needs to be bound. */
+static __thread posix_thread_affinity_t posix_thread_affinity_orig;
+static __thread bool posix_thread_affinity_set;
+#endif
+
+static
+void posix_thread_affinity_save(
+    posix_thread_affinity_t *affinity)
+{
+    affinity->cpus_size = syscall(SYS_sched_getaffinity, 0, 
+        sizeof(affinity->cpus), affinity->cpus);
+    affinity->has_mempolicy = !syscall(SYS_get_mempolicy, 
+        &affinity->mempolicy, affinity->nodes, POSIX_AFFINITY_MAX + 1, 
+        NULL, 0);
+}
+
+static
+void posix_thread_affinity_restore(
+    const posix_thread_affinity_t *affinity)
+{
+    if (affinity->cpus_size > 0) {
+        syscall(SYS_sched_setaffinity, 0, affinity->cpus_size, 
+            affinity->cpus);
+    }
+
+    if (affinity->has_mempolicy) {
+        syscall(SYS_set_mempolicy, affinity->mempolicy, affinity->nodes,
+            POSIX_AFFINITY_MAX + 1);
+    }
+}
+
+/* Set affinity of calling thread. Syscalls are used directly so that this
+ * doesn't depend on _GNU_SOURCE (for pthread_setaffinity_np) or libnuma. */
+static
+int posix_thread_set_affinity(
+    int32_t cpu,
+    int32_t numa_node)
+{
+    unsigned long mask[POSIX_AFFINITY_MAX / POSIX_AFFINITY_WORD_BITS];
+    int result = 0;
+
+#ifdef __GNUC__
+    if ((cpu >= 0 || numa_node >= 0) && !posix_thread_affinity_set) {
+        posix_thread_affinity_save(&posix_thread_affinity_orig);
+        posix_thread_affinity_set = true;
+    }
+#endif
+
+    if (cpu >= 0) {
+        if (cpu >= POSIX_AFFINITY_MAX) {
+            return -1;
+        }
+
+        size_t bit = flecs_ito(size_t, cpu);
+        memset(mask, 0, sizeof(mask));
+        mask[bit / POSIX_AFFINITY_WORD_BITS] |= 
+            1ul << (bit % POSIX_AFFINITY_WORD_BITS);
+
+        /* A pid of 0 applies to the calling thread */
+        if (syscall(SYS_sched_setaffinity, 0, sizeof(mask), mask)) {
+            result = -1;
+        }
+    }
+
+    if (numa_node >= 0) {
+        if (numa_node >= POSIX_AFFINITY_MAX) {
+            return -1;
+        }
+
+        size_t bit = flecs_ito(size_t, numa_node);
+        memset(mask, 0, sizeof(mask));
+        mask[bit / POSIX_AFFINITY_WORD_BITS] |= 
+            1ul << (bit % POSIX_AFFINITY_WORD_BITS);
+
+        /* Prefer memory from node for pages first touched by this thread. Other
+         * nodes are used when the node runs out of memory. */
+        if (syscall(SYS_set_mempolicy, POSIX_MPOL_PREFERRED, mask, 
+            POSIX_AFFINITY_MAX + 1)) 
+        {
+            result = -1;
+        }
+    }
+
+    return result;
+}
+
+#ifdef __GNUC__
+/* Restore affinity of calling thread to what it was before it was set */
+static
+void posix_thread_reset_affinity(void)
+{
+    if (!posix_thread_affinity_set) {
+        return;
+    }
+
+    posix_thread_affinity_restore(&posix_thread_affinity_orig);
+    posix_thread_affinity_set = false;
+}
+#endif
+#endif
+
+#if defined(__linux__) && defined(__GLIBC__)
+#include <ucontext.h>
+#include <sys/mman.h>
+
+typedef struct posix_fiber_t {
+    ucontext_t ctx;                 /* Context of fiber */
+    ucontext_t caller;              /* Context of code that resumed the fiber */
+    ecs_os_fiber_callback_t callback;
+    void *arg;
+    void *stack;                    /* Mapping with guard page and stack */
+    size_t stack_size;              /* Size of mapping */
+} posix_fiber_t;
+
+/* makecontext only passes int arguments, so the fiber pointer is split up in
+ * two 32 bit halves. */
+static
+void posix_fiber_main(
+    unsigned int lo,
+    unsigned int hi)
+{
+    uintptr_t ptr = (uintptr_t)lo | (((uintptr_t)hi << 16) << 16);
+    posix_fiber_t *fiber = (posix_fiber_t*)ptr;
+    fiber->callback(fiber->arg);
+    /* Returning switches to uc_link, which is the caller context */
+}
+
+static
+ecs_os_fiber_t posix_fiber_new(
+    ecs_os_fiber_callback_t callback, 
+    void *arg,
+    ecs_size_t stack_size)
+{
+    posix_fiber_t *fiber = ecs_os_calloc_t(posix_fiber_t);
+    fiber->callback = callback;
+    fiber->arg = arg;
+
+    /* Map stack with a guard page below it, so that a stack overflow faults
+     * instead of silently corrupting the heap. */
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    size_t size = ((size_t)stack_size + page_size - 1) & ~(page_size - 1);
+    fiber->stack_size = size + page_size;
+    fiber->stack = mmap(NULL, fiber->stack_size, PROT_READ | PROT_WRITE, 
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (fiber->stack == MAP_FAILED) {
+        ecs_os_abort();
+    }
+
+    if (mprotect(fiber->stack, page_size, PROT_NONE)) {
+        ecs_os_abort();
+    }
+
+    if (getcontext(&fiber->ctx)) {
+        ecs_os_abort();
+    }
+
+    fiber->ctx.uc_stack.ss_sp = ECS_OFFSET(fiber->stack, page_size);
+    fiber->ctx.uc_stack.ss_size = size;
+    fiber->ctx.uc_link = &fiber->caller;
+
+    uintptr_t ptr = (uintptr_t)fiber;
+    makecontext(&fiber->ctx, (void(*)(void))posix_fiber_main, 2, 
+        (unsigned int)(ptr & 0xFFFFFFFF), 
+        (unsigned int)((ptr >> 16) >> 16));
+
+    return (ecs_os_fiber_t)(uintptr_t)fiber;
+}
+
+static
+void posix_fiber_free(
+    ecs_os_fiber_t f)
+{
+    posix_fiber_t *fiber = (posix_fiber_t*)(uintptr_t)f;
+    munmap(fiber->stack, fiber->stack_size);
+    ecs_os_free(fiber);
+}
+
+static
+void posix_fiber_resume(
+    ecs_os_fiber_t f)
+{
+    posix_fiber_t *fiber = (posix_fiber_t*)(uintptr_t)f;
+    if (swapcontext(&fiber->caller, &fiber->ctx)) {
+        ecs_os_abort();
+    }
+}
+
+static
+void posix_fiber_yield(
+    ecs_os_fiber_t f)
+{
+    posix_fiber_t *fiber = (posix_fiber_t*)(uintptr_t)f;
+    if (swapcontext(&fiber->ctx, &fiber->caller)) {
+        ecs_os_abort();
+    }
+}
+#endif
+
+#if defined(__linux__) && defined(__GNUC__)
+/* Pool of threads that run tasks. Task threads are started and joined for each
+ * frame, so reusing threads removes the cost of creating them. Each pool 
+ * thread has a single task slot. A task is submitted by claiming an idle 
+ * thread, so no locks are needed. Tasks may wait on each other (workers 
+ * synchronize at sync points), so if no thread is idle a new thread is added 
+ * to the pool instead of queueing the task. */
+
+#define POSIX_FUTEX_WAIT_PRIVATE (128)
+#define POSIX_FUTEX_WAKE_PRIVATE (129)
+#define POSIX_TASK_SPIN_COUNT (1024)
+
+#define POSIX_TASK_IDLE (0)         /* Thread can be claimed */
+#define POSIX_TASK_CLAIMED (1)      /* Task is being submitted to thread */
+#define POSIX_TASK_RUNNING (2)      /* Thread is running task */
+#define POSIX_TASK_DONE (3)         /* Task is done but not yet joined */
+#define POSIX_TASK_EXIT (4)         /* Thread should exit */
+
+typedef struct posix_task_t {
+    int32_t state;                  /* Futex, one of POSIX_TASK_* */
+    ecs_os_thread_callback_t callback;
+    void *arg;
+    void *result;
+    pthread_t thread;
+    struct posix_task_t *next;
+} posix_task_t;
+
+static posix_task_t *posix_task_pool;
+
+/* Wait while state has value */
+static
+void posix_task_wait(
+    int32_t *state,
+    int32_t value)
+{
+    int32_t i;
+    for (i = 0; i < POSIX_TASK_SPIN_COUNT; i ++) {
+        if (__atomic_load_n(state, __ATOMIC_ACQUIRE) != value) {
+            return;
+        }
+    }
+
+    while (__atomic_load_n(state, __ATOMIC_ACQUIRE) == value) {
+        syscall(SYS_futex, state, POSIX_FUTEX_WAIT_PRIVATE, value, 
+            NULL, NULL, 0);
+    }
+}
+
+static
+void posix_task_set(
+    int32_t *state,
+    int32_t value)
+{
+    __atomic_store_n(state, value, __ATOMIC_RELEASE);
+    syscall(SYS_futex, state, POSIX_FUTEX_WAKE_PRIVATE, INT32_MAX, 
+        NULL, NULL, 0);
+}
+
+static
+void* posix_task_thread(
+    void *arg)
+{
+    posix_task_t *task = arg;
+
+    for (;;) {
+        int32_t state;
+        while ((state = __atomic_load_n(&task->state, __ATOMIC_ACQUIRE)) != 
+            POSIX_TASK_RUNNING) 
+        {
+            if (state == POSIX_TASK_EXIT) {
+                return NULL;
+            }
+            posix_task_wait(&task->state, state);
+        }
+
+        task->result = task->callback(task->arg);
+
+        /* Restore affinity if the task changed it, so that a task that doesn't
+         * set affinity doesn't run with the affinity of a previous task. */
+        posix_thread_reset_affinity();
+        posix_task_set(&task->state, POSIX_TASK_DONE);
+    }
+}
+
+static
+ecs_os_thread_t posix_task_new(
+    ecs_os_thread_callback_t callback, 
+    void *arg)
+{
+    posix_task_t *task = __atomic_load_n(&posix_task_pool, __ATOMIC_ACQUIRE);
+    for (; task; task = task->next) {
+        int32_t idle = POSIX_TASK_IDLE;
+        if (__atomic_compare_exchange_n(&task->state, &idle, 
+            POSIX_TASK_CLAIMED, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        {
+            break;
+        }
+    }
+
+    bool created = false;
+    if (!task) {
+        task = ecs_os_calloc_t(posix_task_t);
+        task->state = POSIX_TASK_CLAIMED;
+        created = true;
+    }
+
+    task->callback = callback;
+    task->arg = arg;
+
+    if (created) {
+        if (pthread_create(&task->thread, NULL, posix_task_thread, task)) {
+            ecs_os_abort();
+        }
+
+        task->next = __atomic_load_n(&posix_task_pool, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&posix_task_pool, &task->next,
+            task, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) { }
+    }
+
+    posix_task_set(&task->state, POSIX_TASK_RUNNING);
+
+    return (ecs_os_thread_t)(uintptr_t)task;
+}
+
+static
+void* posix_task_join(
+    ecs_os_thread_t thread)
+{
+    posix_task_t *task = (posix_task_t*)(uintptr_t)thread;
+    posix_task_wait(&task->state, POSIX_TASK_RUNNING);
+    ecs_assert(task->state == POSIX_TASK_DONE, ECS_INTERNAL_ERROR, NULL);
+    void *result = task->result;
+    __atomic_store_n(&task->state, POSIX_TASK_IDLE, __ATOMIC_RELEASE);
+    return result;
+}
+
+/* Stop pool threads. Called when the last world is deleted, at which point no
+ * tasks are running. */
+static
+void posix_task_pool_fini(void)
+{
+    posix_task_t *task = __atomic_exchange_n(
+        &posix_task_pool, NULL, __ATOMIC_ACQUIRE);
+    while (task) {
+        posix_task_t *next = task->next;
+        ecs_assert(task->state == POSIX_TASK_IDLE, ECS_INTERNAL_ERROR, 
+            "task was not joined");
+        posix_task_set(&task->state, POSIX_TASK_EXIT);
+        pthread_join(task->thread, NULL);
+        ecs_os_free(task);
+        task = next;
+    }
+}
+#endif
+
 static
 int32_t posix_ainc(
     int32_t *count)
@@ -54853,6 +60163,30 @@ int64_t posix_ladec(
 #endif
 }
 
+static
+void* posix_acas(
+    void **ptr,
+    void *expected,
+    void *value)
+{
+#ifdef __GNUC__
+    return __sync_val_compare_and_swap(ptr, expected, value);
+#else
+    void *result;
+    if (pthread_mutex_lock(&atomic_mutex)) {
+	    abort();
+    }
+    result = *ptr;
+    if (result == expected) {
+        *ptr = value;
+    }
+    if (pthread_mutex_unlock(&atomic_mutex)) {
+	    abort();
+    }
+    return result;
+#endif
+}
+
 static
 ecs_os_mutex_t posix_mutex_new(void) {
     pthread_mutex_t *mutex = ecs_os_malloc(sizeof(pthread_mutex_t));
@@ -55028,12 +60362,31 @@ void ecs_set_os_api_impl(void) {
     api.thread_new_ = posix_thread_new;
     api.thread_join_ = posix_thread_join;
     api.thread_self_ = posix_thread_self;
+#if defined(__linux__)
+    api.thread_set_affinity_ = posix_thread_set_affinity;
+#ifdef __GNUC__
+    api.thread_reset_affinity_ = posix_thread_reset_affinity;
+#endif
+#endif
+#if defined(__linux__) && defined(__GNUC__)
+    api.task_new_ = posix_task_new;
+    api.task_join_ = posix_task_join;
+    api.fini_ = posix_task_pool_fini;
+#else
     api.task_new_ = posix_thread_new;
     api.task_join_ = posix_thread_join;
+#endif
+#if defined(__linux__) && defined(__GLIBC__)
+    api.fiber_new_ = posix_fiber_new;
+    api.fiber_free_ = posix_fiber_free;
+    api.fiber_resume_ = posix_fiber_resume;
+    api.fiber_yield_ = posix_fiber_yield;
+#endif
     api.ainc_ = posix_ainc;
     api.adec_ = posix_adec;
     api.lainc_ = posix_lainc;
     api.ladec_ = posix_ladec;
+    api.acas_ = posix_acas;
     api.mutex_new_ = posix_mutex_new;
     api.mutex_free_ = posix_mutex_free;
     api.mutex_lock_ = posix_mutex_lock;
@@ -55045,6 +60398,10 @@ void ecs_set_os_api_impl(void) {
     api.cond_wait_ = posix_cond_wait;
     api.sleep_ = posix_sleep;
     api.now_ = posix_time_now;
+#ifdef FLECS_PERF_TRACE
+    api.perf_trace_push_ = flecs_perf_trace_push;
+    api.perf_trace_pop_ = flecs_perf_trace_pop;
+#endif
 
     posix_time_setup();
 
@@ -55702,6 +61059,12 @@ static void flecs_pipeline_free(
         ecs_allocator_t *a = &world->allocator;
         ecs_vec_fini_t(a, &p->ops, ecs_pipeline_op_t);
         ecs_vec_fini_t(a, &p->systems, ecs_entity_t);
+        ecs_vec_fini_t(a, &p->tasks, ecs_worker_tasks_t);
+        ecs_vec_fini_t(a, &p->deps, int32_t);
+        ecs_vec_fini_t(a, &p->system_deps, ecs_system_deps_t);
+        ecs_vec_fini_t(a, &p->overlap_ids, ecs_id_t);
+        ecs_vec_fini_t(a, &p->overlap_systems, ecs_system_t*);
+        ecs_vec_fini_t(a, &p->schedule, ecs_system_sched_t);
         ecs_os_free(p->iters);
         ecs_query_fini(p->query);
         ecs_os_free(p);
@@ -55924,6 +61287,149 @@ bool flecs_pipeline_check_terms(
     return needs_merge;
 }
 
+/* Returns whether term accesses component data while the system runs, and if
+ * so, whether the data is written. */
+static
+bool flecs_pipeline_term_access(
+    const ecs_world_t *world,
+    const ecs_term_t *term,
+    bool *write)
+{
+    int16_t inout = term->inout;
+    if (inout == EcsInOutNone || inout == EcsInOutFilter) {
+        return false;
+    }
+
+    if (term->oper == EcsNot) {
+        /* Components that are added with Not/Out are added with a command */
+        return false;
+    }
+
+    ecs_id_t id = term->id;
+    if (!ecs_id_is_wildcard(id) && !ecs_get_typeid(world, id)) {
+        /* Tags don't have data */
+        return false;
+    }
+
+    if (inout == EcsInOutDefault) {
+        if (ecs_term_match_0(term)) {
+            /* Not a read/write annotation, see flecs_pipeline_check_term */
+            return false;
+        }
+
+        bool is_shared = !ecs_term_match_this(term) || 
+            !(term->src.id & EcsSelf);
+        inout = is_shared ? EcsIn : EcsInOut;
+    }
+
+    *write = inout == EcsOut || inout == EcsInOut;
+    return true;
+}
+
+/* Returns whether running two systems at the same time could cause a data 
+ * race, which is the case when both systems access the same component and at 
+ * least one of them writes it. */
+static
+bool flecs_pipeline_systems_conflict(
+    const ecs_world_t *world,
+    const ecs_query_t *a,
+    const ecs_query_t *b)
+{
+    int32_t ta, tb;
+    for (ta = 0; ta < a->term_count; ta ++) {
+        const ecs_term_t *term_a = &a->terms[ta];
+        bool write_a = false;
+        if (!flecs_pipeline_term_access(world, term_a, &write_a)) {
+            continue;
+        }
+
+        for (tb = 0; tb < b->term_count; tb ++) {
+            const ecs_term_t *term_b = &b->terms[tb];
+            bool write_b = false;
+            if (!flecs_pipeline_term_access(world, term_b, &write_b)) {
+                continue;
+            }
+
+            if (!write_a && !write_b) {
+                continue;
+            }
+
+            ecs_id_t id_a = term_a->id, id_b = term_b->id;
+            if (id_a == EcsWildcard || id_a == EcsAny || 
+                id_b == EcsWildcard || id_b == EcsAny) 
+            {
+                return true;
+            }
+
+            if (ecs_id_match(id_a, id_b) || ecs_id_match(id_b, id_a)) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+static
+ecs_system_t* flecs_pipeline_get_system(
+    const ecs_world_t *world,
+    ecs_entity_t system)
+{
+    const EcsPoly *poly = ecs_get_pair(world, system, EcsPoly, EcsSystem);
+    ecs_assert(poly != NULL, ECS_INTERNAL_ERROR, NULL);
+    flecs_poly_assert(poly->poly, ecs_system_t);
+    return poly->poly;
+}
+
+/* Build dependency graph for systems in multi threaded operations. Workers run
+ * the systems of an operation in order, but don't wait for other workers to 
+ * finish a system unless a later system depends on it. This lets workers that
+ * are done with a system start on the next one, so that independent systems 
+ * run concurrently. */
+static
+void flecs_pipeline_build_deps(
+    ecs_world_t *world,
+    ecs_pipeline_state_t *pq)
+{
+    ecs_allocator_t *a = &world->allocator;
+    int32_t count = ecs_vec_count(&pq->systems);
+    ecs_vec_reset_t(a, &pq->deps, int32_t);
+    ecs_vec_set_count_t(a, &pq->system_deps, ecs_system_deps_t, count);
+
+    ecs_entity_t *systems = ecs_vec_first_t(&pq->systems, ecs_entity_t);
+    ecs_system_deps_t *system_deps = ecs_vec_first_t(
+        &pq->system_deps, ecs_system_deps_t);
+    ecs_pipeline_op_t *ops = ecs_vec_first_t(&pq->ops, ecs_pipeline_op_t);
+    int32_t o, op_count = ecs_vec_count(&pq->ops);
+
+    for (o = 0; o < op_count; o ++) {
+        ecs_pipeline_op_t *op = &ops[o];
+        int32_t i, end = op->offset + op->count;
+        for (i = op->offset; i < end; i ++) {
+            ecs_system_deps_t *deps = &system_deps[i];
+            deps->offset = ecs_vec_count(&pq->deps);
+            deps->count = 0;
+
+            if (!op->multi_threaded) {
+                continue;
+            }
+
+            ecs_query_t *q = flecs_pipeline_get_system(
+                world, systems[i])->query;
+
+            int32_t j;
+            for (j = op->offset; j < i; j ++) {
+                ecs_query_t *dep_q = flecs_pipeline_get_system(
+                    world, systems[j])->query;
+                if (flecs_pipeline_systems_conflict(world, dep_q, q)) {
+                    ecs_vec_append_t(a, &pq->deps, int32_t)[0] = j;
+                    deps->count ++;
+                }
+            }
+        }
+    }
+}
+
 static
 EcsPoly* flecs_pipeline_term_system(
     ecs_iter_t *it)
@@ -56061,6 +61567,8 @@ bool flecs_pipeline_build(
     ecs_map_fini(&ws.ids);
     ecs_map_fini(&ws.wildcard_ids);
 
+    flecs_pipeline_build_deps(world, pq);
+
     op = ecs_vec_first_t(&pq->ops, ecs_pipeline_op_t);
 
     if (!op) {
@@ -56221,6 +61729,273 @@ void ecs_run_pipeline(
     }
 }
 
+static
+int flecs_pipeline_sched_compare(
+    const void *ptr1,
+    const void *ptr2)
+{
+    const ecs_system_sched_t *s1 = ptr1, *s2 = ptr2;
+    int32_t p1 = s1->sys->priority, p2 = s2->sys->priority;
+    if (p1 != p2) {
+        return (p1 > p2) - (p1 < p2);
+    }
+    return s1->index - s2->index;
+}
+
+static
+int flecs_pipeline_sched_compare_overdue(
+    const void *ptr1,
+    const void *ptr2)
+{
+    const ecs_system_sched_t *s1 = ptr1, *s2 = ptr2;
+    if (s1->overdue != s2->overdue) {
+        return (s1->overdue < s2->overdue) - (s1->overdue > s2->overdue);
+    }
+    return -flecs_pipeline_sched_compare(ptr1, ptr2);
+}
+
+/* Decide which systems run in the current frame. When the expected time of the
+ * systems in the pipeline exceeds the frame budget, low priority systems are 
+ * decimated, lowest priority first, until the expected time fits the budget. 
+ * The expected time of a system is its average time per run divided by the
+ * number of frames between runs. 
+ * Decimation only makes the budget fit on average, so the budget is also
+ * enforced for each frame: low priority systems that are due run in order of
+ * how long they're overdue, and are deferred to a later frame when they don't
+ * fit in what is left of the budget. Because system time varies between 
+ * frames, systems are deferred again when the measured frame time leaves no
+ * room for them (see flecs_pipeline_defer). */
+static
+void flecs_pipeline_schedule(
+    ecs_world_t *world,
+    ecs_pipeline_state_t *pq,
+    ecs_ftime_t delta_time)
+{
+    ecs_ftime_t budget = world->info.frame_budget;
+    if (ECS_EQZERO(budget) && !pq->decimated) {
+        return;
+    }
+
+    ecs_allocator_t *a = &world->allocator;
+    ecs_vec_clear(&pq->schedule);
+
+    ecs_entity_t *systems = ecs_vec_first_t(&pq->systems, ecs_entity_t);
+    int32_t i, count = ecs_vec_count(&pq->systems);
+    double expected = 0, frame_cost = 0;
+
+    for (i = 0; i < count; i ++) {
+        ecs_system_t *sys = flecs_pipeline_get_system(world, systems[i]);
+        sys->decimation = 1;
+        expected += (double)sys->time_cost;
+
+        if (sys->priority >= 0 || ECS_EQZERO(budget)) {
+            frame_cost += (double)sys->time_cost;
+        } else {
+            ecs_system_sched_t *el = ecs_vec_append_t(
+                a, &pq->schedule, ecs_system_sched_t);
+            el->sys = sys;
+            el->index = i;
+        }
+    }
+
+    ecs_system_sched_t *sched = ecs_vec_first_t(
+        &pq->schedule, ecs_system_sched_t);
+    int32_t sched_count = ecs_vec_count(&pq->schedule);
+    if (sched_count > 1) {
+        qsort(sched, (size_t)sched_count, ECS_SIZEOF(ecs_system_sched_t), 
+            flecs_pipeline_sched_compare);
+    }
+
+    double excess = expected - (double)budget;
+    for (i = 0; i < sched_count && excess > 0; i ++) {
+        ecs_system_t *sys = sched[i].sys;
+        double cost = (double)sys->time_cost;
+        if (cost <= 0) {
+            continue;
+        }
+
+        /* Smallest N for which running every Nth frame saves enough time */
+        int32_t n = FLECS_SYSTEM_DECIMATION_MAX;
+        if (excess < cost) {
+            double q = cost / (cost - excess);
+            if (q < (double)n) {
+                n = (int32_t)q;
+                if ((double)n < q) {
+                    n ++;
+                }
+            }
+        }
+
+        sys->decimation = n;
+        excess -= cost - cost / n;
+    }
+
+    for (i = 0; i < count; i ++) {
+        ecs_system_t *sys = flecs_pipeline_get_system(world, systems[i]);
+        if (!sys->skip) {
+            /* System ran last frame */
+            sys->delta_time_skipped = 0;
+        }
+        sys->skip = false;
+        sys->can_defer = false;
+    }
+
+    /* A system is due when it skipped decimation - 1 frames. Systems that are
+     * overdue the longest run first, then systems with a higher priority. */
+    for (i = 0; i < sched_count; i ++) {
+        ecs_system_t *sys = sched[i].sys;
+        sched[i].overdue = sys->frames_skipped + 1 - sys->decimation;
+    }
+
+    if (sched_count > 1) {
+        qsort(sched, (size_t)sched_count, ECS_SIZEOF(ecs_system_sched_t), 
+            flecs_pipeline_sched_compare_overdue);
+    }
+
+    bool ran_low_priority = false;
+    for (i = 0; i < sched_count; i ++) {
+        ecs_system_t *sys = sched[i].sys;
+        double cost = (double)sys->time_cost;
+        if (sched[i].overdue < 0) {
+            sys->skip = true;
+            continue;
+        }
+
+        /* Run system if it fits in the budget. If no low priority system fits,
+         * the system that's overdue the longest still runs, so that decimated
+         * systems don't pile up. Systems never skip more frames than
+         * FLECS_SYSTEM_DECIMATION_MAX. */
+        if ((frame_cost + cost) <= (double)budget) {
+            sys->can_defer = 
+                (sys->frames_skipped + 1) < FLECS_SYSTEM_DECIMATION_MAX;
+        } else if (ran_low_priority && 
+            (sys->frames_skipped + 1) < FLECS_SYSTEM_DECIMATION_MAX) 
+        {
+            sys->skip = true;
+            continue;
+        }
+
+        frame_cost += cost;
+        ran_low_priority = true;
+    }
+
+    bool decimated = false;
+    for (i = 0; i < count; i ++) {
+        ecs_system_t *sys = flecs_pipeline_get_system(world, systems[i]);
+        if (sys->skip) {
+            sys->frames_skipped ++;
+            sys->delta_time_skipped += delta_time;
+        }
+
+        decimated |= sys->skip || ECS_NEQZERO(sys->delta_time_skipped);
+    }
+
+    pq->decimated = decimated;
+
+    if (ECS_NEQZERO(budget)) {
+        ecs_os_get_time(&pq->frame_start);
+    }
+}
+
+/* Defer a low priority system that was scheduled to run to a later frame if
+ * the time spent in the current frame plus the expected time of the system
+ * (and of the systems before it in a multi threaded op) exceeds the budget. 
+ * Systems that had to run to not fall behind too far are never deferred. */
+static
+bool flecs_pipeline_defer(
+    ecs_world_t *world,
+    ecs_pipeline_state_t *pq,
+    ecs_system_t *sys,
+    double cost,
+    ecs_ftime_t delta_time)
+{
+    if (!sys->can_defer || sys->skip) {
+        return false;
+    }
+
+    ecs_time_t t = pq->frame_start;
+    if ((ecs_time_measure(&t) + cost) <= (double)world->info.frame_budget) {
+        return false;
+    }
+
+    sys->skip = true;
+    sys->can_defer = false;
+    sys->frames_skipped ++;
+    sys->delta_time_skipped += delta_time;
+    pq->decimated = true;
+    return true;
+}
+
+/* Check budget for systems in a multi threaded op before workers start it, as
+ * all threads must agree on which systems run. */
+static
+void flecs_pipeline_defer_op(
+    ecs_world_t *world,
+    ecs_pipeline_state_t *pq,
+    ecs_ftime_t delta_time)
+{
+    if (ECS_EQZERO(world->info.frame_budget)) {
+        return;
+    }
+
+    ecs_entity_t *systems = ecs_vec_first_t(&pq->systems, ecs_entity_t);
+    ecs_pipeline_op_t *op = pq->cur_op;
+    int32_t i, end = op->offset + op->count;
+    double cost = 0;
+    for (i = pq->cur_i; i < end; i ++) {
+        ecs_system_t *sys = flecs_pipeline_get_system(world, systems[i]);
+        if (sys->skip) {
+            continue;
+        }
+
+        if (!flecs_pipeline_defer(world, pq, sys, 
+            cost + (double)sys->time_cost, delta_time)) 
+        {
+            cost += (double)sys->time_cost;
+        }
+    }
+}
+
+/* Returns whether frame budget scheduler skips system in current frame */
+static
+bool flecs_pipeline_skip(
+    const ecs_pipeline_state_t *pq,
+    const ecs_system_t *sys)
+{
+    return pq->decimated && sys->skip;
+}
+
+/* Returns delta time for system, including time of frames it skipped */
+static
+ecs_ftime_t flecs_pipeline_delta_time(
+    const ecs_pipeline_state_t *pq,
+    const ecs_system_t *sys,
+    ecs_ftime_t delta_time)
+{
+    if (pq->decimated) {
+        return delta_time + sys->delta_time_skipped;
+    }
+    return delta_time;
+}
+
+/* Returns whether system already ran while the last sync point was merged */
+static
+bool flecs_pipeline_overlapped(
+    const ecs_pipeline_state_t *pq,
+    const ecs_system_t *sys)
+{
+    ecs_system_t **systems = ecs_vec_first_t(
+        &pq->overlap_systems, ecs_system_t*);
+    int32_t i, count = ecs_vec_count(&pq->overlap_systems);
+    for (i = 0; i < count; i ++) {
+        if (systems[i] == sys) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 int32_t flecs_run_pipeline_ops(
     ecs_world_t* world,
     ecs_stage_t* stage,
@@ -56238,6 +62013,18 @@ int32_t flecs_run_pipeline_ops(
     ecs_entity_t* systems = ecs_vec_first_t(&pq->systems, ecs_entity_t);
     int32_t ran_since_merge = i - op->offset;
 
+    /* Workers claim tasks for multi threaded systems from shared counters. In
+     * deterministic mode each worker processes a fixed part of the data, so
+     * that the order of the commands in each stage doesn't depend on timing. */
+    ecs_worker_tasks_t *tasks = NULL;
+    if (stage_count > 1 && (world->flags & EcsWorldMultiThreaded) &&
+        !(world->flags & EcsWorldDeterministic)) 
+    {
+        tasks = ecs_vec_first_t(&pq->tasks, ecs_worker_tasks_t);
+    }
+
+    int32_t first = i;
+
     for (; i < count; i++) {
         ecs_entity_t system = systems[i];
         const EcsPoly* poly = ecs_get_pair(world, system, EcsPoly, EcsSystem);
@@ -56249,6 +62036,19 @@ int32_t flecs_run_pipeline_ops(
          * changes during a merge. */
         if (stage_index == 0) {
             sys->last_frame = world->info.frame_count_total + 1;
+
+            /* Only the main thread runs systems in this op, so the budget can 
+             * be checked right before the system runs. */
+            if (stage_count == 1 || !(world->flags & EcsWorldMultiThreaded)) {
+                if (ECS_NEQZERO(world->info.frame_budget)) {
+                    flecs_pipeline_defer(world, pq, sys, 
+                        (double)sys->time_cost, delta_time);
+                }
+            }
+
+            if (!flecs_pipeline_skip(pq, sys)) {
+                sys->frames_skipped = 0;
+            }
         }
 
         ecs_stage_t* s = NULL;
@@ -56258,10 +62058,40 @@ int32_t flecs_run_pipeline_ops(
             s = stage;
         }
 
-        flecs_run_intern(world, s, system, sys, stage_index,
-            stage_count, delta_time, NULL);
+        int32_t *tasks_claimed = NULL;
+        if (tasks) {
+            /* Since a worker can process any part of the data matched by a
+             * system, systems that access the same data as this system must 
+             * have been completed by all workers before it can start. Systems
+             * that ran before the current sync point have already completed. */
+            ecs_system_deps_t *deps = ecs_vec_get_t(
+                &pq->system_deps, ecs_system_deps_t, i);
+            int32_t *dep = ecs_vec_first_t(&pq->deps, int32_t);
+            int32_t d, dep_end = deps->offset + deps->count;
+            for (d = deps->offset; d < dep_end; d ++) {
+                if (dep[d] >= first) {
+                    flecs_sync_wait(world, world->sync_cond, 
+                        &tasks[dep[d]].finished, stage_count);
+                }
+            }
+            tasks_claimed = &tasks[i].claimed;
+        }
+
+        if (!flecs_pipeline_overlapped(pq, sys) && 
+            !flecs_pipeline_skip(pq, sys)) 
+        {
+            flecs_run_intern(world, s, system, sys, stage_index,
+                stage_count, flecs_pipeline_delta_time(pq, sys, delta_time), 
+                NULL, tasks_claimed);
+            ecs_os_linc(&world->info.systems_ran_frame);
+        }
+
+        if (tasks) {
+            if (ecs_os_ainc(&tasks[i].finished) == stage_count) {
+                flecs_sync_wake(world, world->sync_cond);
+            }
+        }
 
-        ecs_os_linc(&world->info.systems_ran_frame);
         ran_since_merge++;
 
         if (ran_since_merge == op->count) {
@@ -56273,6 +62103,149 @@ int32_t flecs_run_pipeline_ops(
     return i;
 }
 
+/* Returns whether system can run while commands that assign the components in
+ * ids are merged. This is the case if the system only reads components, and 
+ * doesn't read any of the components in ids. */
+static
+bool flecs_pipeline_system_overlaps(
+    const ecs_world_t *world,
+    const ecs_system_t *sys,
+    const ecs_vec_t *ids)
+{
+    if (sys->tick_source) {
+        /* Tick source is fetched from storage */
+        return false;
+    }
+
+    const ecs_query_t *q = sys->query;
+    if (!(q->flags & EcsQueryMatchThis)) {
+        /* Systems without $this terms only run on the main thread */
+        return false;
+    }
+
+    const ecs_id_t *id_ptr = ecs_vec_first_t(ids, ecs_id_t);
+    int32_t t, i, id_count = ecs_vec_count(ids);
+    for (t = 0; t < q->term_count; t ++) {
+        const ecs_term_t *term = &q->terms[t];
+        bool write = false;
+        if (!flecs_pipeline_term_access(world, term, &write)) {
+            continue;
+        }
+
+        if (write) {
+            return false;
+        }
+
+        ecs_id_t id = term->id;
+        if (id == EcsWildcard || id == EcsAny) {
+            if (id_count) {
+                return false;
+            }
+        }
+
+        for (i = 0; i < id_count; i ++) {
+            if (ecs_id_match(id_ptr[i], id)) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/* Start systems of the next operation on the workers if they can run while the
+ * main thread merges the commands of the current operation. Systems are only
+ * started if they don't depend on earlier systems in the operation, so that 
+ * they see the same data as when they run in schedule order. Returns whether
+ * systems were started. */
+static
+bool flecs_pipeline_overlap_begin(
+    ecs_world_t *world,
+    ecs_pipeline_state_t *pq)
+{
+    ecs_vec_clear(&pq->overlap_systems);
+
+    if (!(world->flags & EcsWorldMergeOverlap) || 
+         (world->flags & EcsWorldDeterministic)) 
+    {
+        return false;
+    }
+
+    ecs_pipeline_op_t *op = pq->cur_op + 1;
+    if (op > ecs_vec_last_t(&pq->ops, ecs_pipeline_op_t)) {
+        return false;
+    }
+
+    if (!op->multi_threaded || op->immediate) {
+        return false;
+    }
+
+    ecs_vec_clear(&pq->overlap_ids);
+    if (!flecs_stage_cmds_assign_only(world, &pq->overlap_ids)) {
+        return false;
+    }
+
+    ecs_entity_t *systems = ecs_vec_first_t(&pq->systems, ecs_entity_t);
+    ecs_system_deps_t *deps = ecs_vec_first_t(
+        &pq->system_deps, ecs_system_deps_t);
+    ecs_worker_tasks_t *tasks = ecs_vec_first_t(
+        &pq->tasks, ecs_worker_tasks_t);
+    int32_t i, end = op->offset + op->count;
+    for (i = op->offset; i < end; i ++) {
+        if (deps[i].count) {
+            continue;
+        }
+
+        ecs_system_t *sys = flecs_pipeline_get_system(world, systems[i]);
+        if (flecs_pipeline_skip(pq, sys)) {
+            continue;
+        }
+
+        if (!flecs_pipeline_system_overlaps(world, sys, &pq->overlap_ids)) {
+            continue;
+        }
+
+        ecs_vec_append_t(&world->allocator, &pq->overlap_systems, 
+            ecs_system_t*)[0] = sys;
+        tasks[i].claimed = 0;
+    }
+
+    if (!ecs_vec_count(&pq->overlap_systems)) {
+        return false;
+    }
+
+    pq->overlapping = true;
+    flecs_stage_merge_overlap_begin(world);
+    flecs_signal_workers(world);
+
+    return true;
+}
+
+void flecs_run_pipeline_overlap(
+    ecs_world_t* world,
+    ecs_stage_t* stage,
+    int32_t stage_index,
+    int32_t stage_count,
+    ecs_ftime_t delta_time)
+{
+    ecs_pipeline_state_t* pq = world->pq;
+    ecs_entity_t* systems = ecs_vec_first_t(&pq->systems, ecs_entity_t);
+    ecs_worker_tasks_t *tasks = ecs_vec_first_t(
+        &pq->tasks, ecs_worker_tasks_t);
+    ecs_pipeline_op_t *op = pq->cur_op + 1;
+    int32_t i, end = op->offset + op->count;
+
+    for (i = op->offset; i < end; i ++) {
+        ecs_system_t *sys = flecs_pipeline_get_system(world, systems[i]);
+        if (flecs_pipeline_overlapped(pq, sys)) {
+            flecs_run_intern(world, stage, systems[i], sys, stage_index,
+                stage_count, flecs_pipeline_delta_time(pq, sys, delta_time), 
+                NULL, &tasks[i].claimed);
+            ecs_os_linc(&world->info.systems_ran_frame);
+        }
+    }
+}
+
 void flecs_run_pipeline(
     ecs_world_t *world,
     ecs_pipeline_state_t *pq,
@@ -56297,6 +62270,9 @@ void flecs_run_pipeline(
     // Update the pipeline before waking the workers.
     flecs_pipeline_update(world, pq, true);
 
+    // Decide which systems run this frame if a frame budget is set.
+    flecs_pipeline_schedule(world, pq, delta_time);
+
     // If there are no operations to execute in the pipeline bail early,
     // no need to wake the workers since they have nothing to do.
     while (pq->cur_op != NULL) {
@@ -56318,6 +62294,13 @@ void flecs_run_pipeline(
         ecs_assert(world->workers_waiting == 0, ECS_INTERNAL_ERROR, NULL);
 
         if (op_multi_threaded) {
+            /* Reset task counters before workers start claiming tasks */
+            ecs_allocator_t *a = &world->allocator;
+            ecs_vec_set_min_count_zeromem_t(a, &pq->tasks, ecs_worker_tasks_t,
+                ecs_vec_count(&pq->systems));
+            ecs_os_memset_n(ecs_vec_get_t(&pq->tasks, ecs_worker_tasks_t, 
+                pq->cur_op->offset), 0, ecs_worker_tasks_t, pq->cur_op->count);
+            flecs_pipeline_defer_op(world, pq, delta_time);
             flecs_signal_workers(world);
         }
 
@@ -56351,7 +62334,24 @@ void flecs_run_pipeline(
                 pq->cur_op->commands_enqueued += ecs_vec_count(&s->cmd->queue);
             }
 
+            bool overlapped = false;
+            if (op_multi_threaded && 
+                flecs_pipeline_overlap_begin(world, pq)) 
+            {
+                flecs_stage_merge_overlap(world);
+                flecs_wait_for_sync(world);
+                pq->overlapping = false;
+                flecs_stage_merge_overlap_end(world);
+                overlapped = true;
+            } else if (op_multi_threaded) {
+                flecs_workers_merge(world);
+            }
+
             ecs_readonly_end(world);
+
+            if (overlapped) {
+                flecs_stage_merge_overlap_restore(world);
+            }
             if (measure_time) {
                 pq->cur_op->time_spent += ecs_time_measure(&mt);
             }
@@ -56443,7 +62443,9 @@ bool ecs_progress(
     const EcsPipeline *p = ecs_get(world, world->pipeline, EcsPipeline);
     ecs_check(p != NULL, ECS_INVALID_OPERATION,
         "pipeline entity is missing flecs.pipeline.Pipeline component");
+    ecs_os_perf_trace_push("flecs.progress");
     flecs_workers_progress(world, p->state, delta_time);
+    ecs_os_perf_trace_pop("flecs.progress");
     ecs_log_pop_3();
 
     ecs_frame_end(world);
@@ -56485,6 +62487,17 @@ error:
     return;
 }
 
+void ecs_set_frame_budget(
+    ecs_world_t *world,
+    ecs_ftime_t budget)
+{
+    flecs_poly_assert(world, ecs_world_t);
+    ecs_check(budget >= 0, ECS_INVALID_PARAMETER, NULL);
+    world->info.frame_budget = budget;
+error:
+    return;
+}
+
 ecs_entity_t ecs_get_pipeline(
     const ecs_world_t *world)
 {
@@ -56640,6 +62653,84 @@ void FlecsPipelineImport(
 
 #ifdef FLECS_PIPELINE
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/* Read counter that is modified by other threads */
+static
+int32_t flecs_sync_load(
+    const int32_t *value)
+{
+#if defined(__GNUC__)
+    return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+#elif defined(_MSC_VER) && defined(_M_ARM64)
+    return (int32_t)__ldar32((volatile unsigned __int32*)value);
+#elif defined(_MSC_VER)
+    /* Interlocked operations are full barriers */
+    return (int32_t)_InterlockedOr((volatile long*)value, 0);
+#else
+    return *(const volatile int32_t*)value;
+#endif
+}
+
+/* Tell the CPU that the thread is spinning, which reduces power usage and
+ * frees up resources for a hyperthread running on the same core. */
+static
+void flecs_sync_pause(void) {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    _mm_pause();
+#elif defined(_MSC_VER) && (defined(_M_ARM64) || defined(_M_ARM))
+    __yield();
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_ia32_pause();
+#elif defined(__GNUC__) && (defined(__aarch64__) || defined(__arm__))
+    __asm__ __volatile__("yield");
+#endif
+}
+
+/* Wait until counter reaches expected value. Counters are only modified with
+ * atomic operations, followed by a call to flecs_sync_wake. A thread first
+ * polls the counter, which avoids a mutex round trip and sleeping on the cond
+ * for sync points that complete quickly. */
+void flecs_sync_wait(
+    ecs_world_t *world,
+    ecs_os_cond_t cond,
+    int32_t *value,
+    int32_t expect)
+{
+    int32_t i;
+    for (i = 0; i < FLECS_SYNC_SPIN_COUNT; i ++) {
+        if (flecs_sync_load(value) == expect) {
+            return;
+        }
+        flecs_sync_pause();
+    }
+
+    /* Register as sleeping before testing the counter while holding the lock,
+     * so that a thread that modifies the counter after the test is guaranteed
+     * to see the sleeping thread, and signals the cond. */
+    ecs_os_mutex_lock(world->sync_mutex);
+    ecs_os_ainc(&world->workers_sleeping);
+    while (flecs_sync_load(value) != expect) {
+        ecs_os_cond_wait(cond, world->sync_mutex);
+    }
+    ecs_os_adec(&world->workers_sleeping);
+    ecs_os_mutex_unlock(world->sync_mutex);
+}
+
+/* Wake up threads blocked in flecs_sync_wait, if any */
+void flecs_sync_wake(
+    ecs_world_t *world,
+    ecs_os_cond_t cond)
+{
+    if (flecs_sync_load(&world->workers_sleeping)) {
+        ecs_os_mutex_lock(world->sync_mutex);
+        ecs_os_cond_broadcast(cond);
+        ecs_os_mutex_unlock(world->sync_mutex);
+    }
+}
+
 /* Synchronize workers */
 static
 void flecs_sync_worker(
@@ -56650,16 +62741,46 @@ void flecs_sync_worker(
         return;
     }
 
+    /* Main thread can't signal workers before all workers are waiting, so the
+     * epoch can't change between loading it and signaling the main thread. */
+    int32_t epoch = flecs_sync_load(&world->sync_epoch);
+
     /* Signal that thread is waiting */
-    ecs_os_mutex_lock(world->sync_mutex);
-    if (++world->workers_waiting == (stage_count - 1)) {
+    if (ecs_os_ainc(&world->workers_waiting) == (stage_count - 1)) {
         /* Only signal main thread when all threads are waiting */
-        ecs_os_cond_signal(world->sync_cond);
+        flecs_sync_wake(world, world->sync_cond);
     }
 
     /* Wait until main thread signals that thread can continue */
-    ecs_os_cond_wait(world->worker_cond, world->sync_mutex);
-    ecs_os_mutex_unlock(world->sync_mutex);
+    flecs_sync_wait(world, world->worker_cond, &world->sync_epoch, epoch + 1);
+}
+
+/* Bind calling thread to CPU and NUMA node */
+static
+void flecs_thread_set_affinity(
+    int32_t stage_id,
+    int32_t cpu,
+    int32_t numa_node)
+{
+    if (!ecs_os_has_thread_affinity()) {
+        ecs_warn("worker %d: cannot set affinity: thread_set_affinity_ not "
+            "implemented by OS API", stage_id);
+        return;
+    }
+
+    if (ecs_os_thread_set_affinity(cpu, numa_node)) {
+        ecs_warn("worker %d: failed to set affinity (cpu %d, numa node %d)",
+            stage_id, cpu, numa_node);
+    }
+}
+
+/* Restore affinity of calling thread */
+static
+void flecs_thread_reset_affinity(void)
+{
+    if (ecs_os_api.thread_reset_affinity_) {
+        ecs_os_thread_reset_affinity();
+    }
 }
 
 /* Worker thread */
@@ -56673,23 +62794,42 @@ void* flecs_worker(void *arg) {
 
     ecs_dbg_2("worker %d: start", stage->id);
 
+    if (stage->cpu != -1 || stage->numa_node != -1) {
+        flecs_thread_set_affinity(stage->id, stage->cpu, stage->numa_node);
+    }
+
     /* Start worker, increase counter so main thread knows how many
      * workers are ready */
     ecs_os_mutex_lock(world->sync_mutex);
     world->workers_running ++;
+    int32_t epoch = flecs_sync_load(&world->sync_epoch);
+    bool quit = world->flags & EcsWorldQuitWorkers;
+    ecs_os_mutex_unlock(world->sync_mutex);
 
-    if (!(world->flags & EcsWorldQuitWorkers)) {
-        ecs_os_cond_wait(world->worker_cond, world->sync_mutex);
+    if (!quit) {
+        flecs_sync_wait(
+            world, world->worker_cond, &world->sync_epoch, epoch + 1);
     }
 
-    ecs_os_mutex_unlock(world->sync_mutex);
-
     while (!(world->flags & EcsWorldQuitWorkers)) {
+        if (world->workers_merge) {
+            ecs_dbg_3("worker %d: merge", stage->id);
+            flecs_stage_merge_parallel(world, stage);
+            flecs_sync_worker(world);
+            continue;
+        }
+
         ecs_entity_t old_scope = ecs_set_scope((ecs_world_t*)stage, 0);
 
-        ecs_dbg_3("worker %d: run", stage->id);
-        flecs_run_pipeline_ops(world, stage, stage->id, world->stage_count, 
-            world->info.delta_time);
+        if (world->pq->overlapping) {
+            ecs_dbg_3("worker %d: run while merging", stage->id);
+            flecs_run_pipeline_overlap(world, stage, stage->id, 
+                world->stage_count, world->info.delta_time);
+        } else {
+            ecs_dbg_3("worker %d: run", stage->id);
+            flecs_run_pipeline_ops(world, stage, stage->id, 
+                world->stage_count, world->info.delta_time);
+        }
 
         ecs_set_scope((ecs_world_t*)stage, old_scope);
 
@@ -56736,12 +62876,19 @@ void flecs_create_worker_threads(
 static
 void flecs_start_workers(
     ecs_world_t *world,
-    int32_t threads)
+    const ecs_threads_desc_t *desc)
 {
+    int32_t i, threads = desc->threads;
     ecs_set_stage_count(world, threads);
 
     ecs_assert(ecs_get_stage_count(world) == threads, ECS_INTERNAL_ERROR, NULL);
 
+    for (i = 0; i < threads; i ++) {
+        ecs_stage_t *stage = world->stages[i];
+        stage->cpu = desc->cpus ? desc->cpus[i] : -1;
+        stage->numa_node = desc->numa_nodes ? desc->numa_nodes[i] : -1;
+    }
+
     if (!ecs_using_task_threads(world)) {
         flecs_create_worker_threads(world);
     }
@@ -56780,21 +62927,37 @@ void flecs_wait_for_sync(
 
     ecs_dbg_3("#[bold]pipeline: waiting for worker sync");
 
-    ecs_os_mutex_lock(world->sync_mutex);
-    if (world->workers_waiting != (stage_count - 1)) {
-        ecs_os_cond_wait(world->sync_cond, world->sync_mutex);
-    }
-
-    /* We shouldn't have been signalled unless all workers are waiting on sync */
-    ecs_assert(world->workers_waiting == (stage_count - 1), 
-        ECS_INTERNAL_ERROR, NULL);
+    flecs_sync_wait(world, world->sync_cond, 
+        &world->workers_waiting, stage_count - 1);
 
+    /* Workers don't modify the counter until they're signaled again */
     world->workers_waiting = 0;
-    ecs_os_mutex_unlock(world->sync_mutex);
 
     ecs_dbg_3("#[bold]pipeline: workers synced");
 }
 
+/* Apply commands that don't depend on other stages on the worker threads */
+void flecs_workers_merge(
+    ecs_world_t *world)
+{
+    int32_t stage_count = ecs_get_stage_count(world);
+    if (stage_count <= 1) {
+        return;
+    }
+
+    if (!flecs_stage_merge_parallel_begin(world)) {
+        return;
+    }
+
+    world->workers_merge = true;
+    flecs_signal_workers(world);
+    flecs_stage_merge_parallel(world, world->stages[0]);
+    flecs_wait_for_sync(world);
+    world->workers_merge = false;
+
+    flecs_stage_merge_parallel_end(world);
+}
+
 /* Signal workers that they can start/resume work */
 void flecs_signal_workers(
     ecs_world_t *world)
@@ -56805,9 +62968,8 @@ void flecs_signal_workers(
     }
 
     ecs_dbg_3("#[bold]pipeline: signal workers");
-    ecs_os_mutex_lock(world->sync_mutex);
-    ecs_os_cond_broadcast(world->worker_cond);
-    ecs_os_mutex_unlock(world->sync_mutex);
+    ecs_os_ainc(&world->sync_epoch);
+    flecs_sync_wake(world, world->worker_cond);
 }
 
 void flecs_join_worker_threads(
@@ -56877,9 +63039,10 @@ void flecs_workers_progress(
 static
 void flecs_set_threads_internal(
     ecs_world_t *world,
-    int32_t threads,
-    bool use_task_api)
+    const ecs_threads_desc_t *desc)
 {
+    int32_t threads = desc->threads;
+    bool use_task_api = desc->task_threads;
     ecs_assert(threads <= 1 || (use_task_api 
         ? ecs_os_has_task_support() 
         : ecs_os_has_threading()), 
@@ -56887,8 +63050,38 @@ void flecs_set_threads_internal(
 
     int32_t stage_count = ecs_get_stage_count(world);
     bool worker_method_changed = (use_task_api != world->workers_use_task_api);
+    bool affinity = desc->cpus || desc->numa_nodes;
+
+    /* Restart workers that are bound to a CPU or NUMA node, so they don't
+     * keep the affinity when it is no longer configured. */
+    bool had_affinity = false;
+    int32_t i;
+    for (i = 1; i < stage_count; i ++) {
+        ecs_stage_t *stage = world->stages[i];
+        had_affinity |= stage->cpu != -1 || stage->numa_node != -1;
+    }
 
-    if ((stage_count != threads) || worker_method_changed) {
+    /* Restore calling thread before applying new settings, so it doesn't keep
+     * a CPU or NUMA node that is no longer configured. This also restores the
+     * calling thread when workers are stopped by ecs_fini. */
+    if (world->main_affinity_set) {
+        flecs_thread_reset_affinity();
+        world->main_affinity_set = false;
+    }
+
+    if (affinity && threads) {
+        /* Settings for calling thread are applied immediately */
+        int32_t cpu = desc->cpus ? desc->cpus[0] : -1;
+        int32_t numa_node = desc->numa_nodes ? desc->numa_nodes[0] : -1;
+        if (cpu != -1 || numa_node != -1) {
+            flecs_thread_set_affinity(0, cpu, numa_node);
+            world->main_affinity_set = true;
+        }
+    }
+
+    if ((stage_count != threads) || worker_method_changed || affinity ||
+        had_affinity) 
+    {
         /* Stop existing threads */
         if (stage_count > 1) {
             flecs_join_worker_threads(world);
@@ -56912,7 +63105,7 @@ void flecs_set_threads_internal(
             world->worker_cond = ecs_os_cond_new();
             world->sync_cond = ecs_os_cond_new();
             world->sync_mutex = ecs_os_mutex_new();
-            flecs_start_workers(world, threads);
+            flecs_start_workers(world, desc);
         }
     }
 }
@@ -56923,14 +63116,38 @@ void ecs_set_threads(
     ecs_world_t *world,
     int32_t threads)
 {
-    flecs_set_threads_internal(world, threads, false /* use thread API */);
+    flecs_set_threads_internal(world, &(ecs_threads_desc_t){
+        .threads = threads, .task_threads = false /* use thread API */ });
 }
 
 void ecs_set_task_threads(
     ecs_world_t *world,
     int32_t task_threads)
 {
-    flecs_set_threads_internal(world, task_threads, true /* use task API */);
+    flecs_set_threads_internal(world, &(ecs_threads_desc_t){
+        .threads = task_threads, .task_threads = true /* use task API */ });
+}
+
+void ecs_set_threads_w_desc(
+    ecs_world_t *world,
+    const ecs_threads_desc_t *desc)
+{
+    ecs_check(desc != NULL, ECS_INVALID_PARAMETER, NULL);
+    flecs_set_threads_internal(world, desc);
+error:
+    return;
+}
+
+void ecs_set_merge_overlap(
+    ecs_world_t *world,
+    bool enable)
+{
+    flecs_poly_assert(world, ecs_world_t);
+    ecs_check(!(world->flags & EcsWorldReadonly), ECS_INVALID_OPERATION,
+        "cannot change merge overlap while world is in readonly mode");
+    ECS_BIT_COND(world->flags, EcsWorldMergeOverlap, enable);
+error:
+    return;
 }
 
 bool ecs_using_task_threads(
@@ -65735,6 +71952,8 @@ void ecs_world_stats_get(
     ECS_COUNTER_RECORD(&s->commands.discard_count, t, world->info.cmd.discard_count);
     ECS_COUNTER_RECORD(&s->commands.batched_entity_count, t, world->info.cmd.batched_entity_count);
     ECS_COUNTER_RECORD(&s->commands.batched_count, t, world->info.cmd.batched_command_count);
+    ECS_COUNTER_RECORD(&s->commands.folded_count, t, world->info.cmd.folded_count);
+    ECS_COUNTER_RECORD(&s->commands.queue_bytes, t, world->info.cmd.queue_bytes);
 
     int64_t outstanding_allocs = ecs_os_api_malloc_count + 
         ecs_os_api_calloc_count - ecs_os_api_free_count;
@@ -65875,6 +72094,17 @@ bool ecs_system_stats_get(
 
     ECS_COUNTER_RECORD(&s->time_spent, t, ptr->time_spent);
 
+#ifdef FLECS_PERF_COUNTERS
+    ecs_perf_counters_t counters;
+    if (ecs_system_perf_counters_get(world, system, &counters)) {
+        ECS_COUNTER_RECORD(&s->cycles, t, counters.cycles);
+        ECS_COUNTER_RECORD(&s->instructions, t, counters.instructions);
+        ECS_COUNTER_RECORD(&s->l1d_misses, t, counters.l1d_misses);
+        ECS_COUNTER_RECORD(&s->llc_misses, t, counters.llc_misses);
+        ECS_COUNTER_RECORD(&s->branch_misses, t, counters.branch_misses);
+    }
+#endif
+
     s->task = !(ptr->query->flags & EcsQueryMatchThis);
 
     return true;
@@ -66183,6 +72413,8 @@ void ecs_world_stats_log(
     flecs_counter_print("discarded commands", t, &s->commands.discard_count);
     flecs_counter_print("batched entities", t, &s->commands.batched_entity_count);
     flecs_counter_print("batched commands", t, &s->commands.batched_count);
+    flecs_counter_print("folded commands", t, &s->commands.folded_count);
+    flecs_counter_print("command queue bytes", t, &s->commands.queue_bytes);
     ecs_trace("");
     
 error:
@@ -66537,6 +72769,367 @@ ecs_mixins_t ecs_system_t_mixins = {
 
 /* -- Public API -- */
 
+/* Record time spent in system. The frame budget scheduler uses the moving 
+ * average of the time per run to predict the cost of a system. Workers only
+ * run part of a multi threaded system, so cost is only measured for the main
+ * thread, which approximates the time it takes for all workers to finish. */
+static
+void flecs_system_measure(
+    ecs_system_t *system_data,
+    ecs_time_t *time_start,
+    bool measure_time,
+    bool measure_cost)
+{
+    ecs_ftime_t t = (ecs_ftime_t)ecs_time_measure(time_start);
+    if (measure_time) {
+        system_data->time_spent += t;
+    }
+
+    if (measure_cost) {
+        if (ECS_EQZERO(system_data->time_cost)) {
+            system_data->time_cost = t;
+        } else {
+            system_data->time_cost += 
+                (t - system_data->time_cost) * (ecs_ftime_t)0.1;
+        }
+    }
+}
+
+#ifdef FLECS_PERF_COUNTERS
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define FLECS_PERF_COUNTER_COUNT (5)
+
+/* Performance counters of a stage. Counters measure the thread that opened
+ * them, so they're reopened when a stage is ran by a different thread, which
+ * happens when task threads are used. */
+typedef struct ecs_system_perf_t {
+    int fd;                                    /* Group leader, -1 if none */
+    int fds[FLECS_PERF_COUNTER_COUNT];         /* -1 if not supported */
+    int32_t index[FLECS_PERF_COUNTER_COUNT];   /* Position in group read */
+    int32_t count;                             /* Number of opened counters */
+    pid_t thread;                              /* Thread that opened counters */
+    ecs_map_t systems;                         /* map<system, counters> */
+} ecs_system_perf_t;
+
+/* Same order as the members of ecs_perf_counters_t */
+static const struct {
+    uint32_t type;
+    uint64_t config;
+} flecs_system_perf_events[FLECS_PERF_COUNTER_COUNT] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | 
+        (PERF_COUNT_HW_CACHE_OP_READ << 8) | 
+        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES }
+};
+
+static
+void flecs_system_perf_close(
+    ecs_system_perf_t *perf)
+{
+    int32_t i;
+    for (i = 0; i < FLECS_PERF_COUNTER_COUNT; i ++) {
+        if (perf->fds[i] != -1) {
+            close(perf->fds[i]);
+        }
+        perf->fds[i] = -1;
+        perf->index[i] = -1;
+    }
+
+    perf->fd = -1;
+    perf->count = 0;
+}
+
+/* Open counters for the current thread as a single group, so that they can be
+ * read with a single syscall. Counters that can't be opened are skipped. */
+static
+void flecs_system_perf_open(
+    ecs_system_perf_t *perf)
+{
+    flecs_system_perf_close(perf);
+
+    int32_t i;
+    for (i = 0; i < FLECS_PERF_COUNTER_COUNT; i ++) {
+        struct perf_event_attr attr;
+        ecs_os_zeromem(&attr);
+        attr.size = sizeof(attr);
+        attr.type = flecs_system_perf_events[i].type;
+        attr.config = flecs_system_perf_events[i].config;
+        attr.read_format = PERF_FORMAT_GROUP;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, perf->fd, 0);
+        if (fd == -1) {
+            continue;
+        }
+
+        if (perf->fd == -1) {
+            perf->fd = fd;
+        }
+
+        perf->fds[i] = fd;
+        perf->index[i] = perf->count ++;
+    }
+
+    /* Stages can open counters from multiple threads, only warn once */
+    static int32_t warned = 0;
+    if (perf->fd == -1 && (ecs_os_ainc(&warned) == 1)) {
+        ecs_warn("perf_event_open failed, system counters disabled (%s)",
+            ecs_os_strerror(errno));
+    }
+
+    perf->thread = (pid_t)syscall(SYS_gettid);
+}
+
+static
+bool flecs_system_perf_read(
+    ecs_system_perf_t *perf,
+    uint64_t *values)
+{
+    if (perf->fd == -1) {
+        return false;
+    }
+
+    uint64_t data[1 + FLECS_PERF_COUNTER_COUNT];
+    ssize_t size = ECS_SIZEOF(uint64_t) * (1 + perf->count);
+    if (read(perf->fd, data, (size_t)size) != size) {
+        return false;
+    }
+
+    int32_t i;
+    for (i = 0; i < FLECS_PERF_COUNTER_COUNT; i ++) {
+        int32_t index = perf->index[i];
+        values[i] = index == -1 ? 0 : data[1 + index];
+    }
+
+    return true;
+}
+
+/* Read counters before a system runs. Returns NULL if counters aren't 
+ * available for the thread. */
+static
+ecs_system_perf_t* flecs_system_perf_begin(
+    ecs_stage_t *stage,
+    uint64_t *start)
+{
+    ecs_system_perf_t *perf = stage->perf;
+    if (!perf) {
+        perf = stage->perf = ecs_os_calloc_t(ecs_system_perf_t);
+        ecs_map_init(&perf->systems, NULL);
+        int32_t i;
+        for (i = 0; i < FLECS_PERF_COUNTER_COUNT; i ++) {
+            perf->fds[i] = -1;
+        }
+        flecs_system_perf_open(perf);
+    } else if (perf->thread != (pid_t)syscall(SYS_gettid)) {
+        flecs_system_perf_open(perf);
+    }
+
+    if (!flecs_system_perf_read(perf, start)) {
+        return NULL;
+    }
+
+    return perf;
+}
+
+/* Add counter deltas for system to the stage */
+static
+void flecs_system_perf_end(
+    ecs_system_perf_t *perf,
+    ecs_entity_t system,
+    const uint64_t *start)
+{
+    uint64_t stop[FLECS_PERF_COUNTER_COUNT];
+    if (!flecs_system_perf_read(perf, stop)) {
+        return;
+    }
+
+    ecs_perf_counters_t *counters = ecs_map_ensure_alloc_t(
+        &perf->systems, ecs_perf_counters_t, system);
+    counters->cycles += stop[0] - start[0];
+    counters->instructions += stop[1] - start[1];
+    counters->l1d_misses += stop[2] - start[2];
+    counters->llc_misses += stop[3] - start[3];
+    counters->branch_misses += stop[4] - start[4];
+}
+
+/* Remove counters of deleted system from stages */
+static
+void flecs_system_perf_remove(
+    ecs_world_t *world,
+    ecs_entity_t system)
+{
+    int32_t i, count = world->stage_count;
+    for (i = 0; i < count; i ++) {
+        ecs_system_perf_t *perf = world->stages[i]->perf;
+        if (perf && ecs_map_get(&perf->systems, system)) {
+            ecs_map_remove_free(&perf->systems, system);
+        }
+    }
+}
+
+void flecs_system_perf_free(
+    ecs_system_perf_t *perf)
+{
+    ecs_map_iter_t it = ecs_map_iter(&perf->systems);
+    while (ecs_map_next(&it)) {
+        ecs_os_free(ecs_map_ptr(&it));
+    }
+
+    ecs_map_fini(&perf->systems);
+    flecs_system_perf_close(perf);
+    ecs_os_free(perf);
+}
+
+#endif
+
+/* Keep track of whether the system finalized the iterator, so that it can be
+ * finalized after the fiber returns or is suspended. */
+static
+void flecs_system_fiber_iter_fini(
+    ecs_iter_t *it)
+{
+    /* Safe cast, iterator is first member of fiber state */
+    ecs_system_fiber_t *f = (ecs_system_fiber_t*)it;
+    f->it_active = false;
+    if (f->it_fini) {
+        f->it_fini(it);
+    }
+}
+
+static
+void flecs_system_fiber_main(
+    void *arg)
+{
+    ecs_system_t *system_data = arg;
+    ecs_system_fiber_t *f = system_data->fiber;
+    if (system_data->run) {
+        system_data->run(&f->it);
+    } else {
+        system_data->action(&f->it);
+    }
+    f->done = true;
+}
+
+/* Run (or resume) system with time budget. Each time the fiber is resumed a
+ * new iterator is created, as tables can change between frames. Commands are
+ * deferred and merged like they are for regular systems, which means that a
+ * suspended system doesn't keep the stage in deferred mode across frames. */
+static
+ecs_entity_t flecs_run_fiber(
+    ecs_world_t *world,
+    ecs_stage_t *stage,
+    ecs_entity_t system,
+    ecs_system_t *system_data,
+    ecs_ftime_t delta_time,
+    ecs_ftime_t time_elapsed,
+    void *param)
+{
+    ecs_system_fiber_t *f = system_data->fiber;
+    if (!f) {
+        f = system_data->fiber = ecs_os_calloc_t(ecs_system_fiber_t);
+    }
+
+    ecs_os_perf_trace_push(system_data->name);
+
+    ecs_time_t time_start;
+    bool measure_time = ECS_BIT_IS_SET(world->flags, EcsWorldMeasureSystemTime);
+    bool measure_cost = ECS_NEQZERO(world->info.frame_budget);
+    if (measure_time || measure_cost) {
+        ecs_os_get_time(&time_start);
+    }
+
+    ecs_world_t *thread_ctx = world;
+    if (stage) {
+        thread_ctx = stage->thread_ctx;
+    } else {
+        stage = world->stages[0];
+    }
+
+    flecs_poly_assert(stage, ecs_stage_t);
+
+#ifdef FLECS_PERF_COUNTERS
+    uint64_t perf_start[FLECS_PERF_COUNTER_COUNT];
+    ecs_system_perf_t *perf = NULL;
+    if (measure_time) {
+        perf = flecs_system_perf_begin(stage, perf_start);
+    }
+#endif
+
+    f->it = ecs_query_iter(thread_ctx, system_data->query);
+    f->it.system = system;
+    f->it.delta_time = delta_time;
+    f->it.delta_system_time = time_elapsed;
+    f->it.param = param;
+    f->it.ctx = system_data->ctx;
+    f->it.callback_ctx = system_data->callback_ctx;
+    f->it.run_ctx = system_data->run_ctx;
+    f->it.callback = system_data->action;
+    if (system_data->query->flags & EcsQueryMatchNothing) {
+        f->it.next = flecs_default_next_callback; /* Return once */
+    }
+
+    f->it_fini = f->it.fini;
+    f->it.fini = flecs_system_fiber_iter_fini;
+    f->it_active = true;
+
+    flecs_defer_begin(world, stage);
+    ecs_entity_t old_system = flecs_stage_set_system(stage, system);
+
+    if (!f->fiber) {
+        f->fiber = ecs_os_fiber_new(
+            flecs_system_fiber_main, system_data, FLECS_FIBER_STACK_SIZE);
+        f->done = false;
+    }
+
+    ecs_os_get_time(&f->resumed);
+#ifdef FLECS_PERF_TRACE
+    flecs_perf_trace_fiber_enter(&f->trace);
+#endif
+    ecs_os_fiber_resume(f->fiber);
+#ifdef FLECS_PERF_TRACE
+    flecs_perf_trace_fiber_leave(&f->trace);
+#endif
+
+    if (f->done) {
+        ecs_os_fiber_free(f->fiber);
+        f->fiber = 0;
+#ifdef FLECS_PERF_TRACE
+        f->trace.depth = 0;
+#endif
+    }
+
+    if (f->it_active) {
+        ecs_iter_fini(&f->it);
+    }
+
+    flecs_stage_set_system(stage, old_system);
+
+    if (measure_time || measure_cost) {
+        flecs_system_measure(
+            system_data, &time_start, measure_time, measure_cost);
+    }
+
+#ifdef FLECS_PERF_COUNTERS
+    if (perf) {
+        flecs_system_perf_end(perf, system, perf_start);
+    }
+#endif
+
+    flecs_defer_end(world, stage);
+
+    ecs_os_perf_trace_pop(system_data->name);
+
+    return f->it.interrupted_by;
+}
+
 ecs_entity_t flecs_run_intern(
     ecs_world_t *world,
     ecs_stage_t *stage,
@@ -66545,7 +73138,8 @@ ecs_entity_t flecs_run_intern(
     int32_t stage_index,
     int32_t stage_count,    
     ecs_ftime_t delta_time,
-    void *param) 
+    void *param,
+    int32_t *tasks_claimed) 
 {
     flecs_poly_assert(world, ecs_world_t);
     ecs_ftime_t time_elapsed = delta_time;
@@ -66556,6 +73150,13 @@ ecs_entity_t flecs_run_intern(
         param = system_data->ctx;
     }
 
+    /* A suspended system resumes in the next frame, even if its tick source
+     * didn't fire. */
+    if (system_data->fiber && system_data->fiber->fiber) {
+        return flecs_run_fiber(world, stage, system, system_data, 
+            delta_time, time_elapsed, param);
+    }
+
     if (tick_source) {
         const EcsTickSource *tick = ecs_get(world, tick_source, EcsTickSource);
 
@@ -66576,6 +73177,11 @@ ecs_entity_t flecs_run_intern(
         }
     }
 
+    if (ECS_NEQZERO(system_data->time_budget)) {
+        return flecs_run_fiber(world, stage, system, system_data, 
+            delta_time, time_elapsed, param);
+    }
+
     ecs_os_perf_trace_push(system_data->name);
 
     if (ecs_should_log_3()) {
@@ -66586,7 +73192,8 @@ ecs_entity_t flecs_run_intern(
 
     ecs_time_t time_start;
     bool measure_time = ECS_BIT_IS_SET(world->flags, EcsWorldMeasureSystemTime);
-    if (measure_time) {
+    bool measure_cost = !stage_index && ECS_NEQZERO(world->info.frame_budget);
+    if (measure_time || measure_cost) {
         ecs_os_get_time(&time_start);
     }
 
@@ -66599,6 +73206,14 @@ ecs_entity_t flecs_run_intern(
 
     flecs_poly_assert(stage, ecs_stage_t);
 
+#ifdef FLECS_PERF_COUNTERS
+    uint64_t perf_start[FLECS_PERF_COUNTER_COUNT];
+    ecs_system_perf_t *perf = NULL;
+    if (measure_time) {
+        perf = flecs_system_perf_begin(stage, perf_start);
+    }
+#endif
+
     /* Prepare the query iterator */
     ecs_iter_t wit, qit = ecs_query_iter(thread_ctx, system_data->query);
     ecs_iter_t *it = &qit;
@@ -66613,8 +73228,20 @@ ecs_entity_t flecs_run_intern(
 
     flecs_defer_begin(world, stage);
 
+    int32_t chunk_size = system_data->chunk_size;
     if (stage_count > 1 && system_data->multi_threaded) {
-        wit = ecs_worker_iter(it, stage_index, stage_count);
+        if (tasks_claimed) {
+            wit = flecs_worker_steal_iter(
+                it, stage_index, stage_count, tasks_claimed, chunk_size);
+        } else if (chunk_size) {
+            wit = ecs_worker_chunk_iter(
+                it, stage_index, stage_count, chunk_size);
+        } else {
+            wit = ecs_worker_iter(it, stage_index, stage_count);
+        }
+        it = &wit;
+    } else if (chunk_size) {
+        wit = ecs_chunk_iter(it, chunk_size);
         it = &wit;
     }
 
@@ -66653,10 +73280,17 @@ ecs_entity_t flecs_run_intern(
 
     flecs_stage_set_system(stage, old_system);
 
-    if (measure_time) {
-        system_data->time_spent += (ecs_ftime_t)ecs_time_measure(&time_start);
+    if (measure_time || measure_cost) {
+        flecs_system_measure(
+            system_data, &time_start, measure_time, measure_cost);
     }
 
+#ifdef FLECS_PERF_COUNTERS
+    if (perf) {
+        flecs_system_perf_end(perf, system, perf_start);
+    }
+#endif
+
     flecs_defer_end(world, stage);
 
     ecs_os_perf_trace_pop(system_data->name);
@@ -66680,7 +73314,7 @@ ecs_entity_t ecs_run_worker(
 
     return flecs_run_intern(
         world, stage, system, system_data, stage_index, stage_count, 
-        delta_time, param);
+        delta_time, param, NULL);
 }
 
 ecs_entity_t ecs_run(
@@ -66693,7 +73327,7 @@ ecs_entity_t ecs_run(
     ecs_system_t *system_data = flecs_poly_get(world, system, ecs_system_t);
     ecs_assert(system_data != NULL, ECS_INVALID_PARAMETER, NULL);
     return flecs_run_intern(
-        world, stage, system, system_data, 0, 0, delta_time, param);
+        world, stage, system, system_data, 0, 0, delta_time, param, NULL);
 }
 
 /* System deinitialization */
@@ -66714,6 +73348,19 @@ void flecs_system_fini(ecs_system_t *sys) {
     /* Safe cast, type owns name */
     ecs_os_free(ECS_CONST_CAST(char*, sys->name));
 
+    /* If the system is suspended its stack is discarded. Resources that the
+     * system allocated and would have freed after resuming are leaked. */
+    if (sys->fiber) {
+        if (sys->fiber->fiber) {
+            ecs_os_fiber_free(sys->fiber->fiber);
+        }
+        ecs_os_free(sys->fiber);
+    }
+
+#ifdef FLECS_PERF_COUNTERS
+    flecs_system_perf_remove(sys->world, sys->entity);
+#endif
+
     flecs_poly_free(sys, ecs_system_t);
 }
 
@@ -66724,6 +73371,41 @@ void flecs_system_poly_fini(void *sys)
     flecs_system_fini(sys);
 }
 
+static
+int flecs_system_init_budget(
+    ecs_world_t *world,
+    ecs_entity_t entity,
+    ecs_system_t *system,
+    const ecs_system_desc_t *desc)
+{
+    if (ECS_NEQZERO(desc->time_budget)) {
+        system->time_budget = desc->time_budget;
+    }
+
+    if (ECS_EQZERO(system->time_budget)) {
+        return 0;
+    }
+
+    const char *err = NULL;
+    if (system->multi_threaded || system->immediate || system->chunk_size) {
+        err = "cannot be multi_threaded, immediate or use chunk_size";
+    } else if (!system->run && system->query->term_count) {
+        err = "requires a run callback";
+    } else if (!ecs_os_has_fibers()) {
+        err = "requires fiber support (see ecs_os_has_fibers())";
+    }
+
+    if (err) {
+        char *name = ecs_get_path(world, entity);
+        ecs_err("system %s with time_budget %s", name, err);
+        ecs_os_free(name);
+        system->time_budget = 0;
+        return -1;
+    }
+
+    return 0;
+}
+
 static
 int flecs_system_init_timer(
     ecs_world_t *world,
@@ -66817,6 +73499,9 @@ ecs_entity_t ecs_system_init(
 
         system->multi_threaded = desc->multi_threaded;
         system->immediate = desc->immediate;
+        system->chunk_size = desc->chunk_size;
+        system->priority = desc->priority;
+        system->decimation = 1;
 
         system->name = ecs_get_path(world, entity);
 
@@ -66826,6 +73511,12 @@ ecs_entity_t ecs_system_init(
             goto error;
         }
 
+        if (flecs_system_init_budget(world, entity, system, desc)) {
+            ecs_delete(world, entity);
+            ecs_defer_end(world);
+            goto error;
+        }
+
         if (ecs_get_name(world, entity)) {
             ecs_trace("#[green]system#[reset] %s created", 
                 ecs_get_name(world, entity));
@@ -66904,9 +73595,21 @@ ecs_entity_t ecs_system_init(
             system->immediate = desc->immediate;
         }
 
+        if (desc->chunk_size) {
+            system->chunk_size = desc->chunk_size;
+        }
+
+        if (desc->priority) {
+            system->priority = desc->priority;
+        }
+
         if (flecs_system_init_timer(world, entity, desc)) {
             return 0;
         }
+
+        if (flecs_system_init_budget(world, entity, system, desc)) {
+            return 0;
+        }
     }
 
     flecs_poly_modified(world, entity, ecs_system_t);
@@ -66916,6 +73619,87 @@ error:
     return 0;
 }
 
+static
+void flecs_observer_async_system(
+    ecs_iter_t *it)
+{
+    flecs_observer_async_run(it->world, it->ctx, 
+        ecs_stage_get_id(it->world), ecs_get_stage_count(it->world));
+}
+
+static
+void flecs_observer_async_flush_system(
+    ecs_iter_t *it)
+{
+    flecs_observer_async_flush(it->real_world, it->ctx);
+}
+
+ecs_entity_t flecs_observer_async_system_init(
+    ecs_world_t *world,
+    ecs_observer_t *o,
+    ecs_entity_t phase)
+{
+    ecs_system_desc_t desc = {
+        .entity = ecs_entity(world, {
+            .parent = o->entity,
+            .add = ecs_ids(ecs_dependson(phase), phase)
+        }),
+        .run = flecs_observer_async_system,
+        .ctx = o,
+        .multi_threaded = true
+    };
+
+    /* Give the system the component access of the observer, so the pipeline
+     * doesn't run it at the same time as systems that write components the
+     * observer reads, or that read components the observer writes. The terms
+     * have no source, so the system doesn't iterate any entities. */
+    const ecs_query_t *q = o->query;
+    int32_t t, term_count = 0;
+    for (t = 0; t < q->term_count; t ++) {
+        const ecs_term_t *term = &q->terms[t];
+        int16_t inout = term->inout;
+        if (inout == EcsInOutNone || inout == EcsInOutFilter || 
+            term->oper == EcsNot) 
+        {
+            continue;
+        }
+
+        if (inout == EcsInOutDefault) {
+            bool is_shared = !ecs_term_match_this(term) || 
+                !(term->src.id & EcsSelf);
+            inout = is_shared ? EcsIn : EcsInOut;
+        }
+
+        ecs_term_t *dst = &desc.query.terms[term_count ++];
+        dst->id = term->id;
+        dst->src.id = EcsIsEntity;
+        dst->inout = inout;
+    }
+
+    ecs_entity_t entity = ecs_system_init(world, &desc);
+
+    if (!entity) {
+        return 0;
+    }
+
+    /* Processed events are removed by a single threaded system, which runs on
+     * the main thread after the workers that process the queue are done. */
+    ecs_entity_t flush = ecs_system(world, {
+        .entity = ecs_entity(world, {
+            .parent = o->entity,
+            .add = ecs_ids(ecs_dependson(phase), phase)
+        }),
+        .callback = flecs_observer_async_flush_system,
+        .ctx = o
+    });
+
+    if (!flush) {
+        return 0;
+    }
+
+    return entity;
+}
+
 const ecs_system_t* ecs_system_get(
     const ecs_world_t *world,
     ecs_entity_t entity)
@@ -66923,6 +73707,74 @@ const ecs_system_t* ecs_system_get(
     return flecs_poly_get(world, entity, ecs_system_t);
 }
 
+#ifdef FLECS_PERF_COUNTERS
+bool ecs_system_perf_counters_get(
+    const ecs_world_t *world,
+    ecs_entity_t system,
+    ecs_perf_counters_t *result)
+{
+    ecs_check(world != NULL, ECS_INVALID_PARAMETER, NULL);
+    ecs_check(result != NULL, ECS_INVALID_PARAMETER, NULL);
+
+    world = ecs_get_world(world);
+    ecs_os_zeromem(result);
+
+    bool found = false;
+    int32_t i, count = world->stage_count;
+    for (i = 0; i < count; i ++) {
+        ecs_system_perf_t *perf = world->stages[i]->perf;
+        if (!perf) {
+            continue;
+        }
+
+        ecs_perf_counters_t *counters = ecs_map_get_deref(
+            &perf->systems, ecs_perf_counters_t, system);
+        if (!counters) {
+            continue;
+        }
+
+        result->cycles += counters->cycles;
+        result->instructions += counters->instructions;
+        result->l1d_misses += counters->l1d_misses;
+        result->llc_misses += counters->llc_misses;
+        result->branch_misses += counters->branch_misses;
+        found = true;
+    }
+
+    return found;
+error:
+    return false;
+}
+#endif
+
+bool ecs_system_yield(
+    ecs_iter_t *it)
+{
+    ecs_check(it != NULL, ECS_INVALID_PARAMETER, NULL);
+    ecs_check(it->system != 0, ECS_INVALID_PARAMETER, 
+        "iterator is not a system iterator");
+
+    const ecs_system_t *system_data = flecs_poly_get(
+        it->real_world, it->system, ecs_system_t);
+    ecs_check(system_data != NULL, ECS_INVALID_PARAMETER, NULL);
+
+    ecs_system_fiber_t *f = system_data->fiber;
+    if (!f || !f->fiber || it != &f->it) {
+        return false;
+    }
+
+    ecs_time_t t = f->resumed;
+    if (ecs_time_measure(&t) < (double)system_data->time_budget) {
+        return false;
+    }
+
+    ecs_os_fiber_yield(f->fiber);
+
+    return true;
+error:
+    return false;
+}
+
 void FlecsSystemImport(
     ecs_world_t *world)
 {
@@ -70114,6 +76966,12 @@ ecs_query_cache_table_t* flecs_query_cache_table_insert(
     ecs_query_cache_table_t *qt = flecs_bcalloc(&world->allocators.query_table);
     if (table) {
         qt->table_id = table->id;
+
+        /* Enable chunk tracking while the table is matched, as this can't be
+         * done while iterating from a worker thread. */
+        if (cache->query->flags & EcsQueryTrackRowChanges) {
+            flecs_table_get_chunk_ticks(world, table);
+        }
     } else {
         qt->table_id = 0;
     }
@@ -71477,6 +78335,392 @@ void flecs_query_cache_sort_tables(
     }
 }
 
+/**
+ * @file query/read_view.c
+ * @brief Immutable versions of query data for reader threads.
+ * 
+ * A version holds copies of the table columns matched by the view query. The
+ * copies are reference counted, and are shared between versions as long as a
+ * column doesn't change. The view keeps the latest copy for each column, with
+ * the value of the column dirty state at the time it was copied, so only 
+ * columns that were written since the last publish are copied.
+ */
+
+
+/* Reference counted copy of a table column. Buffers can be released by reader
+ * threads after the component is deleted, so the type info that is passed to
+ * the destructor is copied into the buffer. */
+typedef struct ecs_read_buffer_t {
+    int32_t refcount;
+    int32_t count;
+    ecs_type_info_t ti;             /* Copy of type info, if type has dtor */
+} ecs_read_buffer_t;
+
+#define flecs_read_buffer_data(buf)\
+    ECS_OFFSET(buf, ECS_SIZEOF(ecs_read_buffer_t))
+
+/* Latest copies of the columns of a table */
+typedef struct ecs_read_view_table_t {
+    ecs_read_buffer_t **columns;    /* Column buffers, 0 is entity column */
+    int32_t *dirty;                 /* Dirty state of column when copied */
+    int32_t column_count;
+    uint32_t version;               /* Table version when copied */
+    int64_t publish;                /* Last publish in which table matched */
+} ecs_read_view_table_t;
+
+typedef struct ecs_read_version_impl_t {
+    ecs_read_version_t pub;
+    int32_t refcount;
+    ecs_vec_t tables;               /* vector<ecs_read_table_t> */
+    ecs_vec_t fields;               /* vector<const void*> */
+    ecs_vec_t buffers;              /* vector<ecs_read_buffer_t*> */
+} ecs_read_version_impl_t;
+
+struct ecs_read_view_t {
+    ecs_world_t *world;
+    ecs_query_t *query;
+    ecs_map_t tables;               /* map<table_id, ecs_read_view_table_t*> */
+    ecs_read_version_impl_t *current;
+    ecs_os_mutex_t lock;            /* Protects current */
+    int64_t publish_count;
+};
+
+static
+ecs_read_buffer_t* flecs_read_buffer_new(
+    const ecs_type_info_t *ti,
+    const void *src,
+    int32_t count)
+{
+    ecs_size_t size = ti ? ti->size : ECS_SIZEOF(ecs_entity_t);
+    ecs_read_buffer_t *buf = ecs_os_malloc(
+        ECS_SIZEOF(ecs_read_buffer_t) + size * count);
+    buf->refcount = 1;
+    buf->count = count;
+    if (ti && ti->hooks.dtor) {
+        buf->ti = *ti;
+    } else {
+        ecs_os_zeromem(&buf->ti);
+    }
+
+    void *dst = flecs_read_buffer_data(buf);
+    if (ti && ti->hooks.copy_ctor) {
+        ti->hooks.copy_ctor(dst, src, count, ti);
+    } else if (count) {
+        ecs_os_memcpy(dst, src, size * count);
+    }
+
+    return buf;
+}
+
+static
+void flecs_read_buffer_release(
+    ecs_read_buffer_t *buf)
+{
+    if (!buf || ecs_os_adec(&buf->refcount)) {
+        return;
+    }
+
+    const ecs_type_info_t *ti = &buf->ti;
+    if (ti->hooks.dtor) {
+        ti->hooks.dtor(flecs_read_buffer_data(buf), buf->count, ti);
+    }
+
+    ecs_os_free(buf);
+}
+
+static
+void flecs_read_view_table_clear(
+    ecs_read_view_table_t *vt)
+{
+    int32_t i;
+    for (i = 0; i <= vt->column_count; i ++) {
+        flecs_read_buffer_release(vt->columns[i]);
+        vt->columns[i] = NULL;
+    }
+}
+
+static
+void flecs_read_view_table_free(
+    ecs_read_view_table_t *vt)
+{
+    flecs_read_view_table_clear(vt);
+    ecs_os_free(vt->columns);
+    ecs_os_free(vt->dirty);
+    ecs_os_free(vt);
+}
+
+static
+ecs_read_view_table_t* flecs_read_view_ensure_table(
+    ecs_read_view_t *view,
+    ecs_table_t *table)
+{
+    ecs_read_view_table_t **vt_ptr = ecs_map_ensure_ref(
+        &view->tables, ecs_read_view_table_t, table->id);
+    ecs_read_view_table_t *vt = *vt_ptr;
+    int32_t column_count = table->column_count;
+
+    if (vt && vt->column_count != column_count) {
+        flecs_read_view_table_free(vt);
+        vt = NULL;
+    }
+
+    if (!vt) {
+        vt = *vt_ptr = ecs_os_calloc_t(ecs_read_view_table_t);
+        vt->columns = ecs_os_calloc_n(ecs_read_buffer_t*, column_count + 1);
+        vt->dirty = ecs_os_calloc_n(int32_t, column_count + 1);
+        vt->column_count = column_count;
+        vt->version = flecs_get_table_version(view->world, table->id);
+    }
+
+    return vt;
+}
+
+/* Get buffer with the current data of a table column. Column -1 is the entity
+ * column. */
+static
+ecs_read_buffer_t* flecs_read_view_column(
+    ecs_read_version_impl_t *version,
+    ecs_read_view_table_t *vt,
+    ecs_table_t *table,
+    const int32_t *dirty_state,
+    int32_t column)
+{
+    ecs_read_buffer_t *buf = vt->columns[column + 1];
+    int32_t dirty = column >= 0 ? dirty_state[column + 1] : 0;
+    if (!buf || vt->dirty[column + 1] != dirty) {
+        flecs_read_buffer_release(buf);
+
+        int32_t count = ecs_table_count(table);
+        if (column >= 0) {
+            ecs_column_t *c = &table->data.columns[column];
+            buf = flecs_read_buffer_new(c->ti, c->data, count);
+        } else {
+            buf = flecs_read_buffer_new(NULL, table->data.entities, count);
+        }
+
+        vt->columns[column + 1] = buf;
+        vt->dirty[column + 1] = dirty;
+    }
+
+    ecs_os_ainc(&buf->refcount);
+    ecs_vec_append_t(NULL, &version->buffers, ecs_read_buffer_t*)[0] = buf;
+
+    return buf;
+}
+
+static
+void flecs_read_version_release(
+    ecs_read_version_impl_t *version)
+{
+    if (ecs_os_adec(&version->refcount)) {
+        return;
+    }
+
+    ecs_read_buffer_t **buffers = ecs_vec_first(&version->buffers);
+    int32_t i, count = ecs_vec_count(&version->buffers);
+    for (i = 0; i < count; i ++) {
+        flecs_read_buffer_release(buffers[i]);
+    }
+
+    ecs_vec_fini_t(NULL, &version->tables, ecs_read_table_t);
+    ecs_vec_fini_t(NULL, &version->fields, const void*);
+    ecs_vec_fini_t(NULL, &version->buffers, ecs_read_buffer_t*);
+    ecs_os_free(version);
+}
+
+ecs_read_view_t* ecs_read_view_init(
+    ecs_world_t *world,
+    ecs_query_t *query)
+{
+    flecs_poly_assert(world, ecs_world_t);
+    ecs_check(query != NULL, ECS_INVALID_PARAMETER, NULL);
+    ecs_check(query->flags & EcsQueryMatchThis, ECS_INVALID_PARAMETER,
+        "read view query must have terms with $this source");
+    ecs_check(!(query->data_fields & 
+        (query->fixed_fields | query->var_fields)), ECS_INVALID_PARAMETER,
+            "read view query fields with data must have $this source");
+
+    ecs_read_view_t *view = ecs_os_calloc_t(ecs_read_view_t);
+    view->world = world;
+    view->query = query;
+    ecs_map_init(&view->tables, NULL);
+    if (ecs_os_has_threading()) {
+        view->lock = ecs_os_mutex_new();
+    }
+
+    ecs_read_view_publish(view);
+
+    return view;
+error:
+    return NULL;
+}
+
+void ecs_read_view_fini(
+    ecs_read_view_t *view)
+{
+    ecs_check(view != NULL, ECS_INVALID_PARAMETER, NULL);
+
+    ecs_map_iter_t it = ecs_map_iter(&view->tables);
+    while (ecs_map_next(&it)) {
+        flecs_read_view_table_free(ecs_map_ptr(&it));
+    }
+    ecs_map_fini(&view->tables);
+
+    if (view->current) {
+        flecs_read_version_release(view->current);
+    }
+
+    if (view->lock) {
+        ecs_os_mutex_free(view->lock);
+    }
+
+    ecs_os_free(view);
+error:
+    return;
+}
+
+void ecs_read_view_publish(
+    ecs_read_view_t *view)
+{
+    ecs_check(view != NULL, ECS_INVALID_PARAMETER, NULL);
+    ecs_world_t *world = view->world;
+    ecs_check(!(world->flags & EcsWorldReadonly), ECS_INVALID_WHILE_READONLY,
+        NULL);
+
+    ecs_query_t *query = view->query;
+    int8_t f, field_count = query->field_count;
+    int64_t publish = ++ view->publish_count;
+
+    ecs_read_version_impl_t *version = 
+        ecs_os_calloc_t(ecs_read_version_impl_t);
+    version->refcount = 1;
+    version->pub.field_count = field_count;
+    version->pub.frame = world->info.frame_count_total;
+
+    ecs_iter_t it = ecs_query_iter(world, query);
+    while (ecs_query_next(&it)) {
+        ecs_table_t *table = it.table;
+        if (!table) {
+            ecs_iter_skip(&it);
+            continue;
+        }
+
+        ecs_read_view_table_t *vt = flecs_read_view_ensure_table(view, table);
+        int32_t *dirty_state = flecs_table_get_dirty_state(world, table);
+
+        /* If rows were added, removed or moved, copy all columns */
+        uint32_t table_version = flecs_get_table_version(world, table->id);
+        if (vt->version != table_version) {
+            flecs_read_view_table_clear(vt);
+            vt->version = table_version;
+        }
+        vt->publish = publish;
+
+        ecs_read_table_t *rt = ecs_vec_append_t(
+            NULL, &version->tables, ecs_read_table_t);
+        rt->count = it.count;
+
+        ecs_read_buffer_t *buf = flecs_read_view_column(
+            version, vt, table, dirty_state, -1);
+        rt->entities = ECS_ELEM_T(
+            flecs_read_buffer_data(buf), ecs_entity_t, it.offset);
+
+        for (f = 0; f < field_count; f ++) {
+            const void *ptr = NULL;
+            const ecs_table_record_t *tr = it.trs[f];
+            if (ecs_field_is_set(&it, f) && tr && tr->column >= 0) {
+                ecs_size_t size = table->data.columns[tr->column].ti->size;
+                buf = flecs_read_view_column(
+                    version, vt, table, dirty_state, tr->column);
+                ptr = ECS_ELEM(flecs_read_buffer_data(buf), size, it.offset);
+            }
+
+            ecs_vec_append_t(NULL, &version->fields, const void*)[0] = ptr;
+        }
+
+        /* Don't mark fields of view query as modified */
+        ecs_iter_skip(&it);
+    }
+
+    /* Field arrays are assigned after the fields vector has its final size */
+    const void **fields = ecs_vec_first(&version->fields);
+    ecs_read_table_t *tables = ecs_vec_first(&version->tables);
+    int32_t t, table_count = ecs_vec_count(&version->tables);
+    for (t = 0; t < table_count; t ++) {
+        tables[t].fields = &fields[t * field_count];
+    }
+
+    version->pub.tables = tables;
+    version->pub.table_count = table_count;
+
+    /* Free copies of tables that are no longer matched */
+    ecs_vec_t unmatched;
+    ecs_vec_init_t(NULL, &unmatched, uint64_t, 0);
+    ecs_map_iter_t mit = ecs_map_iter(&view->tables);
+    while (ecs_map_next(&mit)) {
+        ecs_read_view_table_t *vt = ecs_map_ptr(&mit);
+        if (vt->publish != publish) {
+            flecs_read_view_table_free(vt);
+            ecs_vec_append_t(NULL, &unmatched, uint64_t)[0] = 
+                ecs_map_key(&mit);
+        }
+    }
+
+    uint64_t *keys = ecs_vec_first(&unmatched);
+    for (t = 0; t < ecs_vec_count(&unmatched); t ++) {
+        ecs_map_remove(&view->tables, keys[t]);
+    }
+    ecs_vec_fini_t(NULL, &unmatched, uint64_t);
+
+    if (view->lock) {
+        ecs_os_mutex_lock(view->lock);
+    }
+
+    ecs_read_version_impl_t *prev = view->current;
+    view->current = version;
+
+    if (view->lock) {
+        ecs_os_mutex_unlock(view->lock);
+    }
+
+    if (prev) {
+        flecs_read_version_release(prev);
+    }
+error:
+    return;
+}
+
+const ecs_read_version_t* ecs_read_view_acquire(
+    ecs_read_view_t *view)
+{
+    ecs_check(view != NULL, ECS_INVALID_PARAMETER, NULL);
+
+    if (view->lock) {
+        ecs_os_mutex_lock(view->lock);
+    }
+
+    ecs_read_version_impl_t *version = view->current;
+    ecs_os_ainc(&version->refcount);
+
+    if (view->lock) {
+        ecs_os_mutex_unlock(view->lock);
+    }
+
+    return &version->pub;
+error:
+    return NULL;
+}
+
+void ecs_read_version_release(
+    const ecs_read_version_t *version)
+{
+    ecs_check(version != NULL, ECS_INVALID_PARAMETER, NULL);
+    flecs_read_version_release(
+        ECS_CONST_CAST(ecs_read_version_impl_t*, version));
+error:
+    return;
+}
+
 /**
  * @file query/engine/change_detection.c
  * @brief Compile query term.
@@ -71872,13 +79116,23 @@ void flecs_query_mark_fields_dirty(
         
         ecs_assert(table != NULL, ECS_INTERNAL_ERROR, NULL);
         int32_t *dirty_state = table->dirty_state;
-        if (!dirty_state) {
+        if (!dirty_state && !table->_->chunk_ticks) {
             continue;
         }
 
         ecs_assert(type_index < table->type.count, ECS_INTERNAL_ERROR, NULL);
         int32_t column = table->column_map[type_index];
-        dirty_state[column + 1] ++;
+        if (dirty_state) {
+            dirty_state[column + 1] ++;
+        }
+
+        if (!src) {
+            flecs_table_mark_rows_dirty(
+                world, table, column + 1, it->offset, it->count);
+        } else {
+            flecs_table_mark_rows_dirty(world, table, column + 1, 
+                ECS_RECORD_TO_ROW(flecs_entities_get(world, src)->row), 1);
+        }
     }
 }
 
@@ -71910,13 +79164,18 @@ void flecs_query_mark_fixed_fields_dirty(
         }
 
         int32_t *dirty_state = table->dirty_state;
-        if (!dirty_state) {
+        if (!dirty_state && !table->_->chunk_ticks) {
             continue;
         }
 
         ecs_assert(it->trs[i]->column >= 0, ECS_INTERNAL_ERROR, NULL);
         int32_t column = table->column_map[it->trs[i]->column];
-        dirty_state[column + 1] ++;
+        if (dirty_state) {
+            dirty_state[column + 1] ++;
+        }
+
+        flecs_table_mark_rows_dirty(world, table, column + 1, 
+            ECS_RECORD_TO_ROW(r->row), 1);
     }
 }
 
@@ -72040,6 +79299,153 @@ error:
     return false;
 }
 
+uint32_t ecs_advance_change_tick(
+    ecs_world_t *world)
+{
+    flecs_poly_assert(world, ecs_world_t);
+    return world->change_tick ++;
+}
+
+/* Get chunk ticks, stride & first row for field of iterator result. Returns 
+ * NULL if rows for the field can't be tracked with chunks. Sets untracked_out
+ * if tracking is not yet enabled for the table and can't be enabled because
+ * the world is accessed by multiple threads. */
+static
+const uint32_t* flecs_iter_get_chunk_ticks(
+    const ecs_iter_t *it,
+    int8_t field,
+    int32_t *index_out,
+    int32_t *stride_out,
+    int32_t *offset_out,
+    bool *untracked_out)
+{
+    ecs_world_t *world = it->real_world;
+    ecs_table_t *table = it->table;
+    int32_t offset = it->offset;
+    int32_t index = 0;
+
+    if (field != -1) {
+        ecs_check(field >= 0 && field < it->field_count, 
+            ECS_INVALID_PARAMETER, NULL);
+
+        const ecs_table_record_t *tr = it->trs[field];
+        ecs_entity_t src = it->sources[field];
+        if (tr && (it->set_fields & (1llu << field))) {
+            if (src) {
+                ecs_record_t *r = flecs_entities_get(world, src);
+                ecs_assert(r != NULL, ECS_INTERNAL_ERROR, NULL);
+                table = r->table;
+                offset = ECS_RECORD_TO_ROW(r->row);
+            }
+
+            ecs_assert(tr->hdr.table == table, ECS_INTERNAL_ERROR, NULL);
+            if (tr->column != -1) {
+                index = tr->column + 1;
+            }
+        }
+    }
+
+    if (!table) {
+        return NULL;
+    }
+
+    *index_out = index;
+    *stride_out = table->column_count + 1;
+    *offset_out = offset;
+
+    if (!table->_->chunk_ticks && (world->flags & EcsWorldMultiThreaded)) {
+        /* Enabling tracking allocates from the world allocator, which can't be
+         * used from worker threads. */
+        *untracked_out = true;
+        return NULL;
+    }
+
+    return flecs_table_get_chunk_ticks(world, table);
+error:
+    return NULL;
+}
+
+bool ecs_iter_changed_rows(
+    const ecs_iter_t *it,
+    int8_t field,
+    uint32_t tick,
+    int32_t *row,
+    int32_t *count)
+{
+    ecs_check(it != NULL, ECS_INVALID_PARAMETER, NULL);
+    ecs_check(row != NULL, ECS_INVALID_PARAMETER, NULL);
+    ecs_check(count != NULL, ECS_INVALID_PARAMETER, NULL);
+    ecs_check(ECS_BIT_IS_SET(it->flags, EcsIterIsValid), 
+        ECS_INVALID_PARAMETER, NULL);
+
+    int32_t it_count = it->count, cur = *row;
+    if (cur >= it_count) {
+        return false;
+    }
+
+    int32_t index, stride, offset;
+    bool untracked = false;
+    const uint32_t *ticks = flecs_iter_get_chunk_ticks(
+        it, field, &index, &stride, &offset, &untracked);
+    if (!ticks) {
+        if (untracked) {
+            /* Report remaining rows as changed, which never excludes rows 
+             * that were written to. */
+            *count = it_count - cur;
+            return true;
+        }
+        return false;
+    }
+
+    if (field != -1 && it->sources[field]) {
+        /* Field is shared by all rows in the result */
+        if (ticks[(offset >> FLECS_CHANGE_CHUNK_BITS) * stride + index] > tick) {
+            *count = it_count - cur;
+            return true;
+        }
+        return false;
+    }
+
+    /* Find first changed chunk */
+    const int32_t chunk_size = 1 << FLECS_CHANGE_CHUNK_BITS;
+    int32_t start = offset + cur, end = offset + it_count;
+    int32_t chunk = start >> FLECS_CHANGE_CHUNK_BITS;
+    int32_t last = (end - 1) >> FLECS_CHANGE_CHUNK_BITS;
+    for (; chunk <= last; chunk ++) {
+        if (ticks[chunk * stride + index] > tick) {
+            break;
+        }
+    }
+
+    if (chunk > last) {
+        *row = it_count;
+        return false;
+    }
+
+    /* Extend range with adjacent changed chunks */
+    int32_t first = chunk;
+    for (chunk ++; chunk <= last; chunk ++) {
+        if (ticks[chunk * stride + index] <= tick) {
+            break;
+        }
+    }
+
+    int32_t range_start = first * chunk_size;
+    int32_t range_end = chunk * chunk_size;
+    if (range_start < start) {
+        range_start = start;
+    }
+    if (range_end > end) {
+        range_end = end;
+    }
+
+    *row = range_start - offset;
+    *count = range_end - range_start;
+    return true;
+error:
+    return false;
+}
+
 void ecs_iter_skip(
     ecs_iter_t *it)
 {
@@ -73721,9 +81127,11 @@ bool ecs_query_next(
             }
         } else {
             /* Default iterator mode. This enters the query VM dispatch loop. */
-            if (flecs_query_run_until(
-                redo, &ctx, ops, -1, qit->op, impl->op_count - 1)) 
-            {
+            ecs_os_perf_trace_push("flecs.query.eval");
+            bool match = flecs_query_run_until(
+                redo, &ctx, ops, -1, qit->op, impl->op_count - 1);
+            ecs_os_perf_trace_pop("flecs.query.eval");
+            if (match) {
                 ecs_assert(ops[ctx.op_index].kind == EcsQueryYield, 
                     ECS_INTERNAL_ERROR, NULL);
                 flecs_query_set_iter_this(it, &ctx);
@@ -223,11 +223,14 @@
 #define FLECS_MODULE         /**< Module support */
 #define FLECS_OS_API_IMPL    /**< Default implementation for OS API */
 // #define FLECS_PERF_TRACE  /**< Enable performance tracing */
+// #define FLECS_PERF_COUNTERS /**< Hardware counters for systems (Linux) */
 #define FLECS_PIPELINE       /**< Pipeline support */
 #define FLECS_REST           /**< REST API for querying application data */
 #define FLECS_PARSER         /**< Utilities for script and query DSL parsers */
 #define FLECS_QUERY_DSL      /**< Flecs query DSL parser */
 #define FLECS_SCRIPT         /**< Flecs entity notation language */
+// #define FLECS_SHARD       /**< Simulate entities across multiple worlds */
+// #define FLECS_RECORDER    /**< Record events for analysis and replay */
 // #define FLECS_SCRIPT_MATH /**< Math functions for flecs script (may require linking with libm) */
 #define FLECS_SYSTEM         /**< System support */
 #define FLECS_STATS          /**< Track runtime statistics */
@@ -332,6 +335,92 @@
 #define FLECS_QUERY_SCOPE_NESTING_MAX (8)
 #endif
 
+/** @def FLECS_QUERY_EXPR_CACHE_SIZE
+ * Maximum number of query DSL expressions for which parsed terms are cached
+ * per world. Queries created from an expression that is in the cache skip the
+ * parser. When the cache is full the least recently used entry is evicted.
+ * Set to 0 to disable the cache. */
+#ifndef FLECS_QUERY_EXPR_CACHE_SIZE
+#define FLECS_QUERY_EXPR_CACHE_SIZE (128)
+#endif
+
+/** @def FLECS_CHANGE_CHUNK_BITS
+ * Number of bits of a table row that are used to determine the chunk for chunk
+ * based change detection (see ecs_iter_changed_rows()). The number of rows per
+ * chunk is (1 << bits). Lower values give more precise results at the cost of
+ * increased memory utilization. */
+#ifndef FLECS_CHANGE_CHUNK_BITS
+#define FLECS_CHANGE_CHUNK_BITS (6)
+#endif
+
+/** @def FLECS_WORKER_TASKS_PER_THREAD
+ * When a pipeline runs multi threaded systems, results are split up into tasks
+ * that workers claim dynamically, so that workers that finish early pick up
+ * work that would otherwise have been assigned to busy workers. This constant
+ * specifies the maximum number of tasks per worker a single result is split
+ * up in. Higher values improve load balancing at the cost of more overhead. */
+#ifndef FLECS_WORKER_TASKS_PER_THREAD
+#define FLECS_WORKER_TASKS_PER_THREAD (4)
+#endif
+
+/** @def FLECS_WORKER_TASK_MIN_ROWS
+ * Minimum number of rows in a task claimed by a worker. Results with fewer
+ * rows than this are not split up. */
+#ifndef FLECS_WORKER_TASK_MIN_ROWS
+#define FLECS_WORKER_TASK_MIN_ROWS (256)
+#endif
+
+/** @def FLECS_SYNC_SPIN_COUNT
+ * Number of times a thread polls for a pipeline sync point to complete before
+ * it blocks on a condition variable. Spinning avoids the latency of putting a
+ * thread to sleep when sync points are short, at the cost of CPU time while
+ * waiting. Spinning only helps when each thread has a dedicated core, so it
+ * is disabled by default. Values in the range of 100-1000 are a reasonable 
+ * starting point on such machines. */
+#ifndef FLECS_SYNC_SPIN_COUNT
+#define FLECS_SYNC_SPIN_COUNT (0)
+#endif
+
+/** @def FLECS_PARALLEL_MERGE_MIN_COMMANDS
+ * Minimum number of commands enqueued by the stages of a multi threaded 
+ * pipeline operation before workers apply commands that only assign existing
+ * components in parallel, before the remaining commands are merged by the main
+ * thread. */
+#ifndef FLECS_PARALLEL_MERGE_MIN_COMMANDS
+#define FLECS_PARALLEL_MERGE_MIN_COMMANDS (4096)
+#endif
+
+/** @def FLECS_CMD_FOLD_MAX
+ * Maximum number of distinct ids in the commands for a single entity for which
+ * add and remove commands are folded before the commands are merged. Commands
+ * for ids beyond this number are merged without folding. */
+#ifndef FLECS_CMD_FOLD_MAX
+#define FLECS_CMD_FOLD_MAX (32)
+#endif
+
+/** @def FLECS_DETERMINISTIC_ID_BLOCK
+ * Number of entity ids a stage reserves at a time when it creates entities 
+ * while multi threaded in deterministic mode. Ids in a block that aren't used 
+ * before the next sync point stay reserved for the stage. */
+#ifndef FLECS_DETERMINISTIC_ID_BLOCK
+#define FLECS_DETERMINISTIC_ID_BLOCK (256)
+#endif
+
+/** @def FLECS_SYSTEM_DECIMATION_MAX
+ * Maximum number of frames after which a low priority system runs when the 
+ * frame budget (see ecs_set_frame_budget()) is exceeded. */
+#ifndef FLECS_SYSTEM_DECIMATION_MAX
+#define FLECS_SYSTEM_DECIMATION_MAX (16)
+#endif
+
+/** @def FLECS_FIBER_STACK_SIZE
+ * Size of the stack of the fiber on which a system with a time budget runs. 
+ * Deeply recursive systems may need a larger stack. The builtin POSIX fibers
+ * place a guard page below the stack, so that an overflow faults. */
+#ifndef FLECS_FIBER_STACK_SIZE
+#define FLECS_FIBER_STACK_SIZE (256 * 1024)
+#endif
+
 /** @def FLECS_DAG_DEPTH_MAX
  * Maximum of levels in a DAG (acyclic relationship graph). If a graph with a
  * depth larger than this is encountered, a CYCLE_DETECTED panic is thrown.
@@ -380,6 +469,8 @@ extern "C" {
 #define EcsWorldMeasureSystemTime     (1u << 6)
 #define EcsWorldMultiThreaded         (1u << 7)
 #define EcsWorldFrameInProgress       (1u << 8)
+#define EcsWorldDeterministic         (1u << 9)
+#define EcsWorldMergeOverlap          (1u << 10)
 
 ////////////////////////////////////////////////////////////////////////////////
 //// OS API flags
@@ -2356,6 +2447,7 @@ typedef uintptr_t ecs_os_cond_t;                   /**< OS cond. */
 typedef uintptr_t ecs_os_mutex_t;                  /**< OS mutex. */
 typedef uintptr_t ecs_os_dl_t;                     /**< OS dynamic library. */
 typedef uintptr_t ecs_os_sock_t;                   /**< OS socket. */
+typedef uintptr_t ecs_os_fiber_t;                  /**< OS fiber. */
 
 /** 64 bit thread id. */
 typedef uint64_t ecs_os_thread_id_t;
@@ -2417,6 +2509,21 @@ void* (*ecs_os_api_thread_join_t)(
 typedef
 ecs_os_thread_id_t (*ecs_os_api_thread_self_t)(void);
 
+/** OS API thread_set_affinity function type. 
+ * Binds the calling thread to a CPU and makes it prefer allocating memory from
+ * a NUMA node. A value of -1 leaves the CPU or NUMA node unchanged. Returns 0
+ * if successful. */
+typedef
+int (*ecs_os_api_thread_set_affinity_t)(
+    int32_t cpu,
+    int32_t numa_node);
+
+/** OS API thread_reset_affinity function type. 
+ * Restores the CPU and NUMA node of the calling thread to what they were before
+ * thread_set_affinity was first called by the thread. */
+typedef
+void (*ecs_os_api_thread_reset_affinity_t)(void);
+
 /** OS API task_new function type. */
 typedef
 ecs_os_thread_t (*ecs_os_api_task_new_t)(
@@ -2428,6 +2535,33 @@ typedef
 void* (*ecs_os_api_task_join_t)(
     ecs_os_thread_t thread);
 
+/** OS API fiber_callback function type. */
+typedef
+void (*ecs_os_fiber_callback_t)(
+    void*);
+
+/** OS API fiber_new function type. 
+ * Creates a fiber with its own stack that runs the callback when it is resumed
+ * for the first time. When the callback returns, control goes back to the
+ * code that last resumed the fiber. */
+typedef
+ecs_os_fiber_t (*ecs_os_api_fiber_new_t)(
+    ecs_os_fiber_callback_t callback,
+    void *param,
+    ecs_size_t stack_size);
+
+/** OS API fiber_free function type. */
+typedef
+void (*ecs_os_api_fiber_free_t)(
+    ecs_os_fiber_t fiber);
+
+/** OS API fiber_resume/fiber_yield function type. 
+ * Resume switches from the calling code to the fiber, yield switches from the
+ * fiber back to the code that resumed it. */
+typedef
+void (*ecs_os_api_fiber_switch_t)(
+    ecs_os_fiber_t fiber);
+
 /* Atomic increment / decrement */
 /** OS API ainc function type. */
 typedef
@@ -2439,6 +2573,16 @@ typedef
 int64_t (*ecs_os_api_lainc_t)(
     int64_t *value);
 
+/** OS API acas function type.
+ * Atomically replaces the pointer in ptr with value if it is equal to
+ * expected. Returns the pointer stored in ptr before the operation, which is
+ * equal to expected if the pointer was replaced. */
+typedef
+void* (*ecs_os_api_acas_t)(
+    void **ptr,
+    void *expected,
+    void *value);
+
 /* Mutex */
 /** OS API mutex_new function type. */
 typedef
@@ -2569,16 +2713,25 @@ typedef struct ecs_os_api_t {
     ecs_os_api_thread_new_t thread_new_;           /**< thread_new callback. */
     ecs_os_api_thread_join_t thread_join_;         /**< thread_join callback. */
     ecs_os_api_thread_self_t thread_self_;         /**< thread_self callback. */
+    ecs_os_api_thread_set_affinity_t thread_set_affinity_; /**< thread_set_affinity callback. */
+    ecs_os_api_thread_reset_affinity_t thread_reset_affinity_; /**< thread_reset_affinity callback. */
 
     /* Tasks */
     ecs_os_api_thread_new_t task_new_;             /**< task_new callback. */
     ecs_os_api_thread_join_t task_join_;           /**< task_join callback. */
 
+    /* Fibers */
+    ecs_os_api_fiber_new_t fiber_new_;             /**< fiber_new callback. */
+    ecs_os_api_fiber_free_t fiber_free_;           /**< fiber_free callback. */
+    ecs_os_api_fiber_switch_t fiber_resume_;       /**< fiber_resume callback. */
+    ecs_os_api_fiber_switch_t fiber_yield_;        /**< fiber_yield callback. */
+
     /* Atomic increment / decrement */
     ecs_os_api_ainc_t ainc_;                       /**< ainc callback. */
     ecs_os_api_ainc_t adec_;                       /**< adec callback. */
     ecs_os_api_lainc_t lainc_;                     /**< lainc callback. */
     ecs_os_api_lainc_t ladec_;                     /**< ladec callback. */
+    ecs_os_api_acas_t acas_;                       /**< acas callback. */
 
     /* Mutex */
     ecs_os_api_mutex_new_t mutex_new_;             /**< mutex_new callback. */
@@ -2789,16 +2942,25 @@ void ecs_os_set_api_defaults(void);
 #define ecs_os_thread_new(callback, param) ecs_os_api.thread_new_(callback, param)
 #define ecs_os_thread_join(thread) ecs_os_api.thread_join_(thread)
 #define ecs_os_thread_self() ecs_os_api.thread_self_()
+#define ecs_os_thread_set_affinity(cpu, numa_node) ecs_os_api.thread_set_affinity_(cpu, numa_node)
+#define ecs_os_thread_reset_affinity() ecs_os_api.thread_reset_affinity_()
 
 /* Tasks */
 #define ecs_os_task_new(callback, param) ecs_os_api.task_new_(callback, param)
 #define ecs_os_task_join(thread) ecs_os_api.task_join_(thread)
 
+/* Fibers */
+#define ecs_os_fiber_new(callback, param, stack_size) ecs_os_api.fiber_new_(callback, param, stack_size)
+#define ecs_os_fiber_free(fiber) ecs_os_api.fiber_free_(fiber)
+#define ecs_os_fiber_resume(fiber) ecs_os_api.fiber_resume_(fiber)
+#define ecs_os_fiber_yield(fiber) ecs_os_api.fiber_yield_(fiber)
+
 /* Atomic increment / decrement */
 #define ecs_os_ainc(value) ecs_os_api.ainc_(value)
 #define ecs_os_adec(value) ecs_os_api.adec_(value)
 #define ecs_os_lainc(value) ecs_os_api.lainc_(value)
 #define ecs_os_ladec(value) ecs_os_api.ladec_(value)
+#define ecs_os_acas(ptr, expected, value) ecs_os_api.acas_(ptr, expected, value)
 
 /* Mutex */
 #define ecs_os_mutex_new() ecs_os_api.mutex_new_()
@@ -3036,6 +3198,14 @@ bool ecs_os_has_threading(void);
 FLECS_API
 bool ecs_os_has_task_support(void);
 
+/** Is the thread affinity function available? */
+FLECS_API
+bool ecs_os_has_thread_affinity(void);
+
+/** Are fiber functions available? */
+FLECS_API
+bool ecs_os_has_fibers(void);
+
 /** Are time functions available? */
 FLECS_API
 bool ecs_os_has_time(void);
@@ -3741,6 +3911,8 @@ typedef struct ecs_event_record_t {
     struct ecs_event_id_record_t *wildcard;
     struct ecs_event_id_record_t *wildcard_pair;
     ecs_map_t event_ids; /* map<id, ecs_event_id_record_t> */
+    ecs_map_t fanout;    /* map<id, ecs_event_fanout_t>, observers for id */
+    int32_t fanout_version; /* Incremented when observers are (un)registered */
     ecs_entity_t event;
 } ecs_event_record_t;
 
@@ -3789,10 +3961,22 @@ typedef struct ecs_page_iter_t {
     int32_t remaining;
 } ecs_page_iter_t;
 
+/* Chunk-iterator specific data */
+typedef struct ecs_chunk_iter_t {
+    int32_t size;           /* Maximum number of rows per result */
+    int32_t row;            /* Next row in current result of parent */
+    int32_t count;          /* Number of rows in current result of parent */
+} ecs_chunk_iter_t;
+
 /* Worker-iterator specific data */
 typedef struct ecs_worker_iter_t {
     int32_t index;
     int32_t count;
+    ecs_chunk_iter_t chunk; /* Used when results are split up in chunks */
+    int32_t chunk_index;    /* Index of next chunk across all results */
+    int32_t *tasks_claimed; /* Counter shared between workers claiming chunks */
+    int32_t task_claimed;   /* Index of last chunk claimed by this worker */
+    int32_t task_size;      /* Rows per claimed chunk (0 = derive from count) */
 } ecs_worker_iter_t;
 
 /* Convenience struct to iterate table array for id */
@@ -3859,6 +4043,7 @@ typedef struct ecs_iter_private_t {
         ecs_query_iter_t query;
         ecs_page_iter_t page;
         ecs_worker_iter_t worker;
+        ecs_chunk_iter_t chunk;
         ecs_each_iter_t each;
     } iter;                       /* Iterator specific data */
 
@@ -3871,6 +4056,7 @@ typedef struct ecs_commands_t {
     ecs_vec_t queue;
     ecs_stack_t stack;          /* Temp memory used by deferred commands */
     ecs_sparse_t entries;       /* <entity, op_entry_t> - command batching */
+    ecs_vec_t systems;          /* Systems that enqueued commands, only populated when commands are captured */
 } ecs_commands_t;
 
 #ifdef __cplusplus
@@ -4857,6 +5043,15 @@ struct ecs_iter_t {
  */
 #define EcsQueryMatchEmptyTables      (1u << 3u)
 
+/** Query enables chunk based change detection for matched tables.
+ * When combined with a cached query, tracking is enabled for tables when they
+ * are matched, so that ecs_iter_changed_rows() can be used from multi threaded
+ * systems. Can be combined with other query flags on the 
+ * ecs_query_desc_t::flags field.
+ * \ingroup queries
+ */
+#define EcsQueryTrackRowChanges       (1u << 4u)
+
 /** Query may have unresolved entity identifiers.
  * Can be combined with other query flags on the ecs_query_desc_t::flags field.
  * \ingroup queries
@@ -4965,6 +5160,14 @@ typedef struct ecs_observer_desc_t {
      * #EcsOnAdd `Position` would match all existing instances of `Position`. */
     bool yield_existing;
 
+    /** Invoke observer asynchronously in the specified pipeline phase. Events
+     * are queued per entity, with repeated events for the same entity
+     * coalesced into one, and the queue is processed in parallel on worker
+     * threads when the phase runs. The observer reads component values at
+     * that time. Only OnAdd and OnSet events are supported. Requires the 
+     * system addon. */
+    ecs_entity_t async_phase;
+
     /** Callback to invoke on an event, invoked when the observer matches. */
     ecs_iter_action_t callback;
 
@@ -5086,6 +5289,7 @@ typedef struct ecs_world_info_t {
     ecs_ftime_t delta_time;           /**< Time passed to or computed by ecs_progress() */
     ecs_ftime_t time_scale;           /**< Time scale applied to delta_time */
     ecs_ftime_t target_fps;           /**< Target fps */
+    ecs_ftime_t frame_budget;         /**< Time budget for systems per frame */
     ecs_ftime_t frame_time_total;     /**< Total time spent processing a frame */
     ecs_ftime_t system_time_total;    /**< Total time spent in systems */
     ecs_ftime_t emit_time_total;      /**< Total time spent notifying observers */
@@ -5127,6 +5331,8 @@ typedef struct ecs_world_info_t {
         int64_t other_count;           /**< Other commands processed */
         int64_t batched_entity_count;  /**< Entities for which commands were batched */
         int64_t batched_command_count; /**< Commands batched */
+        int64_t folded_count;          /**< Add/remove commands folded away before merging */
+        int64_t queue_bytes;           /**< Memory used by merged command queues */
     } cmd;                             /**< Command statistics. */
 
     const char *name_prefix;          /**< Value set by ecs_set_name_prefix(). Used
@@ -5842,6 +6048,62 @@ void ecs_set_default_query_flags(
     ecs_world_t *world,
     ecs_flags32_t flags);
 
+/** Enable or disable deterministic mode.
+ * In deterministic mode, running the same systems with the same inputs and the
+ * same number of threads produces the same world state, regardless of how the
+ * operating system schedules the threads. This is useful for applications like
+ * lockstep simulations that compare state between runs or machines.
+ *
+ * When enabled:
+ *  - Each worker thread processes a fixed part of the entities matched by a
+ *    multi threaded system. Commands are merged per stage, so in stage order,
+ *    then system order, then enqueue order.
+ *  - Entities created by stages while multi threaded get ids from blocks that
+ *    are reserved per stage (see FLECS_DETERMINISTIC_ID_BLOCK).
+ *
+ * Deterministic mode can reduce multi threaded performance when workers get
+ * unequal amounts of work, as workers no longer take work from each other.
+ * When deterministic mode is disabled, the id blocks reserved by stages are
+ * freed. The ids in those blocks are not reused.
+ * This operation may not be called while the world is in readonly mode.
+ *
+ * @param world The world.
+ * @param enable Whether to enable or disable deterministic mode.
+ *
+ * @see ecs_world_state_hash()
+ */
+FLECS_API
+void ecs_set_deterministic(
+    ecs_world_t *world,
+    bool enable);
+
+/** Compute a hash of the world state.
+ * The hash includes the entities of each table, in storage order, the table
+ * types, and the values of components that don't have a copy hook. Values of
+ * components with a copy hook, builtin components and sparse components are
+ * not included. Components that contain pointers should have a copy hook, or 
+ * the hash will differ between runs.
+ *
+ * For components with reflection data (FLECS_META) only the members are
+ * hashed, skipping padding and string, vector and opaque members. Other 
+ * components are hashed as raw memory including padding bytes, so their 
+ * values must be assigned from memory in which padding is initialized, for
+ * example by zero-initializing the value before setting its members.
+ *
+ * The hash can be computed after each frame to check whether runs of an
+ * application in deterministic mode produced the same result. Computing the 
+ * hash visits all component data, so it has a cost proportional to the size of
+ * the world.
+ *
+ * @param world The world.
+ * @return Hash of the world state.
+ *
+ * @see ecs_set_deterministic()
+ */
+FLECS_API
+uint64_t ecs_world_state_hash(
+    const ecs_world_t *world);
+
 /** @} */
 
 /**
@@ -8581,6 +8843,111 @@ const ecs_query_t* ecs_query_get_cache_query(
 
 /** @} */
 
+/**
+ * @defgroup read_views Read views
+ * Functions for reading component data from threads other than the thread 
+ * that progresses the world.
+ *
+ * @{
+ */
+
+/** A read view stores immutable versions of the data matched by a query.
+ * A version is created when the view is published by the thread that owns the
+ * world, and can be read by other threads while the world is progressed. */
+typedef struct ecs_read_view_t ecs_read_view_t;
+
+/** Table in a read view version. */
+typedef struct ecs_read_table_t {
+    const ecs_entity_t *entities;  /**< Entities in result. */
+    const void **fields;           /**< Component arrays, one per query field. */
+    int32_t count;                 /**< Number of entities in result. */
+} ecs_read_table_t;
+
+/** Version of the data in a read view. */
+typedef struct ecs_read_version_t {
+    const ecs_read_table_t *tables; /**< Query results at time of publish. */
+    int32_t table_count;           /**< Number of results. */
+    int32_t field_count;           /**< Number of fields per result. */
+    int64_t frame;                 /**< Value of frame_count_total at publish. */
+} ecs_read_version_t;
+
+/** Create a read view.
+ * The view stores the component data of the fields of a query. Fields with 
+ * data must have $this as source. Fields that don't have data are NULL in the
+ * view. Publishing a view doesn't mark fields of the query as modified. The
+ * query must outlive the view.
+ * 
+ * Data is copied per table column. When a view is published, columns that 
+ * didn't change since the last version are shared with the last version, 
+ * while columns that were written are copied. A column is only copied again
+ * when entities are added to, removed from or moved in its table, or when the
+ * column is marked dirty. A column is marked dirty when:
+ *  - a component is assigned with ecs_set() or ecs_modified(), or by the
+ *    equivalent commands.
+ *  - a query with [out] or [inout] fields for $this iterates the table, at the
+ *    point where ecs_query_next() advances to the next result. An iterator
+ *    that is stopped early with ecs_iter_fini() doesn't mark its last table.
+ * 
+ * Writes that don't mark the column dirty are not detected, and the view will
+ * keep the previously published value. Examples are writes to pointers from 
+ * ecs_ensure() or ecs_get_mut() without a call to ecs_modified(), and writes
+ * to columns obtained with ecs_table_get_column().
+ * 
+ * The view is published once when it is created.
+ * 
+ * @param world The world.
+ * @param query The query that selects the data for the view.
+ * @return The read view, or NULL if the query is not valid for a view.
+ */
+FLECS_API
+ecs_read_view_t* ecs_read_view_init(
+    ecs_world_t *world,
+    ecs_query_t *query);
+
+/** Delete a read view.
+ * Versions that are still acquired remain valid until they are released, but
+ * must be released before the world is deleted.
+ * 
+ * @param view The read view.
+ */
+FLECS_API
+void ecs_read_view_fini(
+    ecs_read_view_t *view);
+
+/** Publish a new version of a read view.
+ * This operation must be called from the thread that owns the world while the
+ * world is not in readonly mode, typically after ecs_progress(). Readers that
+ * acquire the view after this operation get the new version.
+ * 
+ * @param view The read view.
+ */
+FLECS_API
+void ecs_read_view_publish(
+    ecs_read_view_t *view);
+
+/** Acquire the latest version of a read view.
+ * This operation can be called from any thread. The returned version does not
+ * change, and is valid until it is released with ecs_read_version_release(),
+ * regardless of whether the world is progressed or the view is published.
+ * 
+ * @param view The read view.
+ * @return The latest published version.
+ */
+FLECS_API
+const ecs_read_version_t* ecs_read_view_acquire(
+    ecs_read_view_t *view);
+
+/** Release an acquired read view version.
+ * This operation can be called from any thread.
+ * 
+ * @param version The version to release.
+ */
+FLECS_API
+void ecs_read_version_release(
+    const ecs_read_version_t *version);
+
+/** @} */
+
 /**
  * @defgroup observers Observers
  * Functions for working with events and observers.
@@ -8887,7 +9254,8 @@ bool ecs_iter_var_is_constrained(
  * iterated result has changed since the last time it was iterated by the query.
  * 
  * Change detection works on a per-table basis. Changes to individual entities
- * cannot be detected this way.
+ * cannot be detected this way. To find which rows changed in a result, use
+ * ecs_iter_changed_rows().
  * 
  * @param it The iterator.
  * @return True if the result changed, false if it didn't.
@@ -8896,6 +9264,68 @@ FLECS_API
 bool ecs_iter_changed(
     ecs_iter_t *it);
 
+/** Advance the change tick used by chunk based change detection.
+ * This operation returns the current change tick and advances it. Rows that are
+ * written after this call are reported as changed by ecs_iter_changed_rows()
+ * when called with the returned tick.
+ *
+ * An application that synchronizes data (e.g. network replication) typically
+ * stores the tick returned by this function after each synchronization, and 
+ * passes it to ecs_iter_changed_rows() during the next synchronization.
+ *
+ * @param world The world.
+ * @return The change tick before it was advanced.
+ */
+FLECS_API
+uint32_t ecs_advance_change_tick(
+    ecs_world_t *world);
+
+/** Find next range of changed rows in the current iterator result.
+ * This operation finds rows of the current result for which the specified field
+ * was written after the provided change tick. Changes are tracked per chunk of
+ * rows (see FLECS_CHANGE_CHUNK_BITS), so a range may include rows that were not
+ * written to, but will never exclude rows that were.
+ *
+ * Rows are written to by set/modified operations, by iterating queries with 
+ * out/inout fields, and by operations that add, move or remove entities in a 
+ * table. Tracking is enabled for a table when it is matched by a cached query
+ * created with EcsQueryTrackRowChanges, or else the first time this operation
+ * is used with it, at which point all rows in the table are reported as 
+ * changed. Tracking can't be enabled while the world is accessed by multiple
+ * threads. Until it is enabled for a table, all rows are reported as changed.
+ *
+ * The row argument is used as cursor. It must be initialized to 0 before the 
+ * first call, and must be set to row + count before the next call. Rows are 
+ * relative to the current result, and range from 0 to it->count.
+ *
+ * @code
+ * int32_t row = 0, count;
+ * while (ecs_iter_changed_rows(&it, 0, last_tick, &row, &count)) {
+ *   for (int32_t i = row; i < row + count; i ++) { ... }
+ *   row += count;
+ * }
+ * @endcode
+ *
+ * If field is -1, or if the field does not have data, the operation returns 
+ * rows that were added or moved. If the field is matched on an entity other 
+ * than $this, the entire result is reported as changed if the component on 
+ * the source entity changed.
+ *
+ * @param it The iterator.
+ * @param field The field index, or -1 for changes in entity membership.
+ * @param tick The tick obtained from ecs_advance_change_tick().
+ * @param row In/out: first row to search, set to first changed row.
+ * @param count Out: number of changed rows starting from row.
+ * @return True if a range of changed rows was found, false if not.
+ */
+FLECS_API
+bool ecs_iter_changed_rows(
+    const ecs_iter_t *it,
+    int8_t field,
+    uint32_t tick,
+    int32_t *row,
+    int32_t *count);
+
 /** Convert iterator to string.
  * Prints the contents of an iterator to a string. Useful for debugging and/or
  * testing the output of an iterator.
@@ -8968,8 +9398,37 @@ ecs_iter_t ecs_worker_iter(
     int32_t index,
     int32_t count);
 
+/** Create a worker iterator that distributes chunks across resources.
+ * Same as ecs_worker_iter(), but instead of dividing each result across all
+ * resources, results are split up in chunks of at most chunk_size entities,
+ * which are assigned to resources in a round robin fashion. Results that are
+ * smaller than chunk_size are not split up, and are assigned to a single
+ * resource.
+ * 
+ * This limits the work done per result to a predictable amount, and prevents 
+ * results with few entities from being split up in many tiny slices.
+ *
+ * Chunks are distributed such that the distribution is stable between queries
+ * that produce results in the same order.
+ *
+ * The iterator must be iterated with ecs_worker_next().
+ *
+ * @param it The source iterator.
+ * @param index The index of the current resource.
+ * @param count The total number of resources to divide entities between.
+ * @param chunk_size The maximum number of entities per result.
+ * @return A worker iterator.
+ */
+FLECS_API
+ecs_iter_t ecs_worker_chunk_iter(
+    const ecs_iter_t *it,
+    int32_t index,
+    int32_t count,
+    int32_t chunk_size);
+
 /** Progress a worker iterator.
- * Progresses an iterator created by ecs_worker_iter().
+ * Progresses an iterator created by ecs_worker_iter() or 
+ * ecs_worker_chunk_iter().
  *
  * @param it The iterator.
  * @return true if iterator has more results, false if not.
@@ -8978,6 +9437,37 @@ FLECS_API
 bool ecs_worker_next(
     ecs_iter_t *it);
 
+/** Create a chunk iterator.
+ * Chunk iterators split up results of the parent iterator so that each result
+ * contains at most chunk_size entities. This makes the amount of work done per
+ * result predictable, for example to keep the data accessed per result within
+ * a CPU cache.
+ *
+ * The iterator must be iterated with ecs_chunk_next().
+ *
+ * A chunk iterator acts as a passthrough for data exposed by the parent
+ * iterator, so that any data provided by the parent will also be provided by
+ * the chunk iterator.
+ *
+ * @param it The source iterator.
+ * @param chunk_size The maximum number of entities per result.
+ * @return A chunk iterator.
+ */
+FLECS_API
+ecs_iter_t ecs_chunk_iter(
+    const ecs_iter_t *it,
+    int32_t chunk_size);
+
+/** Progress a chunk iterator.
+ * Progresses an iterator created by ecs_chunk_iter().
+ *
+ * @param it The iterator.
+ * @return true if iterator has more results, false if not.
+ */
+FLECS_API
+bool ecs_chunk_next(
+    ecs_iter_t *it);
+
 /** Get data for field.
  * This operation retrieves a pointer to an array of data that belongs to the
  * term in the query. The index refers to the location of the term in the query,
@@ -10785,6 +11275,22 @@ int ecs_value_move_ctor(
 #ifdef FLECS_NO_JOURNAL
 #undef FLECS_JOURNAL
 #endif
+#ifdef FLECS_NO_SHARD
+#undef FLECS_SHARD
+#endif
+#ifdef FLECS_NO_RECORDER
+#undef FLECS_RECORDER
+#endif
+
+/* Hardware performance counters are measured per system with perf_event_open,
+ * which is only available on Linux */
+#if defined(FLECS_PERF_COUNTERS) && \
+    (!defined(__linux__) || defined(FLECS_NO_SYSTEM))
+#undef FLECS_PERF_COUNTERS
+#endif
+#if defined(FLECS_PERF_COUNTERS) && !defined(FLECS_SYSTEM)
+#define FLECS_SYSTEM
+#endif
 
 /* Always included, if disabled functions are replaced with dummy macros */
 /**
@@ -11527,6 +12033,423 @@ int ecs_app_set_frame_action(
 
 #endif
 
+#ifdef FLECS_SHARD
+#ifdef FLECS_NO_SHARD
+#error "FLECS_NO_SHARD failed: SHARD is required by other addons"
+#endif
+/**
+ * @file addons/shard.h
+ * @brief Shard addon.
+ *
+ * The shard addon splits a simulation across multiple worlds (shards) that
+ * progress in parallel. Each shard owns a disjoint range of entity ids, so
+ * the shard that stores an entity can be derived from its id. Shards don't
+ * share data: operations on entities that live in another shard are posted
+ * to a lock-free mailbox, and are applied when the group synchronizes.
+ */
+
+#ifdef FLECS_SHARD
+
+#ifndef FLECS_PIPELINE
+#define FLECS_PIPELINE
+#endif
+
+#ifndef FLECS_SHARD_H
+#define FLECS_SHARD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup c_addons_shard Shard
+ * @ingroup c_addons
+ * Simulate entities across multiple worlds.
+ *
+ * @{
+ */
+
+/** A group of worlds that simulate disjoint sets of entities. */
+typedef struct ecs_shard_group_t ecs_shard_group_t;
+
+/** Callback type for initializing a shard. */
+typedef void (*ecs_shard_init_action_t)(
+    ecs_world_t *world,
+    int32_t shard,
+    void *ctx);
+
+/** Used with ecs_shard_group_init(). */
+typedef struct ecs_shard_group_desc_t {
+    int32_t shard_count;        /**< Number of shards (worlds) in the group. */
+
+    /** Number of entity ids reserved for each shard. Defaults to 2^24. */
+    uint32_t ids_per_shard;
+
+    /** Invoked for each shard before its entity range is set. Components,
+     * tags and modules must be registered in the same order for all shards,
+     * so that they have the same ids in each world. */
+    ecs_shard_init_action_t init;
+
+    void *ctx;                  /**< Context passed to init. */
+} ecs_shard_group_desc_t;
+
+/** Create a shard group.
+ * This creates the shard worlds, invokes the init callback for each shard and
+ * then assigns each shard its own range of entity ids. Entities created before
+ * the range was assigned (components, modules, ...) exist in all shards.
+ *
+ * @param desc Shard group parameters.
+ * @return The new shard group, or NULL if the group could not be created.
+ */
+FLECS_API
+ecs_shard_group_t* ecs_shard_group_init(
+    const ecs_shard_group_desc_t *desc);
+
+/** Delete a shard group.
+ * Discards messages that weren't applied yet, and deletes the shard worlds.
+ *
+ * @param group The shard group.
+ */
+FLECS_API
+void ecs_shard_group_fini(
+    ecs_shard_group_t *group);
+
+/** Return number of shards in group.
+ *
+ * @param group The shard group.
+ * @return The number of shards.
+ */
+FLECS_API
+int32_t ecs_shard_count(
+    const ecs_shard_group_t *group);
+
+/** Return world of shard.
+ *
+ * @param group The shard group.
+ * @param shard The shard index.
+ * @return The world of the shard.
+ */
+FLECS_API
+ecs_world_t* ecs_shard_world(
+    const ecs_shard_group_t *group,
+    int32_t shard);
+
+/** Return shard that owns an entity.
+ * The owner is derived from the entity id, and does not check whether the
+ * entity is alive.
+ *
+ * @param group The shard group.
+ * @param entity The entity.
+ * @return The shard index, or -1 if the entity isn't owned by a shard.
+ */
+FLECS_API
+int32_t ecs_shard_of(
+    const ecs_shard_group_t *group,
+    ecs_entity_t entity);
+
+/** Post set message to shard that owns entity.
+ * The value is copied into the message with memcpy, and is assigned to the
+ * component when the group synchronizes. Components that own resources (like
+ * strings) should not be sent between shards.
+ *
+ * This operation is thread safe and may be called from systems in any shard.
+ *
+ * @param group The shard group.
+ * @param entity The entity.
+ * @param id The component to set.
+ * @param size The size of the component value.
+ * @param ptr The component value.
+ */
+FLECS_API
+void ecs_shard_set_id(
+    ecs_shard_group_t *group,
+    ecs_entity_t entity,
+    ecs_id_t id,
+    size_t size,
+    const void *ptr);
+
+/** Post add message to shard that owns entity.
+ * This operation is thread safe.
+ *
+ * @param group The shard group.
+ * @param entity The entity.
+ * @param id The id to add.
+ */
+FLECS_API
+void ecs_shard_add_id(
+    ecs_shard_group_t *group,
+    ecs_entity_t entity,
+    ecs_id_t id);
+
+/** Post remove message to shard that owns entity.
+ * This operation is thread safe.
+ *
+ * @param group The shard group.
+ * @param entity The entity.
+ * @param id The id to remove.
+ */
+FLECS_API
+void ecs_shard_remove_id(
+    ecs_shard_group_t *group,
+    ecs_entity_t entity,
+    ecs_id_t id);
+
+/** Post delete message to shard that owns entity.
+ * This operation is thread safe.
+ *
+ * @param group The shard group.
+ * @param entity The entity.
+ */
+FLECS_API
+void ecs_shard_delete(
+    ecs_shard_group_t *group,
+    ecs_entity_t entity);
+
+/** Post migrate message to shard that owns entity.
+ * When the group synchronizes, the entity is recreated in the destination
+ * shard with all of its components, after which it is deleted from its
+ * current shard. Because shards own disjoint id ranges the migrated entity
+ * gets a new id, which can be obtained with ecs_shard_forward().
+ *
+ * Children of the entity (entities with a ChildOf pair to it) are migrated
+ * with it, recursively, and keep their place in the hierarchy. Their new ids
+ * can also be obtained with ecs_shard_forward(). The ChildOf pair of the
+ * migrated entity itself is not migrated, as its parent does not exist in the
+ * destination shard, so the entity becomes a root entity.
+ *
+ * Relationship pairs with a target that does not exist in the destination
+ * shard are not migrated. A name is only migrated if it doesn't conflict with
+ * an existing entity in the destination shard.
+ *
+ * This operation is thread safe.
+ *
+ * @param group The shard group.
+ * @param entity The entity to migrate.
+ * @param shard The destination shard.
+ */
+FLECS_API
+void ecs_shard_migrate(
+    ecs_shard_group_t *group,
+    ecs_entity_t entity,
+    int32_t shard);
+
+/** Return id of migrated entity.
+ * Messages posted for an entity that migrated in the last two synchronizations
+ * are forwarded automatically. Applications that store entity ids should use
+ * this operation to update them.
+ *
+ * @param group The shard group.
+ * @param entity The entity id before migrating.
+ * @return The new id, or the entity itself if it did not recently migrate.
+ */
+FLECS_API
+ecs_entity_t ecs_shard_forward(
+    const ecs_shard_group_t *group,
+    ecs_entity_t entity);
+
+/** Apply messages posted to the shards of a group.
+ * This operation must not be called while shards are progressing.
+ *
+ * @param group The shard group.
+ * @return The number of messages applied.
+ */
+FLECS_API
+int32_t ecs_shard_group_sync(
+    ecs_shard_group_t *group);
+
+/** Progress all shards.
+ * This runs ecs_progress() for each shard in parallel, after which the group
+ * is synchronized with ecs_shard_group_sync(). Shards other than the first
+ * run on tasks (see ecs_os_task_new()).
+ *
+ * @param group The shard group.
+ * @param delta_time The time passed since the last frame.
+ * @return false if ecs_quit() was called in any of the shards, true otherwise.
+ */
+FLECS_API
+bool ecs_shard_group_progress(
+    ecs_shard_group_t *group,
+    ecs_ftime_t delta_time);
+
+/** Post set message for component type. */
+#define ecs_shard_set(group, entity, component, ...)\
+    ecs_shard_set_id(group, entity, ecs_id(component), sizeof(component),\
+        &(component)__VA_ARGS__)
+
+/** Post add message for component type. */
+#define ecs_shard_add(group, entity, T)\
+    ecs_shard_add_id(group, entity, ecs_id(T))
+
+/** Post remove message for component type. */
+#define ecs_shard_remove(group, entity, T)\
+    ecs_shard_remove_id(group, entity, ecs_id(T))
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+#endif // FLECS_SHARD
+
+#endif
+
+#ifdef FLECS_RECORDER
+#ifdef FLECS_NO_RECORDER
+#error "FLECS_NO_RECORDER failed: RECORDER is required by other addons"
+#endif
+/**
+ * @file addons/recorder.h
+ * @brief Event recorder addon.
+ *
+ * The event recorder captures the add, remove and set events of a world in a
+ * ring buffer, without requiring an application observer for each component.
+ * The buffer has a single producer (the thread that owns the world) and a
+ * single consumer, and can be drained from another thread without locking.
+ * Drained events can be inspected, or replayed into another world.
+ */
+
+#ifdef FLECS_RECORDER
+
+#ifndef FLECS_RECORDER_H
+#define FLECS_RECORDER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup c_addons_recorder Recorder
+ * @ingroup c_addons
+ * Record events for analysis and replay.
+ *
+ * @{
+ */
+
+/** Records events of a world. */
+typedef struct ecs_recorder_t ecs_recorder_t;
+
+/** A recorded event. */
+typedef struct ecs_recorded_event_t {
+    ecs_entity_t event;         /**< Event kind (EcsOnAdd, EcsOnSet, ...). */
+    ecs_entity_t entity;        /**< Entity for which event was emitted. */
+    ecs_id_t id;                /**< (Component) id of event. */
+    uint64_t table;             /**< Id of entity table at time of event. */
+    uint32_t table_version;     /**< Table version, changes when rows move. */
+    ecs_size_t size;            /**< Size of payload, 0 if no payload. */
+} ecs_recorded_event_t;
+
+/** Callback type for draining events. */
+typedef void (*ecs_recorder_action_t)(
+    const ecs_recorded_event_t *event,
+    const void *payload,
+    void *ctx);
+
+/** Used with ecs_recorder_init(). */
+typedef struct ecs_recorder_desc_t {
+    /** Size of the ring buffer in bytes. Rounded up to a power of two, 
+     * defaults to 4MB. Events that don't fit are dropped. */
+    ecs_size_t capacity;
+
+    /** Store component values with events. Only values of components without
+     * copy and dtor hooks are stored, as other values may point to memory that
+     * is owned by the world. */
+    bool payload;
+
+    /** Events to record. Defaults to OnAdd, OnRemove and OnSet. */
+    ecs_entity_t events[FLECS_EVENT_DESC_MAX];
+} ecs_recorder_desc_t;
+
+/** Start recording events of a world.
+ * The recorder must be deleted before the world is deleted.
+ *
+ * @param world The world.
+ * @param desc Recorder parameters.
+ * @return The new recorder, or NULL if the recorder could not be created.
+ */
+FLECS_API
+ecs_recorder_t* ecs_recorder_init(
+    ecs_world_t *world,
+    const ecs_recorder_desc_t *desc);
+
+/** Stop recording and delete recorder.
+ *
+ * @param recorder The recorder.
+ */
+FLECS_API
+void ecs_recorder_fini(
+    ecs_recorder_t *recorder);
+
+/** Invoke callback for recorded events, and release them from the buffer.
+ * Can be called from a thread other than the thread that owns the world, as
+ * long as a single thread drains the recorder at a time.
+ *
+ * @param recorder The recorder.
+ * @param action Callback invoked for each event.
+ * @param ctx Context passed to callback.
+ * @return The number of drained events.
+ */
+FLECS_API
+int32_t ecs_recorder_drain(
+    ecs_recorder_t *recorder,
+    ecs_recorder_action_t action,
+    void *ctx);
+
+/** Replay recorded events into a world.
+ * Drains the recorder, and applies each event to the world with 
+ * ecs_recorder_replay_event().
+ *
+ * @param recorder The recorder.
+ * @param world The world to replay the events into.
+ * @return The number of drained events.
+ */
+FLECS_API
+int32_t ecs_recorder_replay(
+    ecs_recorder_t *recorder,
+    ecs_world_t *world);
+
+/** Apply recorded event to a world.
+ * OnAdd and OnRemove events add or remove the id, OnSet events with a payload
+ * assign the value, and other events are emitted for the entity. Entities that
+ * don't exist in the world are created. If the world has an older generation
+ * of the entity alive, it is deleted first. This makes it possible to keep a
+ * replica in sync with the recorded world, provided that both worlds register
+ * components in the same order. The world must not be deferred.
+ *
+ * @param world The world.
+ * @param event The recorded event.
+ * @param payload The recorded component value, or NULL if none.
+ */
+FLECS_API
+void ecs_recorder_replay_event(
+    ecs_world_t *world,
+    const ecs_recorded_event_t *event,
+    const void *payload);
+
+/** Return the number of events dropped because the buffer was full.
+ * Must be called from the thread that owns the recorded world.
+ *
+ * @param recorder The recorder.
+ * @return The number of dropped events.
+ */
+FLECS_API
+int64_t ecs_recorder_dropped(
+    const ecs_recorder_t *recorder);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+#endif // FLECS_RECORDER
+
+#endif
+
 #ifdef FLECS_HTTP
 #ifdef FLECS_NO_HTTP
 #error "FLECS_NO_HTTP failed: HTTP is required by other addons"
@@ -12352,6 +13275,32 @@ FLECS_API
 void ecs_reset_clock(
     ecs_world_t *world);
 
+/** Set time budget for systems per frame.
+ * When the systems in the pipeline are expected to take longer than the 
+ * budget, systems with a negative priority (see ecs_system_desc_t) are ran 
+ * every Nth frame, starting with the lowest priority. The expected time is
+ * computed from a moving average of the time spent in each system, which is
+ * measured while a budget is set. A system that doesn't run in a frame gets
+ * the delta_time of the skipped frames added to the delta_time of the next 
+ * frame in which it runs.
+ * 
+ * The budget is also checked in each frame. A low priority system is deferred
+ * to the next frame when the time spent in the frame so far plus its expected
+ * time exceeds the budget. This check happens right before the system runs, or
+ * for multi threaded systems, before the sync point that runs them starts.
+ * 
+ * Systems are ran at least every FLECS_SYSTEM_DECIMATION_MAX frames. Systems 
+ * with a priority of zero or higher always run. A budget of zero disables the 
+ * scheduler, after which all systems run every frame.
+ * 
+ * @param world The world.
+ * @param budget The time budget in seconds.
+ */
+FLECS_API
+void ecs_set_frame_budget(
+    ecs_world_t *world,
+    ecs_ftime_t budget);
+
 /** Run pipeline.
  * This will run all systems in the provided pipeline. This operation may be
  * invoked from multiple threads, and only when staging is disabled, as the
@@ -12425,6 +13374,77 @@ FLECS_API
 bool ecs_using_task_threads(
     ecs_world_t *world);
 
+/** Used with ecs_set_threads_w_desc(). */
+typedef struct ecs_threads_desc_t {
+    /** Number of threads, including the thread that calls ecs_progress(). */
+    int32_t threads;
+
+    /** Use the task API instead of the thread API, see ecs_set_task_threads(). */
+    bool task_threads;
+
+    /** CPU to bind each thread to. Array with an element for each thread, 
+     * where element 0 is for the calling thread and element N is for worker N.
+     * Use -1 for threads that should not be bound to a CPU. If NULL, no 
+     * threads are bound to a CPU. */
+    const int32_t *cpus;
+
+    /** NUMA node each thread should allocate memory from. Array with an 
+     * element for each thread, laid out like cpus. Because workers allocate 
+     * the memory of their stage after the node is set, this keeps stage 
+     * allocations local to the node of the worker. Use -1 for threads that
+     * should use the default policy. If NULL, the default policy is used for
+     * all threads. */
+    const int32_t *numa_nodes;
+} ecs_threads_desc_t;
+
+/** Set worker threads with configuration.
+ * Same as ecs_set_threads() or ecs_set_task_threads(), but also makes it 
+ * possible to bind threads to CPUs and NUMA nodes, which prevents workers from
+ * migrating between CPUs and from accessing memory on remote NUMA nodes. 
+ * Binding threads requires the OS API to implement thread_set_affinity_. The
+ * builtin POSIX implementation supports this on Linux. If a thread can't be 
+ * bound, a warning is logged and the thread runs without being bound.
+ * 
+ * Workers are always restarted when this operation is called with CPUs or 
+ * NUMA nodes. Settings for the calling thread are applied immediately. When
+ * the OS API implements thread_reset_affinity_, the calling thread is restored
+ * to its original affinity when the settings change or workers are stopped,
+ * which also happens when the world is deleted.
+ * 
+ * @param world The world.
+ * @param desc Thread configuration.
+ */
+FLECS_API
+void ecs_set_threads_w_desc(
+    ecs_world_t *world,
+    const ecs_threads_desc_t *desc);
+
+/** Run systems while commands are merged.
+ * When enabled, a pipeline with worker threads can start systems of the next
+ * multi threaded operation on the workers while the main thread merges the 
+ * commands of a sync point. This happens when all commands of the sync point 
+ * assign values to components that entities already have, without invoking 
+ * OnSet hooks or observers, and only applies to the systems at the start of 
+ * the operation that read none of the assigned components and write no 
+ * components.
+ * 
+ * Because such a merge doesn't change which entities a system matches or the
+ * values a system reads, the systems see the same data as when they would run
+ * after the merge. This assumes that systems only access components through
+ * the terms of their query. Systems with a tick source and systems without
+ * $this terms don't run while merging. Commands enqueued by the systems are
+ * applied after the merged commands.
+ * 
+ * This setting has no effect in deterministic mode.
+ * 
+ * @param world The world.
+ * @param enable Whether to run systems while merging.
+ */
+FLECS_API
+void ecs_set_merge_overlap(
+    ecs_world_t *world,
+    bool enable);
+
 ////////////////////////////////////////////////////////////////////////////////
 //// Module
 ////////////////////////////////////////////////////////////////////////////////
@@ -12554,6 +13574,24 @@ typedef struct ecs_system_desc_t {
     /** If true, system will have access to the actual world. Cannot be true at the
      * same time as multi_threaded. */
     bool immediate;
+
+    /** If set, the system callback is invoked with at most chunk_size entities
+     * per result. For multi threaded systems chunks are distributed across
+     * workers (see ecs_worker_chunk_iter()). */
+    int32_t chunk_size;
+
+    /** If set, the system runs on a fiber and may spend at most time_budget 
+     * seconds per frame. The run callback calls ecs_system_yield() at points
+     * where it can be suspended. When the budget is exceeded, the system is 
+     * suspended and resumed where it left off in the next frame. Requires a 
+     * run callback (or a query without terms), and cannot be combined with 
+     * multi_threaded, immediate or chunk_size. */
+    ecs_ftime_t time_budget;
+
+    /** Priority of the system when a frame budget is set (see 
+     * ecs_set_frame_budget()). Systems with a negative priority run less 
+     * frequently when the budget is exceeded, lowest priority first. */
+    int32_t priority;
 } ecs_system_desc_t;
 
 /** Create a system */
@@ -12587,6 +13625,15 @@ typedef struct ecs_system_t {
     /** Is system ran in immediate mode */
     bool immediate;
 
+    /** Maximum number of entities per result (0 if results aren't split) */
+    int32_t chunk_size;
+
+    /** Time the system may run per frame (0 if system doesn't run on fiber) */
+    ecs_ftime_t time_budget;
+
+    /** Fiber state of system with time budget */
+    struct ecs_system_fiber_t *fiber;
+
     /** Cached system name (for perf tracing) */
     const char *name;
 
@@ -12617,6 +13664,27 @@ typedef struct ecs_system_t {
     /** Last frame for which the system was considered */
     int64_t last_frame;
 
+    /** See ecs_system_desc_t */
+    int32_t priority;
+
+    /** Moving average of time spent per run, measured when frame budget set */
+    ecs_ftime_t time_cost;
+
+    /** System runs every Nth frame (set by frame budget scheduler) */
+    int32_t decimation;
+
+    /** Number of frames skipped since the system last ran */
+    int32_t frames_skipped;
+
+    /** Delta time of skipped frames, added to delta_time when system runs */
+    ecs_ftime_t delta_time_skipped;
+
+    /** Whether system is skipped in current frame */
+    bool skip;
+
+    /** Whether system is deferred if the frame runs out of budget */
+    bool can_defer;
+
     /* Mixins */
     ecs_world_t *world;
     ecs_entity_t entity;
@@ -12636,6 +13704,58 @@ const ecs_system_t* ecs_system_get(
     const ecs_world_t *world,
     ecs_entity_t system);
 
+#ifdef FLECS_PERF_COUNTERS
+
+/** Hardware performance counters for a system. */
+typedef struct ecs_perf_counters_t {
+    uint64_t cycles;               /**< CPU cycles */
+    uint64_t instructions;         /**< Retired instructions */
+    uint64_t l1d_misses;           /**< L1 data cache read misses */
+    uint64_t llc_misses;           /**< Last level cache misses */
+    uint64_t branch_misses;        /**< Mispredicted branches */
+} ecs_perf_counters_t;
+
+/** Get hardware performance counters for a system.
+ * Counters are measured with perf_event_open while system time measurement
+ * is enabled (see ecs_measure_system_time()), and are aggregated over all
+ * threads that ran the system. Counters that are not supported by the
+ * hardware or that the process doesn't have permission for remain zero.
+ *
+ * @param world The world.
+ * @param system The system.
+ * @param result Out parameter for the counter values.
+ * @return Whether counters are available for the system.
+ */
+FLECS_API
+bool ecs_system_perf_counters_get(
+    const ecs_world_t *world,
+    ecs_entity_t system,
+    ecs_perf_counters_t *result);
+
+#endif
+
+/** Suspend a system with a time budget until the next frame.
+ * This operation can be called by the run callback of a system that has a 
+ * time_budget (see ecs_system_desc_t). If the system has run for longer than
+ * its budget in the current frame, the system is suspended and the operation
+ * returns in the next frame the system is ran, after which it returns true. 
+ * Otherwise the operation returns false immediately. For systems without a 
+ * time budget the operation always returns false.
+ * 
+ * When the operation returns true, the iterator has been reset to the first
+ * result of the query for the new frame. Storage can change between frames,
+ * which means that component pointers, as well as iterators other than the
+ * system iterator, must not be kept across a call to this function. State 
+ * that is stored in local variables remains valid. Operations that modify 
+ * the world are always deferred for systems with a time budget.
+ * 
+ * @param it The system iterator.
+ * @return True if the system was suspended, false if not.
+ */
+FLECS_API
+bool ecs_system_yield(
+    ecs_iter_t *it);
+
 #ifndef FLECS_LEGACY
 
 /** Forward declare a system. */
@@ -12893,6 +14013,8 @@ typedef struct ecs_world_stats_t {
         ecs_metric_t discard_count;
         ecs_metric_t batched_entity_count;
         ecs_metric_t batched_count;
+        ecs_metric_t folded_count;
+        ecs_metric_t queue_bytes;
     } commands;
 
     /* Frame data */
@@ -12970,6 +14092,13 @@ typedef struct ecs_query_stats_t {
 typedef struct ecs_system_stats_t {
     int64_t first_;
     ecs_metric_t time_spent;       /**< Time spent processing a system */
+#ifdef FLECS_PERF_COUNTERS
+    ecs_metric_t cycles;           /**< CPU cycles */
+    ecs_metric_t instructions;     /**< Retired instructions */
+    ecs_metric_t l1d_misses;       /**< L1 data cache read misses */
+    ecs_metric_t llc_misses;       /**< Last level cache misses */
+    ecs_metric_t branch_misses;    /**< Mispredicted branches */
+#endif
     int64_t last_;
 
     bool task;                     /**< Is system a task */
@@ -17150,6 +18279,39 @@ extern "C" {
 FLECS_API
 void ecs_set_os_api_impl(void);
 
+#ifdef FLECS_PERF_TRACE
+
+/** Start recording perf trace scopes.
+ * When FLECS_PERF_TRACE is defined, ecs_set_os_api_impl() installs a tracer
+ * for the ecs_os_perf_trace_push() and ecs_os_perf_trace_pop() hooks. After
+ * this function is called, each thread records completed scopes in its own
+ * ring buffer. When a buffer is full, the oldest scopes are overwritten.
+ *
+ * @param events_per_thread Number of scopes stored per thread (0 = default).
+ */
+FLECS_API
+void ecs_perf_trace_start(
+    int32_t events_per_thread);
+
+/** Stop recording perf trace scopes.
+ * If a filename is provided, the recorded scopes are written to the file in
+ * the Chrome trace event format, which can be loaded by chrome://tracing and
+ * Perfetto, or converted with the import-chrome tool of Tracy.
+ *
+ * Scope names are written when the trace is stopped, so the trace must be
+ * stopped before the systems that were traced are deleted. Other threads may
+ * run traced code while the trace is stopped: this function waits for threads
+ * that are recording a scope before it reads and frees their buffers.
+ *
+ * @param filename The file to write the trace to (optional).
+ * @return Zero if success, non-zero if failed to write the file.
+ */
+FLECS_API
+int ecs_perf_trace_stop(
+    const char *filename);
+
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -21700,6 +22862,20 @@ struct world {
         return ecs_should_quit(world_);
     }
 
+    /** Enable or disable deterministic mode.
+     * @see ecs_set_deterministic()
+     */
+    void set_deterministic(bool enable = true) const {
+        ecs_set_deterministic(world_, enable);
+    }
+
+    /** Compute hash of world state.
+     * @see ecs_world_state_hash()
+     */
+    uint64_t state_hash() const {
+        return ecs_world_state_hash(world_);
+    }
+
     /** Begin frame.
      * When an application does not use progress() to control the main loop, it
      * can still use Flecs features such as FPS limiting and time measurements.
@@ -23038,6 +24214,11 @@ void set_target_fps(ecs_ftime_t target_fps) const;
  */
 void reset_clock() const;
 
+/** Set time budget for systems per frame.
+ * @see ecs_set_frame_budget
+ */
+void set_frame_budget(ecs_ftime_t budget) const;
+
 /** Set number of threads.
  * @see ecs_set_threads
  */
@@ -23058,6 +24239,11 @@ void set_task_threads(int32_t task_threads) const;
  */
 bool using_task_threads() const;
 
+/** Run systems while commands are merged.
+ * @see ecs_set_merge_overlap
+ */
+void set_merge_overlap(bool enable = true) const;
+
 /** @} */
 
 #   endif
@@ -23909,6 +25095,26 @@ public:
         ecs_iter_fini(iter_);
     }
 
+#ifdef FLECS_SYSTEM
+    /** Suspend system with time budget until the next frame.
+     * When this operation returns true the iterator has been reset, and values
+     * obtained from the iterator before the call must not be used.
+     *
+     * @see ecs_system_yield()
+     */
+    bool yield() {
+        bool locked = (iter_->flags & EcsIterIsValid) && iter_->table;
+        if (locked) {
+            ECS_TABLE_UNLOCK(iter_->world, iter_->table);
+        }
+        bool result = ecs_system_yield(iter_);
+        if (locked && !result) {
+            ECS_TABLE_LOCK(iter_->world, iter_->table);
+        }
+        return result;
+    }
+#endif
+
 private:
     /* Get field, check if correct type is used */
     template <typename T, typename A = actual_type_t<T>>
@@ -31578,6 +32784,14 @@ struct observer_builder_i : query_builder_i<Base, Components ...> {
         return *this;
     }
 
+    /** Invoke observer asynchronously on worker threads in a pipeline phase.
+     * @param phase The phase in which the queued events are processed.
+     */
+    Base& async(flecs::entity_t phase = flecs::OnUpdate) {
+        desc_->async_phase = phase;
+        return *this;
+    }
+
     /** Set observer flags */
     Base& observer_flags(ecs_flags32_t flags) {
         desc_->flags_ |= flags;
@@ -32018,6 +33232,36 @@ public:
         return *this;
     }
 
+    /** Specify maximum number of entities passed to system per result.
+     *
+     * @param value The chunk size, or 0 to not split up results.
+     */
+    Base& chunk_size(int32_t value) {
+        desc_->chunk_size = value;
+        return *this;
+    }
+
+    /** Specify maximum time system may run per frame.
+     * The system runs on a fiber and is suspended by flecs::iter::yield() when
+     * it runs out of time. Requires a run callback.
+     *
+     * @param value The time budget in seconds.
+     */
+    Base& time_budget(ecs_ftime_t value) {
+        desc_->time_budget = value;
+        return *this;
+    }
+
+    /** Specify system priority for frame budget scheduler.
+     *
+     * @param value The priority, negative for systems that may be skipped.
+     * @see ecs_set_frame_budget()
+     */
+    Base& priority(int32_t value) {
+        desc_->priority = value;
+        return *this;
+    }
+
     /** Specify whether system should be ran in staged context.
      *
      * @param value If false system will always run staged.
@@ -32452,6 +33696,10 @@ inline void world::reset_clock() const {
     ecs_reset_clock(world_);
 }
 
+inline void world::set_frame_budget(ecs_ftime_t budget) const {
+    ecs_set_frame_budget(world_, budget);
+}
+
 inline void world::set_threads(int32_t threads) const {
     ecs_set_threads(world_, threads);
 }
@@ -32468,6 +33716,10 @@ inline bool world::using_task_threads() const {
     return ecs_using_task_threads(world_);
 }
 
+inline void world::set_merge_overlap(bool enable) const {
+    ecs_set_merge_overlap(world_, enable);
+}
+
 }
 
 #endif